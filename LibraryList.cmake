@@ -6,4 +6,5 @@ set(LIBRARY_LIST
     game
     appframework
     rendersystem
+    shaderpack
 )
\ No newline at end of file
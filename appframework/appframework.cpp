@@ -1,9 +1,15 @@
 #include "appframework.h"
 #include "libcommon/module_lib.h"
+#include "libcommon/trace.h"
+#include "rendersystem/irendersystem.h"
+#include "SDL.h"
 
 const String DefaultApp = "game";
 
-void AppFramework::Execute(const Span<String> &args)
+// The application owns the tracer, loaded modules find it through the module dictionary
+static Modules::DeclareModule<Tracer> tracer;
+
+void AppFramework::ParseCommandLine(const Span<String> &args)
 {
 	CurrentApp = DefaultApp;
 
@@ -16,8 +22,43 @@ void AppFramework::Execute(const Span<String> &args)
 			if ( iter != args.end() )
 				CurrentApp = *iter;
 		}
+		else if ( arg == "-headless" )
+		{
+			Headless = true;
+		}
+		else if ( arg == "-frames" )
+		{
+			iter++;
+			if ( iter != args.end() )
+				MaxFrames = std::stoi( *iter );
+		}
+		else if ( arg == "-framesinflight" )
+		{
+			iter++;
+			if ( iter != args.end() )
+				FramesInFlight = std::stoi( *iter );
+		}
+		else if ( arg == "-nodescriptorbuffer" )
+		{
+			DescriptorBuffer = false;
+		}
+		else if ( arg == "-gputrace" )
+		{
+			iter++;
+			if ( iter != args.end() )
+				GpuTracePath = *iter;
+		}
+		else if ( arg == "-trace" )
+		{
+			iter++;
+			if ( iter != args.end() )
+				CpuTracePath = *iter;
+		}
 	}
+}
 
+void AppFramework::Execute()
+{
 	Modules::LibHandle appLib = Modules::LoadLib( CurrentApp );
 	Modules::LibHandle rendersysLib = Modules::LoadLib( "rendersystem" );
 
@@ -26,15 +67,61 @@ void AppFramework::Execute(const Span<String> &args)
 
 	TheApp = Modules::FindModule<IApplication>();
 
+	tracer->SetEnabled( !CpuTracePath.empty() );
+	Trace::SetThreadName( "Main" );
+
+	TheApp->SetHeadless( Headless );
+
+	if ( FramesInFlight > 0 )
+		Modules::FindModule<IRenderSystem>()->SetFramesInFlight( FramesInFlight );
+
+	Modules::FindModule<IRenderSystem>()->SetDescriptorBufferEnabled( DescriptorBuffer );
+
 	if ( !TheApp->Execute() )
 		exit( 0 );
 
-	while ( TheApp->ProccessWindowEvents() )
+	int frameCount = 0;
+	uint64_t frameTicks = 0;
+
+	while ( true )
 	{
-		TheApp->Simulate( 1.0f / 60.0f );
+		TRACE_SCOPE( "AppFrame" );
 
-		TheApp->Frame();
+		{
+			TRACE_SCOPE( "ProccessWindowEvents" );
+			if ( !TheApp->ProccessWindowEvents() )
+				break;
+		}
+
+		uint64_t frameStart = SDL_GetPerformanceCounter();
+
+		{
+			TRACE_SCOPE( "Simulate" );
+			TheApp->Simulate( 1.0f / 60.0f );
+		}
+
+		{
+			TRACE_SCOPE( "Frame" );
+			TheApp->Frame();
+		}
+
+		frameTicks += SDL_GetPerformanceCounter() - frameStart;
+
+		if ( MaxFrames > 0 && ++frameCount >= MaxFrames )
+			break;
 	}
 
+	if ( frameCount > 0 )
+	{
+		double totalMs = 1000.0 * (double)frameTicks / (double)SDL_GetPerformanceFrequency();
+		printf( "%d frames, %.3f ms/frame, %.1f fps\n", frameCount, totalMs / frameCount, 1000.0 * frameCount / totalMs );
+	}
+
+	if ( !CpuTracePath.empty() )
+		tracer->WriteTrace( CpuTracePath.c_str() );
+
+	if ( !GpuTracePath.empty() )
+		Modules::FindModule<IRenderSystem>()->WriteGpuTrace( GpuTracePath.c_str() );
+
 	TheApp->Shutdown();
 }
\ No newline at end of file
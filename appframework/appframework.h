@@ -6,11 +6,33 @@
 class AppFramework
 {
 public:
-    void Execute(const Span<String> &args);
+    void ParseCommandLine(const Span<String> &args);
+
+    void Execute();
+
+    bool IsHeadless() const { return Headless; }
 
 private:
 
     String CurrentApp = "";
 
+    // Run without a window, rendering offscreen only
+    bool Headless = false;
+
+    // Stop after this many frames and report frame timings, 0 runs until quit
+    int MaxFrames = 0;
+
+    // Frames the renderer may record ahead of the GPU, 0 keeps the renderer default
+    int FramesInFlight = 0;
+
+    // Descriptor sets in a buffer when the device supports it, pools otherwise
+    bool DescriptorBuffer = true;
+
+    // Where to write the GPU scope trace on exit, empty to skip
+    String GpuTracePath = "";
+
+    // Where to write the CPU trace on exit, empty leaves tracing off
+    String CpuTracePath = "";
+
     IApplication *TheApp = nullptr;
 };
\ No newline at end of file
@@ -6,17 +6,22 @@ int main(int argc, char *argv[])
 {
     AppFramework framework = AppFramework();
 
-    if ( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+    Array<String> args;
+    for (int i = 0; i < argc; ++i)
+        args.push_back( String(argv[i]));
+
+    framework.ParseCommandLine(Span(args.begin(), args.end()));
+
+    // Headless runs have no display to talk to, only the event queue is needed
+    Uint32 initFlags = framework.IsHeadless() ? SDL_INIT_EVENTS : SDL_INIT_VIDEO;
+
+    if ( SDL_Init( initFlags ) < 0 )
     {
         printf( "Couldn't initialize SDL: %s\n", SDL_GetError() );
         exit( 1 );
     }
 
-    Array<String> args;
-    for (int i = 0; i < argc; ++i)
-        args.push_back( String(argv[i]));
-
-    framework.Execute(Span(args.begin(), args.end()));
+    framework.Execute();
 
     return 0;
 }
\ No newline at end of file
@@ -3,10 +3,24 @@ set(LIBNAME game)
 set(src_dir ${PROJECT_ROOT_PATH}/game)
 
 set(sources ${src_dir}/game_app.cpp)
-set(headers ${src_dir}/game_globals.h ${src_dir}/shaders/baseshader.h ${src_dir}/shaders/screen_triangle.h)
+set(headers ${src_dir}/game_globals.h ${src_dir}/shaders/baseshader.h ${src_dir}/shaders/screen_triangle.h ${src_dir}/shaders/mesh.h)
 
 add_library(${LIBNAME} SHARED ${sources} ${headers} )
 set_property(TARGET game PROPERTY FOLDER "${SLN_FOLDER_PREFIX}ColdSrc")
 
 target_link_libraries(${LIBNAME} PRIVATE SDL3::SDL3)
 
+# Every shader the game loads, packed into one archive next to the executable
+file(GLOB shader_binaries CONFIGURE_DEPENDS ${src_dir}/shaders/*.spv)
+set(shader_archive ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/shaders.pak)
+
+add_custom_command(
+    OUTPUT ${shader_archive}
+    COMMAND shaderpack ${shader_archive} ${shader_binaries}
+    DEPENDS shaderpack ${shader_binaries}
+    COMMENT "Packing shaders"
+)
+add_custom_target(game_shaders DEPENDS ${shader_archive})
+set_property(TARGET game_shaders PROPERTY FOLDER "${SLN_FOLDER_PREFIX}ColdSrc")
+
+add_dependencies(${LIBNAME} game_shaders)
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include "appframework/iapplication.h"
 #include "game_globals.h"
 #include "libcommon/module_lib.h"
+#include "libcommon/trace.h"
 #include "SDL.h"
 
 #include "shaders/screen_triangle.h"
+#include "shaders/mesh.h"
 
 #include <iostream>
 
@@ -21,25 +23,34 @@ public:
 
     virtual const char *GetAppName() { return "Test Game"; };
 
+    virtual void SetHeadless( bool headless ) { IsHeadless = headless; }
+
     // Called when app is first started and shutdown.
     virtual bool Execute() 
     {
         if ( !LoadDependencies() )
             return false;
 
-        SDL_Window *window = SDL_CreateWindow( GetAppName(), 1280, 720, 0 );
+        if ( !rendersys->Create() )
+            return false;
 
-        if ( !window )
+        if ( IsHeadless )
         {
-            std::cout << SDL_GetError();
+            rendersys->AttachHeadless( 1280, 720 );
         }
+        else
+        {
+            SDL_Window *window = SDL_CreateWindow( GetAppName(), 1280, 720, 0 );
 
-        void *hwnd = SDL_GetProperty( SDL_GetWindowProperties( window ), SDL_PROP_WINDOW_WIN32_HWND_POINTER, NULL );
+            if ( !window )
+            {
+                std::cout << SDL_GetError();
+            }
 
-        if ( !rendersys->Create() )
-            return false;
+            void *hwnd = SDL_GetProperty( SDL_GetWindowProperties( window ), SDL_PROP_WINDOW_WIN32_HWND_POINTER, NULL );
 
-        rendersys->AttachWindow( &hwnd, 1280, 720 );
+            rendersys->AttachWindow( &hwnd, 1280, 720 );
+        }
 
         // HDR Render target to support higher color values
         rendertarget = rendersys->CreateRenderTarget(BufferFormat::RGBA16F, 1280, 720);
@@ -49,25 +60,46 @@ public:
         circle_shader = rendersys->CreateShader();
         circle_shader->SetComputeModule(hardwareShader);
 
-        // Build shader input layout
-        DescriptorLayoutEntry layout[] =
-        {
-            {0, DescriptorType::StorageImage, ShaderStage::Compute},
-        };
-        circle_shader_input_layout = rendersys->BuildDescriptorLayout(1, layout);
+        // The shader sizes its groups with constants 0 and 1, let the device pick what suits it
+        circle_shader->SetWorkgroupSize(16, 16, 1);
+        circle_shader->SetWorkgroupAutotune(true);
 
-        // Build shader pipeline according to our input layout
-        circle_shader->BuildPipeline(circle_shader_input_layout);
+        // Reads the render target from the bindless heap, built on a compiler thread next to the other shaders
+        circle_shader->BuildPipelineAsync(rendersys->GetBindlessLayout());
 
-        // Create a new Descriptor set, bind our rendertarget into it, update for changes to take effect
-        circle_shader_descriptor = rendersys->BuildDescriptorSet(circle_shader_input_layout);
-        circle_shader_descriptor->BindImage(0, rendertarget->GetHardwareImageView());
-        circle_shader_descriptor->Update();
+        framegraph = rendersys->CreateFrameGraph();
 
         screen_triangle = new ShaderScreenTriangle();
 
         screen_triangle->Initialize();
 
+        // Quad drawn from GPU buffers, static data ends up in device local memory
+        mesh_shader = new ShaderMesh();
+        mesh_shader->Initialize();
+
+        const MeshVertex quadVertices[] =
+        {
+            { { -0.5f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+            { {  0.5f, -0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f } },
+            { {  0.5f,  0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+            { { -0.5f,  0.5f, 0.0f }, { 1.0f, 1.0f, 1.0f } },
+        };
+        const uint16_t quadIndices[] = { 0, 1, 2, 2, 3, 0 };
+
+        quad_vertices = rendersys->CreateVertexBuffer( sizeof( quadVertices ), sizeof( MeshVertex ), BufferUsageHint::Static, quadVertices );
+        quad_indices = rendersys->CreateIndexBuffer( sizeof( quadIndices ), IndexFormat::UInt16, BufferUsageHint::Static, quadIndices );
+
+        // Every pipeline compiles in parallel, the first frame still gets all of them
+        rendersys->WaitForPipelines();
+
+        // Every pipeline exists by now, a warm start should find all of them in the cache
+        PipelineCacheStats cacheStats = rendersys->GetPipelineCacheStats();
+        std::cout << "pipeline cache: " << cacheStats.CacheHits << "/" << cacheStats.Pipelines << " hits, "
+                  << cacheStats.CreationMs << " ms" << ( cacheStats.LoadedFromDisk ? "" : " (cold)" ) << "\n";
+
+        // Recompiled .spv files show up on the next frame
+        rendersys->SetShaderHotReload( true );
+
         return true;
     }
     virtual void Shutdown()
@@ -99,6 +131,14 @@ public:
             {
                 IsMinimized = false;
             }
+            if (e.type == SDL_EVENT_KEY_DOWN)
+            {
+                // On demand trace dumps, the CPU trace only has events when started with -trace
+                if (e.key.keysym.sym == SDLK_F11)
+                    Trace::WriteTrace("cpu_trace.json");
+                if (e.key.keysym.sym == SDLK_F12)
+                    rendersys->WriteGpuTrace("gpu_trace.json");
+            }
         }
 
         return resume;
@@ -132,22 +172,63 @@ public:
 
         rendersys->BeginRendering();
 
-        rendersys->SetViewport( { 0,0,1280,720 } );
-        rendersys->SetRenderTarget(rendertarget);
+        // Passes run in declaration order, each one is a GPU scope named after it
+        framegraph->Reset();
 
-        rendersys->SetClearColor( clearClr );
-        rendersys->ClearColor();
+        FrameGraphResource scene = framegraph->ImportRenderTarget( "scene", rendertarget );
+        FrameGraphResource backbuffer = framegraph->ImportBackBuffer();
 
-        rendersys->BindShader(screen_triangle->GetRenderShader(), PipelineBindPoint::Graphics);
-
-        rendersys->DrawPrimitive(0, 3);
+        framegraph->AddPass( "screen_triangle",
+            [&]( IFrameGraphBuilder &builder ) { builder.Write( scene, FrameGraphAccess::ColorAttachment ); },
+            [&]( IFrameGraphResources &resources )
+            {
+                // Cleared by the load op, no separate clear of the target
+                RenderPassDesc pass;
+                pass.Color = { resources.GetRenderTarget( scene ), AttachmentLoadOp::Clear, AttachmentStoreOp::Store };
+                pass.ClearColor = clearClr;
+
+                rendersys->BeginPass( pass );
+                rendersys->SetViewport( { 0,0,1280,720 } );
+                rendersys->BindShader( screen_triangle->GetRenderShader(), PipelineBindPoint::Graphics );
+                rendersys->DrawPrimitive( 0, 3 );
+
+                rendersys->BindShader( mesh_shader->GetRenderShader(), PipelineBindPoint::Graphics );
+                rendersys->SetVertexBuffer( quad_vertices );
+                rendersys->SetIndexBuffer( quad_indices );
+                rendersys->DrawIndexedPrimitives( 6 );
+                rendersys->EndPass();
+            } );
+
+        framegraph->AddPass( "circle_cs",
+            [&]( IFrameGraphBuilder &builder )
+            {
+                builder.Read( scene, FrameGraphAccess::ComputeStorage );
+                builder.Write( scene, FrameGraphAccess::ComputeStorage );
+            },
+            [&]( IFrameGraphResources &resources )
+            {
+                // The pass declared the access, the target is in the right layout for the index to be used
+                uint32_t targetIndex = resources.GetRenderTarget( scene )->GetStorageIndex();
 
-        rendersys->BindShader(circle_shader, PipelineBindPoint::Compute);
-        rendersys->BindDescriptorSet(circle_shader_descriptor, PipelineBindPoint::Compute);
+                rendersys->BindShader( circle_shader, PipelineBindPoint::Compute );
+                rendersys->SetPushConstants( &targetIndex, sizeof( targetIndex ) );
+                rendersys->DispatchThreads( 1280, 720, 1 );
+            } );
 
-        rendersys->Dispatch(1280 / 16, 720 / 16, 1);
+        framegraph->AddPass( "present_copy",
+            [&]( IFrameGraphBuilder &builder )
+            {
+                builder.Read( scene, FrameGraphAccess::TransferSrc );
+                builder.Write( backbuffer, FrameGraphAccess::TransferDst );
+            },
+            [&]( IFrameGraphResources &resources )
+            {
+                rendersys->SetRenderTarget( resources.GetRenderTarget( scene ) );
+                rendersys->CopyRenderTargetToBackBuffer();
+            } );
 
-        rendersys->CopyRenderTargetToBackBuffer();
+        if ( !framegraph->Execute() )
+            std::cout << "frame graph failed to compile\n";
 
         rendersys->EndRendering();
         rendersys->Present();
@@ -167,14 +248,18 @@ private:
     }
 
     IRenderTarget* rendertarget;
+    IFrameGraph* framegraph;
     IShader* circle_shader;
-    IDescriptorSet* circle_shader_descriptor;
-    IDescriptorLayout* circle_shader_input_layout;
 
     ShaderScreenTriangle* screen_triangle;
+    ShaderMesh* mesh_shader;
+
+    IVertexBuffer* quad_vertices;
+    IIndexBuffer* quad_indices;
 
     SDL_Window* Window;
     bool IsMinimized = false;
+    bool IsHeadless = false;
 };
 
 static Modules::DeclareModule<GameApp> game_module;
\ No newline at end of file
@@ -10,11 +10,12 @@ public:
         internal_shader = rendersys->CreateShader();
     }
 
+    // The pipeline is compiled in the background, see IRenderSystem::WaitForPipelines
     void Initialize()
     {
         Snapshot();
 
-        internal_shader->BuildPipeline(layout);
+        internal_shader->BuildPipelineAsync(layout);
     }
 
     IShader *GetRenderShader()
@@ -53,6 +54,14 @@ protected:
     {
         internal_shader->SetCullMode(cullFlags, winding);
     }
+    void SetVertexLayout(uint32_t stride, uint32_t numAttributes, VertexAttribute *attributes)
+    {
+        internal_shader->SetVertexLayout(stride, numAttributes, attributes);
+    }
+    void SetAttachmentFormats(BufferFormat color, BufferFormat depth)
+    {
+        internal_shader->SetAttachmentFormats(color, depth);
+    }
 
     void SetDescriptorLayout(uint32_t numEntries, DescriptorLayoutEntry* entries)
     {
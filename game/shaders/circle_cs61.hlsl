@@ -1,17 +1,34 @@
-RWTexture2D<float4> InTexture : register( u0 );
+// Storage images of the bindless heap, the one to draw into is picked through push constants
+[[vk::binding( 0, 0 )]] RWTexture2D<float4> StorageImages[];
+
+struct CircleConstants
+{
+    uint TargetIndex;
+};
+[[vk::push_constant]] CircleConstants Constants;
 
 float sdCircle( in float2 p, in float r ) 
 {
     return length(p)-r;
 }
 
-[numthreads( 16, 16, 1 )]
+// Workgroup size is picked at pipeline creation, see IShader::SetWorkgroupSize
+[[vk::constant_id(0)]] const uint TileSizeX = 16;
+[[vk::constant_id(1)]] const uint TileSizeY = 16;
+
+[numthreads( TileSizeX, TileSizeY, 1 )]
 void main( uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID,
 uint3 GTid : SV_GroupThreadID, uint Gidx : SV_GroupIndex )
 {
+    RWTexture2D<float4> InTexture = StorageImages[Constants.TargetIndex];
+
     uint2 inDims;
 	InTexture.GetDimensions(inDims.x, inDims.y );
 
+    // Groups at the edges reach past the texture when its size isn't a multiple of the tile
+    if(any(DTid.xy >= inDims))
+        return;
+
     float2 screenPos = float2(2.0f * DTid.xy - inDims) / inDims.y;
     float circle = sdCircle(screenPos, 0.5f);
 
@@ -0,0 +1,33 @@
+#pragma once
+#include "baseshader.h"
+
+#include <cstddef>
+
+// Interleaved vertex read by mesh_vs61
+struct MeshVertex
+{
+    float Position[3];
+    float Color[3];
+};
+
+class ShaderMesh : public BaseShader
+{
+protected:
+
+    virtual void Snapshot()
+    {
+        SetVertexShader("mesh_vs61.spv");
+        SetFragmentShader("triangle_ps61.spv");
+
+        VertexAttribute attributes[] =
+        {
+            { 0, BufferFormat::RGB32F, offsetof(MeshVertex, Position) },
+            { 1, BufferFormat::RGB32F, offsetof(MeshVertex, Color) },
+        };
+        SetVertexLayout(sizeof(MeshVertex), 2, attributes);
+
+        SetTopology(PrimitiveTopology::Triangles);
+        SetPolygonMode(PolygonMode::Fill);
+        SetCullMode(CullModeFlags::None, PolygonWinding::CounterClockwise);
+    }
+};
\ No newline at end of file
@@ -0,0 +1,22 @@
+struct VS_Input
+{
+    float3 Pos : POSITION;
+    float3 Color : COLOR0;
+};
+
+struct VS_Output
+{
+	float4 Pos : SV_POSITION;
+    float3 Color : COLOR0;
+};
+
+// Vertices come from a vertex buffer, location 0 is the position and 1 the color
+VS_Output main(VS_Input i)
+{
+    VS_Output o;
+
+    o.Pos = float4(i.Pos, 1.0f);
+    o.Color = i.Color;
+
+    return o;
+}
\ No newline at end of file
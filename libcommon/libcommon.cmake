@@ -7,11 +7,14 @@ set(public_dir ${PROJECT_ROOT_PATH}/public/libcommon)
 set(sources 
     ${src_dir}/module_factory.cpp
     ${src_dir}/module_lib.cpp
+    ${src_dir}/trace.cpp
 
 )
 set(headers 
     ${public_dir}/module_factory.h
     ${public_dir}/module_lib.h
+    ${public_dir}/trace.h
+    ${public_dir}/hash.h
 )
 
 add_library(${LIBNAME} STATIC ${sources} ${headers} )
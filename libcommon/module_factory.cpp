@@ -1,7 +1,7 @@
 #include "libcommon/module_factory.h"
 
 
-extern "C" _declspec( dllexport ) ModuleDictionary *GetGlobalModuleDict()
+extern "C" MODULE_EXPORT ModuleDictionary *GetGlobalModuleDict()
 {
     static ModuleDictionary s_dict;
     return &s_dict;
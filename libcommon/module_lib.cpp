@@ -2,6 +2,17 @@
 
 #include "SDL.h"
 
+static String GetLibraryPath( const String &name )
+{
+#ifdef _WIN32
+	return name + ".dll";
+#else
+	// Shared libraries are not searched next to the executable outside of Windows
+	const char *basePath = SDL_GetBasePath();
+	return String( basePath ? basePath : "" ) + "lib" + name + ".so";
+#endif
+}
+
 static GetGlobalModuleDict_Function *FindGetFunction( Modules::LibHandle libHandle )
 {
 	GetGlobalModuleDict_Function *hFunc = reinterpret_cast<GetGlobalModuleDict_Function *>( SDL_LoadFunction( libHandle, "GetGlobalModuleDict" ) );
@@ -13,7 +24,9 @@ namespace Modules {
 
 	LibHandle LoadLib( String name )
 	{
-		LibHandle lib = SDL_LoadObject( ( name + ".dll" ).c_str() );
+		LibHandle lib = SDL_LoadObject( GetLibraryPath( name ).c_str() );
+		if ( !lib )
+			return nullptr;
 
 		auto OtherModuleDict = Modules::GetLibraryModuleDict( lib );
 		if ( !OtherModuleDict )
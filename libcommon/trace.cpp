@@ -0,0 +1,180 @@
+#include "libcommon/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+void Tracer::SetEnabled(bool enabled)
+{
+	Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Tracer::IsEnabled()
+{
+	return Enabled.load(std::memory_order_relaxed);
+}
+
+TraceThreadBuffer *Tracer::RegisterThread()
+{
+	std::lock_guard<std::mutex> lock(BuffersMutex);
+
+	std::unique_ptr<TraceThreadBuffer> buffer = std::make_unique<TraceThreadBuffer>();
+	buffer->ThreadId = GetThreadId();
+	buffer->Events.resize(TraceThreadBuffer::Capacity);
+
+	Buffers.push_back(std::move(buffer));
+
+	return Buffers.back().get();
+}
+
+void Tracer::SetThreadName(const char *name)
+{
+	std::lock_guard<std::mutex> lock(BuffersMutex);
+
+	ThreadNames[GetThreadId()] = name;
+}
+
+uint32_t Tracer::GetThreadId()
+{
+	// BuffersMutex is held by the caller
+	auto iter = ThreadIds.try_emplace(std::this_thread::get_id(), (uint32_t)ThreadIds.size() + 1).first;
+	return iter->second;
+}
+
+bool Tracer::WriteTrace(const char *filepath)
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+
+	std::lock_guard<std::mutex> lock(BuffersMutex);
+
+	// Copy out what each thread has recorded so far, the threads keep going meanwhile
+	Array<TraceEvent> events;
+	Array<uint32_t> eventThreads;
+	uint64_t origin = UINT64_MAX;
+
+	for (auto &buffer : Buffers)
+	{
+		uint64_t count = buffer->WriteCount.load(std::memory_order_acquire);
+		uint64_t first = count > TraceThreadBuffer::Capacity ? count - TraceThreadBuffer::Capacity : 0;
+
+		size_t copied = events.size();
+		for (uint64_t i = first; i < count; ++i)
+			events.push_back(buffer->Events[i % TraceThreadBuffer::Capacity]);
+
+		// Slots the owner claimed while they were copied, the oldest ones, may be torn
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t claimed = buffer->ClaimCount.load(std::memory_order_relaxed);
+		uint64_t firstIntact = claimed > TraceThreadBuffer::Capacity ? claimed - TraceThreadBuffer::Capacity : 0;
+
+		if (firstIntact > first)
+			events.erase(events.begin() + copied, events.begin() + copied + (size_t)std::min(firstIntact - first, count - first));
+
+		eventThreads.resize(events.size(), buffer->ThreadId);
+		for (size_t i = copied; i < events.size(); ++i)
+			origin = std::min(origin, events[i].StartNs);
+	}
+
+	file << std::fixed;
+	file.precision(3);
+
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}}";
+
+	for (auto &threadName : ThreadNames)
+	{
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << threadName.first
+			<< ",\"args\":{\"name\":\"" << Trace::EscapeJson(threadName.second.c_str()) << "\"}}";
+	}
+
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		const TraceEvent &ev = events[i];
+
+		file << ",\n{\"name\":\"" << Trace::EscapeJson(ev.Name) << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":" << eventThreads[i]
+			<< ",\"ts\":" << (double)(ev.StartNs - origin) / 1000.0
+			<< ",\"dur\":" << (double)(ev.EndNs - ev.StartNs) / 1000.0 << "}";
+	}
+
+	file << "\n]}\n";
+
+	return true;
+}
+
+namespace Trace
+{
+	static ITracer *FindTracer()
+	{
+		// Cached per module once found, the tracer lives as long as the application
+		static ITracer *s_tracer = nullptr;
+		if (!s_tracer)
+			s_tracer = Modules::FindModule<ITracer>();
+
+		return s_tracer;
+	}
+
+	uint64_t GetTimeNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	TraceThreadBuffer *GetThreadBuffer()
+	{
+		ITracer *tracer = FindTracer();
+		if (!tracer || !tracer->IsEnabled())
+			return nullptr;
+
+		thread_local TraceThreadBuffer *t_buffer = nullptr;
+		if (!t_buffer)
+			t_buffer = tracer->RegisterThread();
+
+		return t_buffer;
+	}
+
+	void SetThreadName(const char *name)
+	{
+		if (ITracer *tracer = FindTracer())
+			tracer->SetThreadName(name);
+	}
+
+	bool WriteTrace(const char *filepath)
+	{
+		ITracer *tracer = FindTracer();
+		if (!tracer)
+			return false;
+
+		return tracer->WriteTrace(filepath);
+	}
+
+	String EscapeJson(const char *text)
+	{
+		String escaped;
+		for (const char *c = text; c && *c; ++c)
+		{
+			switch (*c)
+			{
+			case '"': escaped += "\\\""; break;
+			case '\\': escaped += "\\\\"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\r': escaped += "\\r"; break;
+			case '\t': escaped += "\\t"; break;
+			default:
+				if ((unsigned char)*c < 0x20)
+				{
+					char code[7];
+					snprintf(code, sizeof(code), "\\u%04x", (unsigned char)*c);
+					escaped += code;
+				}
+				else
+				{
+					escaped += *c;
+				}
+				break;
+			}
+		}
+
+		return escaped;
+	}
+}
\ No newline at end of file
@@ -13,6 +13,9 @@ public:
 
     virtual const char *GetAppName() = 0;
 
+    // Run without a window, frames are rendered offscreen. Set before Execute.
+    virtual void SetHeadless(bool headless) = 0;
+
     // Called when app is first started and shutdown.
     virtual bool Execute() = 0;
     virtual void Shutdown() = 0;
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Non-cryptographic hashing for cache keys. Stable across runs and platforms, so hashes can go to disk.
+namespace Hash
+{
+    constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+    // 64-bit FNV-1a, pass a previous result as seed to hash several pieces as one
+    inline uint64_t Fnv1a(const void *data, size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    // Fold another hash in, order matters
+    inline uint64_t Combine(uint64_t hash, uint64_t value)
+    {
+        return Fnv1a(&value, sizeof(value), hash);
+    }
+}
\ No newline at end of file
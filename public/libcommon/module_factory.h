@@ -2,6 +2,12 @@
 
 #include "common_stl.h"
 
+#ifdef _WIN32
+#define MODULE_EXPORT __declspec( dllexport )
+#else
+#define MODULE_EXPORT __attribute__( ( visibility( "default" ) ) )
+#endif
+
 class IModule;
 
 template <class T>
@@ -92,7 +98,7 @@ public:
     String Classname = "UNDEFINED MODULE CLASS";
 };
 
-extern "C" _declspec(dllexport) ModuleDictionary *GetGlobalModuleDict();
+extern "C" MODULE_EXPORT ModuleDictionary *GetGlobalModuleDict();
 using GetGlobalModuleDict_Function = decltype(GetGlobalModuleDict);
 
 namespace Modules
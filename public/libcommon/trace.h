@@ -0,0 +1,143 @@
+#pragma once
+
+#include "common_stl.h"
+#include "libcommon/module_lib.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Lightweight scoped CPU spans, written out as Chrome trace event JSON which Perfetto also opens.
+//
+// Every thread records into its own ring of events without taking any locks. The tracer only
+// locks when a thread records its first span and when a trace is written. Rings wrap around,
+// so a trace holds the most recent events of each thread. Events overwritten while a trace is
+// being written are left out of it rather than written half old, half new.
+
+struct TraceEvent
+{
+    const char *Name;
+    uint64_t StartNs;
+    uint64_t EndNs;
+};
+
+struct TraceThreadBuffer
+{
+    static constexpr uint32_t Capacity = 1 << 16;
+
+    uint32_t ThreadId = 0;
+
+    // Single writer, the owning thread. Readers acquire the count before reading events, and check
+    // the claim after: events whose slot was claimed meanwhile may have been torn by the writer.
+    std::atomic<uint64_t> WriteCount = 0;
+    std::atomic<uint64_t> ClaimCount = 0;
+    Array<TraceEvent> Events;
+
+    void Push(const TraceEvent &ev)
+    {
+        uint64_t idx = WriteCount.load(std::memory_order_relaxed);
+
+        // Ordered before the slot is overwritten
+        ClaimCount.store(idx + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Events[idx % Capacity] = ev;
+        WriteCount.store(idx + 1, std::memory_order_release);
+    }
+};
+
+class ITracer : public IModule
+{
+public:
+
+    static constexpr const char *ModuleName = "Tracer";
+
+    ITracer() : IModule( ModuleName ) {}
+
+    virtual void SetEnabled(bool enabled) = 0;
+    virtual bool IsEnabled() = 0;
+
+    // Buffer the calling thread records into, one per thread and module
+    virtual TraceThreadBuffer *RegisterThread() = 0;
+
+    virtual void SetThreadName(const char *name) = 0;
+
+    // Can be called at any time, threads keep recording while the file is written
+    virtual bool WriteTrace(const char *filepath) = 0;
+};
+
+// Owned by the application, every other module reaches it through the module dictionary
+class Tracer : public ITracer
+{
+public:
+    virtual void *GetInterface() { return static_cast<ITracer *>(this); }
+
+    virtual void SetEnabled(bool enabled);
+    virtual bool IsEnabled();
+
+    virtual TraceThreadBuffer *RegisterThread();
+
+    virtual void SetThreadName(const char *name);
+
+    virtual bool WriteTrace(const char *filepath);
+
+private:
+
+    uint32_t GetThreadId();
+
+    std::atomic<bool> Enabled = false;
+
+    std::mutex BuffersMutex;
+    Array<std::unique_ptr<TraceThreadBuffer>> Buffers;
+
+    // Modules each keep their own buffer per thread, events of one thread share a track
+    Dict<std::thread::id, uint32_t> ThreadIds;
+    Dict<uint32_t, String> ThreadNames;
+};
+
+namespace Trace
+{
+    uint64_t GetTimeNs();
+
+    // Null when tracing is disabled or no tracer is loaded
+    TraceThreadBuffer *GetThreadBuffer();
+
+    void SetThreadName(const char *name);
+
+    bool WriteTrace(const char *filepath);
+
+    // Quotes, backslashes and control characters escaped, for names written into the JSON of a trace
+    String EscapeJson(const char *text);
+}
+
+class TraceScope
+{
+public:
+    TraceScope(const char *name)
+    {
+        Buffer = Trace::GetThreadBuffer();
+        if (Buffer)
+        {
+            Name = name;
+            StartNs = Trace::GetTimeNs();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (Buffer)
+            Buffer->Push({ Name, StartNs, Trace::GetTimeNs() });
+    }
+
+private:
+    TraceThreadBuffer *Buffer = nullptr;
+    const char *Name = nullptr;
+    uint64_t StartNs = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Names must outlive the trace, use string literals
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
\ No newline at end of file
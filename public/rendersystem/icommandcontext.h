@@ -0,0 +1,36 @@
+#pragma once
+#include "rendersystem/rendersystem_types.h"
+
+class IRenderTarget;
+class IShader;
+class IDescriptorSet;
+
+// Records commands on a worker thread. Acquire it from the rendersystem between BeginRendering and
+// EndRendering, record, End it, then hand it back through IRenderSystem::ExecuteCommandContexts.
+// A context is only ever used by one thread at a time.
+class ICommandContext
+{
+public:
+
+    // Graphics contexts record draws into a render pass on the target, nullptr for the backbuffer.
+    // Compute contexts record outside of any render pass, the target is ignored.
+    virtual void Begin(CommandContextType type, IRenderTarget *target) = 0;
+    virtual void End() = 0;
+
+    virtual void SetViewport(Viewport settings) = 0;
+    virtual void SetScissorRectangle(ScissorRectangle settings) = 0;
+
+    virtual void BindShader(IShader *shader, PipelineBindPoint point) = 0;
+    virtual void BindDescriptorSet(IDescriptorSet *set, PipelineBindPoint point, const uint32_t *constantOffsets = nullptr, uint32_t numOffsets = 0) = 0;
+    virtual void SetPushConstants(const void *data, uint32_t size, uint32_t offset = 0) = 0;
+
+    virtual void SetVertexBuffer(IVertexBuffer *buffer) = 0;
+    virtual void SetIndexBuffer(IIndexBuffer *buffer) = 0;
+
+    virtual void DrawPrimitive(int first_vertex, int vertex_count) = 0;
+    virtual void DrawIndexedPrimitives(int index_count, int first_index = 0, int base_vertex = 0, int instance_count = 1, int first_instance = 0) = 0;
+    virtual void Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ) = 0;
+
+    // Same as IRenderSystem::DispatchThreads, with the sizes tuning settled on so far
+    virtual void DispatchThreads(uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ) = 0;
+};
\ No newline at end of file
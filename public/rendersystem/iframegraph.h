@@ -0,0 +1,89 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/rendersystem_types.h"
+
+class IRenderTarget;
+
+// Handle to a render target declared in a frame graph, valid until the graph is reset
+using FrameGraphResource = uint32_t;
+constexpr FrameGraphResource FRAMEGRAPH_INVALID_RESOURCE = UINT32_MAX;
+
+// How a pass touches a resource, decides the barrier placed in front of the pass
+enum class FrameGraphAccess : unsigned char
+{
+    ColorAttachment = 0,
+    DepthAttachment,
+    ComputeStorage,
+    GraphicsStorage,
+    ShaderRead,
+    TransferSrc,
+    TransferDst,
+};
+
+struct FrameGraphTextureDesc
+{
+    BufferFormat Format;
+    int Width, Height;
+};
+
+struct FrameGraphStats
+{
+    uint32_t Passes;
+    uint32_t CulledPasses;
+    uint32_t TransientTextures;
+    uint64_t TransientBytes;  // size of the one allocation backing every transient texture
+    uint64_t RequestedBytes;  // what the transient textures would take without aliasing
+    uint32_t Compiles;        // times the graph topology changed
+};
+
+// Used while declaring a pass
+class IFrameGraphBuilder
+{
+public:
+
+    // Texture that only lives inside this frame, its memory is shared with transients of passes it never overlaps.
+    // Contents are undefined until the pass writes them.
+    virtual FrameGraphResource CreateTexture(const char *name, const FrameGraphTextureDesc &desc) = 0;
+
+    virtual void Read(FrameGraphResource resource, FrameGraphAccess access) = 0;
+    virtual void Write(FrameGraphResource resource, FrameGraphAccess access) = 0;
+
+    // Keep the pass even if nothing reads what it writes
+    virtual void SideEffect() = 0;
+};
+
+// Used while a pass executes
+class IFrameGraphResources
+{
+public:
+
+    // nullptr for the back buffer, so it can go straight to IRenderSystem::SetRenderTarget
+    virtual IRenderTarget *GetRenderTarget(FrameGraphResource resource) = 0;
+};
+
+using FrameGraphSetupFunc = std::function<void(IFrameGraphBuilder &builder)>;
+using FrameGraphExecuteFunc = std::function<void(IFrameGraphResources &resources)>;
+
+// Declarative description of a frame. Passes are declared every frame in submission order,
+// the graph only recompiles when the topology changes. Compiling culls passes that contribute
+// to no imported resource, and places transient textures in one aliased allocation.
+// Passes record through the immediate IRenderSystem calls, between BeginRendering and EndRendering.
+class IFrameGraph
+{
+public:
+
+    // Start declaring a new frame
+    virtual void Reset() = 0;
+
+    // Resources that outlive the frame, writes to them are what keeps passes alive
+    virtual FrameGraphResource ImportRenderTarget(const char *name, IRenderTarget *target) = 0;
+    virtual FrameGraphResource ImportBackBuffer() = 0;
+
+    virtual void AddPass(const char *name, FrameGraphSetupFunc setup, FrameGraphExecuteFunc execute) = 0;
+
+    // Compile if needed, then run the surviving passes in order.
+    // False when the graph can't be compiled, e.g. out of memory for the transients, nothing runs then.
+    virtual bool Execute() = 0;
+
+    virtual FrameGraphStats GetStats() = 0;
+};
\ No newline at end of file
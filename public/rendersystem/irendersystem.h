@@ -1,6 +1,8 @@
 #pragma once
 #include "libcommon/module_lib.h"
 #include "rendersystem/rendersystem_types.h"
+#include "rendersystem/icommandcontext.h"
+#include "rendersystem/iframegraph.h"
 
 class IRenderTarget
 {
@@ -9,6 +11,57 @@ public:
     virtual HImage GetHardwareImage() = 0;
     virtual HImageView GetHardwareImageView() = 0;
 
+    // Indices in the bindless heap, BINDLESS_INVALID_INDEX when the format can't be used that way
+    virtual uint32_t GetStorageIndex() = 0;
+    virtual uint32_t GetSampledIndex() = 0;
+
+};
+
+// Host writes to Dynamic and Stream buffers are not synchronized with the frames in flight,
+// write ranges the GPU is not reading, e.g. one region per frame slot.
+class IVertexBuffer
+{
+public:
+
+    // Copy into the buffer, offset and size in bytes
+    virtual bool Update(const void *data, uint32_t size, uint32_t offset = 0) = 0;
+
+    virtual uint32_t GetSize() = 0;
+    virtual uint32_t GetStride() = 0;
+
+    // Index of the buffer in the bindless heap, read as a storage buffer
+    virtual uint32_t GetBindlessIndex() = 0;
+};
+
+class IIndexBuffer
+{
+public:
+
+    // Copy into the buffer, offset and size in bytes
+    virtual bool Update(const void *data, uint32_t size, uint32_t offset = 0) = 0;
+
+    virtual uint32_t GetSize() = 0;
+    virtual IndexFormat GetIndexFormat() = 0;
+
+    // Index of the buffer in the bindless heap, read as a storage buffer
+    virtual uint32_t GetBindlessIndex() = 0;
+};
+
+struct RenderPassAttachment
+{
+    IRenderTarget *Target;  // nullptr color target is the back buffer
+    AttachmentLoadOp Load;
+    AttachmentStoreOp Store;
+};
+
+struct RenderPassDesc
+{
+    RenderPassAttachment Color = { nullptr, AttachmentLoadOp::Load, AttachmentStoreOp::Store };
+    ColorFloat ClearColor = {};
+
+    bool UseDepth = false;
+    RenderPassAttachment Depth = { nullptr, AttachmentLoadOp::Clear, AttachmentStoreOp::DontCare };
+    float ClearDepth = 1.0f;
 };
 
 class IShader;
@@ -29,12 +82,58 @@ public:
     // Attach the rendering system to a window
     virtual void AttachWindow(void *window_handle, int w, int h) = 0;
 
+    // Attach the rendering system to offscreen back buffers instead of a window.
+    // No swapchain is created, Present retires the frame without showing it.
+    virtual void AttachHeadless(int w, int h) = 0;
+
     virtual IRenderTarget* CreateRenderTarget(BufferFormat fmt, int width, int height) = 0;
+
+    // Main thread only. Render target from a pool keyed on format and size, for intermediate targets asked for
+    // every frame. Contents are undefined. Release it once the commands using it are recorded, it is handed out
+    // again when the GPU is done with that frame.
+    virtual IRenderTarget* AcquireRenderTarget(BufferFormat fmt, int width, int height) = 0;
+    virtual void ReleaseRenderTarget(IRenderTarget* target) = 0;
+
+    // Frames a released pooled target is kept unused before it is destroyed, 0 keeps them until shutdown
+    virtual void SetRenderTargetEviction(uint32_t frames) = 0;
+
     virtual IDescriptorLayout* BuildDescriptorLayout(uint32_t numEntries, DescriptorLayoutEntry* entries) = 0;
     virtual IDescriptorSet* BuildDescriptorSet(IDescriptorLayout *layout) = 0;
+
+    // Thread safe. Only valid for the frame being recorded, owned by the rendering system and reused by a later frame
+    virtual IDescriptorSet* BuildTransientDescriptorSet(IDescriptorLayout *layout) = 0;
+
+    // Layout of the bindless heap, for shaders that reach render targets and buffers by their index.
+    // Binding such a shader binds the heap, no descriptor sets are needed.
+    virtual IDescriptorLayout* GetBindlessLayout() = 0;
     virtual IShader* CreateShader() = 0;
 
+    // Size in bytes, initial data is optional
+    virtual IVertexBuffer* CreateVertexBuffer(uint32_t size, uint32_t stride, BufferUsageHint usage, const void *data = nullptr) = 0;
+    virtual IIndexBuffer* CreateIndexBuffer(uint32_t size, IndexFormat format, BufferUsageHint usage, const void *data = nullptr) = 0;
+
+    // Declarative alternative to building the frame from immediate calls, owned by the rendersystem
+    virtual IFrameGraph* CreateFrameGraph() = 0;
+
+    // Modules are cached by path and code, loading the same SPIR-V again costs no disk read or driver call.
+    // Every load holds a reference, pass it on to a shader or give it back with ReleaseShaderModule.
     virtual HShader LoadShaderModule(const char* filepath) = 0;
+    virtual void ReleaseShaderModule(HShader module) = 0;
+
+    // Block until every pipeline started with IShader::BuildPipelineAsync is ready
+    virtual void WaitForPipelines() = 0;
+
+    // Watch the loaded shader modules for changes on disk. Shaders using a changed file get their pipeline
+    // rebuilt in the background and swapped in at the start of a frame, the old one keeps drawing until then.
+    virtual void SetShaderHotReload(bool enable) = 0;
+
+    // Fill a color render target with tightly packed texels.
+    // Runs on the transfer queue when the target was never rendered to, visible to the frames that begin afterwards.
+    virtual bool UploadRenderTarget(IRenderTarget *target, const void *data, uint32_t size) = 0;
+
+    // Thread safe. Mapped memory for shader constants, valid until the end of the current frame.
+    // Write the constants there and pass the offset to BindDescriptorSet. nullptr when the frame ran out of space.
+    virtual void* AllocateConstants(uint32_t size, uint32_t &offset) = 0;
 
     // Begin rendering
     virtual void BeginRendering() = 0;
@@ -43,8 +142,17 @@ public:
     virtual void EndRendering() = 0;
 
     virtual void SetClearColor(ColorFloat &color) = 0;
+
+    // Clears the bound render target. Outside of a pass the clear becomes the load op
+    // of the next pass drawing into that target, so it costs no separate clear.
     virtual void ClearColor() = 0;
 
+    // Draws until EndPass share one rendering instance. Transitions happen here, so images
+    // used by the draws must be bound before, and dispatches or copies don't belong in a pass.
+    // Draws outside of an explicit pass open one on the bound render target as needed.
+    virtual void BeginPass(const RenderPassDesc &desc) = 0;
+    virtual void EndPass() = 0;
+
     // Set the render target
     // Set nullptr to clear
     virtual void SetRenderTarget(IRenderTarget *target) = 0;
@@ -56,10 +164,19 @@ public:
     virtual void SetScissorRectangle(ScissorRectangle settings) = 0;
 
     // Set the current shader to render the mesh
-    // Set to nullptr to clear
+    // Set to nullptr to clear. Until a shader is ready, binds, draws and dispatches using it are skipped.
     virtual void BindShader(IShader *shader, PipelineBindPoint point) = 0;
 
-    virtual void BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point) = 0;
+    // One offset from AllocateConstants per constant buffer binding of the set, in binding order
+    virtual void BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point, const uint32_t *constantOffsets = nullptr, uint32_t numOffsets = 0) = 0;
+
+    // Render targets the following draws or dispatches reach through the bindless heap, instead of a bound set.
+    // Frame graph passes don't need it, the accesses they declare are transitioned already.
+    virtual void UseBindlessTarget(IRenderTarget *target, FrameGraphAccess access) = 0;
+
+    // Write into the push constant range of the bound shader, offset and size in bytes.
+    // Values stay set for following draws and dispatches until overwritten.
+    virtual void SetPushConstants(const void *data, uint32_t size, uint32_t offset = 0) = 0;
 
     // Set the vertex buffer
     virtual void SetVertexBuffer(IVertexBuffer *buffer) = 0;
@@ -70,8 +187,8 @@ public:
     // Draw a primitive
     virtual void DrawPrimitive(int first_vertex, int vertex_count) = 0;
 
-    // Draw indexed primitives
-    virtual void DrawIndexedPrimitives(int index_count) = 0;
+    // Draw indexed primitives, base_vertex is added to every index
+    virtual void DrawIndexedPrimitives(int index_count, int first_index = 0, int base_vertex = 0, int instance_count = 1, int first_instance = 0) = 0;
 
     virtual void CopyRenderTargetToBackBuffer() = 0;
 
@@ -80,15 +197,72 @@ public:
 
     virtual void Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ) = 0;
 
+    // Dispatch at least this many threads, grouped by the workgroup size of the bound compute shader.
+    // Autotuned shaders may run with another size, the shader has to skip the threads past the end itself.
+    virtual void DispatchThreads(uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ) = 0;
+
+    // Compute binds and dispatches in between run on the async compute queue, overlapping the graphics work recorded
+    // after EndAsyncCompute. They see everything recorded before BeginAsyncCompute. Not inside a pass.
+    // Runs inline when the device has no separate compute queue.
+    virtual void BeginAsyncCompute() = 0;
+    virtual void EndAsyncCompute() = 0;
+
+    // Commands recorded after this see the results of the async compute work, otherwise the end of the frame does.
+    // Pipelines and buffers have to be bound again afterwards.
+    virtual void WaitAsyncCompute() = 0;
+
+    // Thread safe. Hands out a context to record commands on another thread for the current frame.
+    virtual ICommandContext* AcquireCommandContext() = 0;
+
+    // Main thread only. Executes ended contexts in the given order and returns them to the rendersystem,
+    // consecutive graphics contexts on the same target share one render pass.
+    virtual void ExecuteCommandContexts(ICommandContext **contexts, uint32_t count) = 0;
+
     // Destroy the rendering system
     virtual void Destroy() = 0;
 
-    // Set the blend state
+    // How many frames the CPU may record ahead of the GPU, clamped to 1-4.
+    // Lower values cut latency, higher values keep the GPU busier. Waits for the GPU when changed.
+    virtual void SetFramesInFlight(int count) = 0;
+    virtual int GetFramesInFlight() = 0;
+
+    // Keep descriptor sets in a buffer through VK_EXT_descriptor_buffer when the device supports it, in descriptor
+    // pools otherwise. On by default. Decided when the device is created, so it has to be set before attaching.
+    virtual void SetDescriptorBufferEnabled(bool enable) = 0;
+
+    // Whether the device that was created keeps descriptor sets in a buffer
+    virtual bool IsDescriptorBufferActive() = 0;
+
+    // Number of the frame being recorded, frames are numbered from 1
+    virtual uint64_t GetCurrentFrame() = 0;
+
+    // Latest frame number the GPU has finished executing
+    virtual uint64_t GetCompletedFrame() = 0;
+
+    // Block until the GPU has finished the given frame, returns false on timeout
+    virtual bool WaitForFrame(uint64_t frame, uint64_t timeoutNs = UINT64_MAX) = 0;
+
+    // Named GPU timing scope, scopes nest and show up as debug labels in capture tools
+    virtual void BeginGpuScope(const char *name) = 0;
+    virtual void EndGpuScope() = 0;
+
+    // Copies the scope timings of the latest resolved frame, returns how many were written.
+    // Results trail the current frame by the frames in flight, reading them never waits on the GPU.
+    virtual uint32_t GetGpuScopeTimings(GpuScopeTiming *timings, uint32_t maxCount, uint64_t *frame = nullptr) = 0;
+
+    // Write recent GPU scope history as Chrome trace JSON, for chrome://tracing or Perfetto
+    virtual bool WriteGpuTrace(const char *filepath) = 0;
+
+    // Pipeline creation since startup, tells how much of the warm start the on-disk pipeline cache covered
+    virtual PipelineCacheStats GetPipelineCacheStats() = 0;
+
+    // Set the blend state. Each combination a shader draws with is a pipeline variant of its own,
+    // compiled the first time it is drawn with and looked up by hash after that.
     virtual void SetBlendState(BlendState settings) = 0;
 
-    // Set the depth stencil state
+    // Set the depth stencil state, dynamic state that needs no other pipeline
     virtual void SetDepthStencilState(DepthStencilState settings) = 0;
 
-    // Set the rasterizer state
+    // Set the rasterizer state, dynamic state that needs no other pipeline
     virtual void SetRasterizerState(RasterizerState settings) = 0;
 };
\ No newline at end of file
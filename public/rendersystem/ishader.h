@@ -14,7 +14,13 @@ public:
 
     virtual void BindImage(uint32_t binding, HImageView img) = 0;
 
-    virtual void Update() = 0;
+    // Constants come from the frame's constant ring, see IRenderSystem::AllocateConstants.
+    // Size covers the largest slice read through the binding, the slice is picked by its offset when the set is bound.
+    virtual void BindConstantBuffer(uint32_t binding, uint32_t size) = 0;
+
+    // False when no set could be written for the bindings, e.g. the descriptor memory is used up.
+    // Binding the set then records nothing.
+    virtual bool Update() = 0;
 };
 
 class IShader
@@ -23,8 +29,8 @@ public:
 
     virtual ShaderType GetType() = 0;
 
-    // After setting the modules, the shader will take ownership of them and destroy them with itself
-    // TODO: Need a shader module cache that will take ownership of shader modules
+    // Modules come from the rendersystem's module cache, the shader takes over the reference
+    // LoadShaderModule handed out and releases it when the module is replaced or the shader destroyed
     virtual void SetVertexModule(HShader csModule) = 0;
     virtual void SetFragmentModule(HShader csModule) = 0;
     virtual void SetComputeModule(HShader csModule) = 0;
@@ -34,6 +40,35 @@ public:
     virtual void SetPolygonMode(PolygonMode polygonMode) = 0;
     virtual void SetCullMode(CullModeFlags cullFlags, PolygonWinding winding) = 0;
 
+    // Vertex buffer layout, the shader reads no vertex buffer when none is set
+    virtual void SetVertexLayout(uint32_t stride, uint32_t numAttributes, VertexAttribute *attributes) = 0;
+
+    // Formats of the passes the shader draws into, RGBA16F color and no depth by default
+    virtual void SetAttachmentFormats(BufferFormat color, BufferFormat depth) = 0;
+
+    // Bytes of push constants the stages read, fed with IRenderSystem::SetPushConstants.
+    // 128 bytes is the most every device supports. Shaders built against the bindless layout always get all 128 bytes.
+    virtual void SetPushConstantRange(uint32_t size, ShaderStage stages) = 0;
+
+    // Value of a [[vk::constant_id]] constant, in every stage that declares it. Floats go in as their bits.
+    virtual void SetSpecializationConstant(uint32_t id, uint32_t value) = 0;
+
+    // Threads per group of a compute shader, the group counts of DispatchThreads are derived from it.
+    // Also the value of constants 0, 1 and 2, for shaders that size their groups with them.
+    virtual void SetWorkgroupSize(uint32_t x, uint32_t y, uint32_t z) = 0;
+
+    // DispatchThreads tries other workgroup sizes on the device it runs on and keeps the fastest.
+    // Only for shaders that size their groups with the constants, the result is saved for the next run.
+    virtual void SetWorkgroupAutotune(bool enable) = 0;
+
+    // With IRenderSystem::GetBindlessLayout the shader reads its resources from the bindless heap
     virtual void BuildPipeline(IDescriptorLayout* layout) = 0;
 
+    // Returns right away, the pipeline is built on a compiler thread. Don't change the shader until it is ready.
+    // Binding it before then has no effect, draws and dispatches with it are skipped.
+    virtual void BuildPipelineAsync(IDescriptorLayout* layout) = 0;
+
+    // Thread safe. The pipeline is built and the shader can be used
+    virtual bool IsReady() = 0;
+
 };
\ No newline at end of file
@@ -1,22 +1,7 @@
 #pragma once
 
-struct BlendState
-{
-    bool enable;
-    float src_factor, dst_factor;
-};
-
-struct DepthStencilState
-{
-    bool enable;
-    float depth_bias;
-};
-
-struct RasterizerState
-{
-    bool enable;
-    int cull_mode;
-};
+// Index of a resource in the bindless heap, this one is never handed out
+constexpr uint32_t BINDLESS_INVALID_INDEX = UINT32_MAX;
 
 struct Viewport
 {
@@ -33,6 +18,22 @@ struct ColorFloat
     float r, g, b, a;
 };
 
+struct GpuScopeTiming
+{
+    const char *Name; // owned by the rendersystem, valid until it is destroyed
+    uint32_t Depth;   // nesting level, 0 for top level scopes
+    double StartMs;   // offset from the first scope of the frame
+    double DurationMs;
+};
+
+struct PipelineCacheStats
+{
+    bool LoadedFromDisk; // false on first run, or when the file came from another driver or GPU
+    uint32_t Pipelines;  // created so far
+    uint32_t CacheHits;  // found in the cache by the driver, no compile needed
+    double CreationMs;   // CPU time spent creating them
+};
+
 enum class BufferFormat : short
 {
     Null = 0,
@@ -63,6 +64,24 @@ enum class BufferFormat : short
 
     RGBA16F,
     RGBA32F,
+
+    // Depth formats, for depth attachments only
+    D16,
+    D32F,
+    D24S8,
+};
+
+enum class AttachmentLoadOp : unsigned char
+{
+    Load = 0, // keep what the target held
+    Clear,
+    DontCare, // every pixel gets overwritten anyway
+};
+
+enum class AttachmentStoreOp : unsigned char
+{
+    Store = 0,
+    DontCare, // contents are not needed after the pass, e.g. depth
 };
 
 // Hardware image handles
@@ -75,6 +94,27 @@ using HShader = void*;
 class IVertexBuffer;
 class IIndexBuffer;
 
+// Decides where buffer memory lives
+enum class BufferUsageHint : unsigned char
+{
+    Static = 0, // written rarely, device local memory, updates go through a staging copy
+    Dynamic,    // rewritten often and read a lot, device local memory the CPU can write (ReBAR), else like Static
+    Stream,     // rewritten every frame and read once, host memory
+};
+
+enum class IndexFormat : unsigned char
+{
+    UInt16 = 0,
+    UInt32,
+};
+
+struct VertexAttribute
+{
+    uint32_t Location;
+    BufferFormat Format;
+    uint32_t Offset; // from the start of the vertex, in bytes
+};
+
 enum class ShaderType : unsigned char
 {
     Null = 0,
@@ -105,6 +145,12 @@ enum class PipelineBindPoint : short
     Compute
 };
 
+enum class CommandContextType : short
+{
+    Graphics = 0, // draws inside a render pass
+    Compute,      // dispatches outside of render passes
+};
+
 struct DescriptorLayoutEntry
 {
     uint32_t Binding;
@@ -139,4 +185,69 @@ enum PolygonWinding : int
 {
     CounterClockwise = 0,
     Clockwise
+};
+
+enum class BlendFactor : unsigned char
+{
+    Zero = 0,
+    One,
+    SrcColor,
+    InvSrcColor,
+    SrcAlpha,
+    InvSrcAlpha,
+    DstColor,
+    InvDstColor,
+    DstAlpha,
+    InvDstAlpha,
+};
+
+enum class BlendOp : unsigned char
+{
+    Add = 0,
+    Subtract,
+    ReverseSubtract,
+    Min,
+    Max,
+};
+
+enum class CompareOp : unsigned char
+{
+    Never = 0,
+    Less,
+    Equal,
+    LessOrEqual,
+    Greater,
+    NotEqual,
+    GreaterOrEqual,
+    Always,
+};
+
+// Baked into the pipeline, every combination in use gets its own variant of the shader's pipeline
+struct BlendState
+{
+    bool enable = false; // off writes the shader output as is
+    BlendFactor src_factor = BlendFactor::One;
+    BlendFactor dst_factor = BlendFactor::Zero;
+    BlendOp op = BlendOp::Add;
+    BlendFactor src_alpha_factor = BlendFactor::One;
+    BlendFactor dst_alpha_factor = BlendFactor::Zero;
+    BlendOp alpha_op = BlendOp::Add;
+};
+
+// Dynamic, changing it costs no pipeline
+struct DepthStencilState
+{
+    bool enable = true; // depth test, ignored in passes without depth
+    bool write_enable = true;
+    CompareOp compare_op = CompareOp::LessOrEqual;
+    float depth_bias = 0.0f; // constant offset, with the slope factor 0 turns biasing off
+    float depth_bias_slope = 0.0f;
+};
+
+// Dynamic, changing it costs no pipeline
+struct RasterizerState
+{
+    bool enable = false; // off keeps the cull mode and winding the shader was set up with
+    CullModeFlags cull_mode = CullModeFlags::None;
+    PolygonWinding winding = PolygonWinding::CounterClockwise;
 };
\ No newline at end of file
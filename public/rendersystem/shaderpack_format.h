@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// Layout of the shader archive written by the shaderpack tool and mapped by the rendersystem.
+// Header, then the index sorted by name hash, then the names, then the SPIR-V of every file.
+// All offsets are from the start of the file, code is aligned so it can be handed to the driver in place.
+namespace ShaderPack
+{
+    constexpr uint32_t MAGIC = 0x4B505343; // "CSPK"
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t CODE_ALIGNMENT = 16;
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t EntryCount;
+        uint32_t IndexOffset;
+    };
+
+    struct Entry
+    {
+        uint64_t NameHash;    // FNV-1a of the file name, no directories
+        uint64_t ContentHash; // FNV-1a of the code
+        uint32_t NameOffset;
+        uint32_t NameLength;
+        uint32_t CodeOffset;
+        uint32_t CodeSize;    // in bytes, a multiple of 4
+    };
+}
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "common_stl.h"
+#include "asynccompute.h"
+#include "rendersystem.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
+
+static bool CreateTimeline(VkDevice device, VkSemaphore& semaphore)
+{
+	VkSemaphoreTypeCreateInfo timelineInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphoreInfo.pNext = &timelineInfo;
+
+	return vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) == VK_SUCCESS;
+}
+
+bool AsyncComputeVk::Init(VkQueue computeQueue, uint32_t computeFamily, uint32_t graphicsFamily)
+{
+	VkDevice device = rendersystem->GetDevice();
+
+	ComputeFamily = computeFamily;
+	GraphicsFamily = graphicsFamily;
+
+	if (!CreateTimeline(device, ForkTimeline) || !CreateTimeline(device, ComputeTimeline))
+		return false;
+
+	VkCommandPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = ComputeFamily;
+
+	for (FramePool& framePool : Pools)
+	{
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &framePool.Pool) != VK_SUCCESS)
+			return false;
+	}
+
+	// Only usable once everything exists
+	ComputeQueue = computeQueue;
+	return true;
+}
+
+void AsyncComputeVk::Destroy()
+{
+	VkDevice device = rendersystem->GetDevice();
+
+	for (FramePool& framePool : Pools)
+	{
+		if (framePool.Pool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(device, framePool.Pool, nullptr);
+		framePool = FramePool{};
+	}
+
+	if (ForkTimeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, ForkTimeline, nullptr);
+	if (ComputeTimeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, ComputeTimeline, nullptr);
+
+	ForkTimeline = VK_NULL_HANDLE;
+	ComputeTimeline = VK_NULL_HANDLE;
+	ComputeQueue = VK_NULL_HANDLE;
+}
+
+VkCommandBuffer AsyncComputeVk::GetCommandBuffer()
+{
+	if (Recording)
+		return CommandBuffer;
+
+	FrameSchedulerVk& scheduler = rendersystem->GetFrameScheduler();
+	FramePool& framePool = Pools[scheduler.GetSlotIndex()];
+
+	// Work is always joined within its frame, the scheduler waited for the frame that last used the pool
+	if (framePool.Frame != scheduler.GetCurrentFrame())
+	{
+		vkResetCommandPool(rendersystem->GetDevice(), framePool.Pool, 0);
+		framePool.UsedBuffers = 0;
+		framePool.Frame = scheduler.GetCurrentFrame();
+	}
+
+	if (framePool.UsedBuffers == framePool.Buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocInfo.commandPool = framePool.Pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer cmd;
+		if (vkAllocateCommandBuffers(rendersystem->GetDevice(), &allocInfo, &cmd) != VK_SUCCESS)
+			return VK_NULL_HANDLE;
+
+		framePool.Buffers.push_back(cmd);
+	}
+
+	CommandBuffer = framePool.Buffers[framePool.UsedBuffers++];
+
+	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(CommandBuffer, &beginInfo) != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	Recording = true;
+	return CommandBuffer;
+}
+
+void AsyncComputeVk::UseImage(VkImage image)
+{
+	if (std::find(Images.begin(), Images.end(), image) != Images.end())
+		return;
+
+	Images.push_back(image);
+
+	// Acquire right away, the commands that follow are the ones using it
+	Array<VkImage> acquired = { image };
+	RecordOwnershipTransfer(GetCommandBuffer(), acquired, true, false);
+}
+
+uint64_t AsyncComputeVk::Fork(VkCommandBuffer graphicsCmd)
+{
+	if (!Recording)
+		return ForkValue;
+
+	TRACE_SCOPE("AsyncComputeSubmit");
+
+	// Graphics gives the images up at the fork, the async work hands them back when it's done
+	RecordOwnershipTransfer(graphicsCmd, Images, true, true);
+	RecordOwnershipTransfer(CommandBuffer, Images, false, true);
+
+	ForkedImages.insert(ForkedImages.end(), Images.begin(), Images.end());
+	Images.clear();
+
+	Recording = false;
+
+	if (vkEndCommandBuffer(CommandBuffer) != VK_SUCCESS)
+	{
+		// std::cout << "failed to record async compute\n";
+		return ForkValue;
+	}
+
+	ForkValue++;
+	ComputeValue++;
+
+	VkCommandBufferSubmitInfo commandSubmitInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+	commandSubmitInfo.commandBuffer = CommandBuffer;
+
+	// The graphics part is only submitted with the rest of the frame, timelines may be waited before they are signalled
+	VkSemaphoreSubmitInfo waitInfo = RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, ForkTimeline);
+	waitInfo.value = ForkValue;
+
+	VkSemaphoreSubmitInfo signalInfo = RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, ComputeTimeline);
+	signalInfo.value = ComputeValue;
+
+	VkSubmitInfo2 submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+	submitInfo.waitSemaphoreInfoCount = 1;
+	submitInfo.pWaitSemaphoreInfos = &waitInfo;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandSubmitInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+	if (vkQueueSubmit2(ComputeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		// std::cout << "failed to submit async compute\n";
+	}
+
+	return ForkValue;
+}
+
+uint64_t AsyncComputeVk::Join(VkCommandBuffer graphicsCmd)
+{
+	RecordOwnershipTransfer(graphicsCmd, ForkedImages, false, false);
+	ForkedImages.clear();
+
+	JoinedValue = ComputeValue;
+	return JoinedValue;
+}
+
+void AsyncComputeVk::RecordOwnershipTransfer(VkCommandBuffer cmd, const Array<VkImage>& images, bool toCompute, bool release)
+{
+	// The semaphores alone order the work when both queues share a family
+	if (SameFamily() || images.empty())
+		return;
+
+	Array<VkImageMemoryBarrier2> barriers;
+	barriers.reserve(images.size());
+
+	for (VkImage image : images)
+	{
+		VkImageMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+
+		if (release)
+		{
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		}
+		else
+		{
+			// Chained to the semaphore wait in front of it
+			barrier.srcStageMask = toCompute ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : CONSUMER_STAGES;
+			barrier.dstStageMask = toCompute ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT : CONSUMER_STAGES;
+			barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		}
+
+		// Storage images stay in GENERAL the whole way, only ownership moves
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = toCompute ? GraphicsFamily : ComputeFamily;
+		barrier.dstQueueFamilyIndex = toCompute ? ComputeFamily : GraphicsFamily;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+		barriers.push_back(barrier);
+	}
+
+	VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.imageMemoryBarrierCount = (uint32_t)barriers.size();
+	depInfo.pImageMemoryBarriers = barriers.data();
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+}
\ No newline at end of file
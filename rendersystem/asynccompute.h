@@ -0,0 +1,83 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+// Dispatches recorded into their own command buffers and submitted on a compute queue, so they overlap
+// the graphics work of the frame. The frame is forked after the graphics commands the work depends on,
+// the async work waits for the fork on a timeline, and graphics joins back by waiting for the work's value.
+// Images the work uses change queue family between fork and join when the families differ.
+class AsyncComputeVk
+{
+public:
+
+	// Graphics stages that may consume the results, joins wait there
+	static constexpr VkPipelineStageFlags2 CONSUMER_STAGES =
+		VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+		VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+
+	bool Init(VkQueue computeQueue, uint32_t computeFamily, uint32_t graphicsFamily);
+	void Destroy();
+
+	// Without a separate compute queue async work runs inline on the graphics queue
+	bool IsAvailable() const { return ComputeQueue != VK_NULL_HANDLE; }
+
+	// Command buffer for the async work of the current fork, begun on first use
+	VkCommandBuffer GetCommandBuffer();
+
+	// The work being recorded uses the image, it is acquired by the compute family before the next command
+	void UseImage(VkImage image);
+
+	// End the recording and submit it. The releases go into the graphics command buffer, which has to signal
+	// the returned fork value on the fork timeline once everything recorded before has run.
+	uint64_t Fork(VkCommandBuffer graphicsCmd);
+
+	// Acquire everything forked since the last join, returns the compute value graphics has to wait for
+	uint64_t Join(VkCommandBuffer graphicsCmd);
+
+	uint32_t GetComputeFamily() const { return ComputeFamily; }
+
+	bool IsRecording() const { return Recording; }
+	bool HasUnjoinedWork() const { return JoinedValue < ComputeValue; }
+
+	VkSemaphore GetForkTimeline() const { return ForkTimeline; }
+	VkSemaphore GetComputeTimeline() const { return ComputeTimeline; }
+
+private:
+
+	// Same scheme as the command contexts, one pool per frame slot reset on its first use in a frame
+	struct FramePool
+	{
+		VkCommandPool Pool = VK_NULL_HANDLE;
+		Array<VkCommandBuffer> Buffers;
+		uint32_t UsedBuffers = 0;
+		uint64_t Frame = 0;
+	};
+
+	void RecordOwnershipTransfer(VkCommandBuffer cmd, const Array<VkImage>& images, bool toCompute, bool release);
+
+	bool SameFamily() const { return ComputeFamily == GraphicsFamily; }
+
+	VkQueue ComputeQueue = VK_NULL_HANDLE;
+	uint32_t ComputeFamily = 0;
+	uint32_t GraphicsFamily = 0;
+
+	ConstArray<FramePool, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT> Pools;
+
+	VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+	bool Recording = false;
+
+	// Signalled by graphics at each fork, and by the compute queue when the forked work is done
+	VkSemaphore ForkTimeline = VK_NULL_HANDLE;
+	VkSemaphore ComputeTimeline = VK_NULL_HANDLE;
+	uint64_t ForkValue = 0;
+	uint64_t ComputeValue = 0;
+	uint64_t JoinedValue = 0;
+
+	// Used by the work being recorded, and by submitted work graphics has not joined yet
+	Array<VkImage> Images;
+	Array<VkImage> ForkedImages;
+};
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "common_stl.h"
+#include "bindlessheap.h"
+#include "rendersystem.h"
+
+#include <algorithm>
+
+// Wanted sizes of the arrays, clamped to what the device allows
+static constexpr uint32_t STORAGE_IMAGE_COUNT = 4096;
+static constexpr uint32_t SAMPLED_IMAGE_COUNT = 16384;
+static constexpr uint32_t STORAGE_BUFFER_COUNT = 4096;
+
+bool BindlessHeapVk::Init(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+	Device = device;
+
+	VkPhysicalDeviceVulkan12Properties properties12 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+	VkPhysicalDeviceProperties2 properties = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	properties.pNext = &properties12;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	Tables[STORAGE_IMAGE_BINDING].Capacity = std::min({ STORAGE_IMAGE_COUNT,
+		properties12.maxDescriptorSetUpdateAfterBindStorageImages, properties12.maxPerStageDescriptorUpdateAfterBindStorageImages });
+	Tables[SAMPLED_IMAGE_BINDING].Capacity = std::min({ SAMPLED_IMAGE_COUNT,
+		properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages });
+	Tables[STORAGE_BUFFER_BINDING].Capacity = std::min({ STORAGE_BUFFER_COUNT,
+		properties12.maxDescriptorSetUpdateAfterBindStorageBuffers, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+	if (!CreateSamplers())
+		return false;
+
+	VkDescriptorType types[TABLE_COUNT] = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+
+	ConstArray<VkDescriptorSetLayoutBinding, TABLE_COUNT + 1> bindings = {};
+	ConstArray<VkDescriptorBindingFlags, TABLE_COUNT + 1> bindingFlags = {};
+	ConstArray<VkDescriptorPoolSize, TABLE_COUNT + 1> poolSizes = {};
+
+	for (uint32_t i = 0; i < TABLE_COUNT; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = types[i];
+		bindings[i].descriptorCount = Tables[i].Capacity;
+		bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+
+		// Written while frames using other indices are in flight, most indices never hold anything
+		bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+		poolSizes[i] = { types[i], Tables[i].Capacity };
+	}
+
+	bindings[SAMPLER_BINDING].binding = SAMPLER_BINDING;
+	bindings[SAMPLER_BINDING].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	bindings[SAMPLER_BINDING].descriptorCount = SAMPLER_COUNT;
+	bindings[SAMPLER_BINDING].stageFlags = VK_SHADER_STAGE_ALL;
+	bindings[SAMPLER_BINDING].pImmutableSamplers = Samplers.data();
+
+	poolSizes[SAMPLER_BINDING] = { VK_DESCRIPTOR_TYPE_SAMPLER, SAMPLER_COUNT };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+	flagsInfo.bindingCount = (uint32_t)bindingFlags.size();
+	flagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = (uint32_t)bindings.size();
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(Device, &layoutInfo, nullptr, &SetLayout) != VK_SUCCESS)
+		return false;
+
+	Layout.InitBindless(SetLayout);
+
+	VkDescriptorPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (vkCreateDescriptorPool(Device, &poolInfo, nullptr, &Pool) != VK_SUCCESS)
+		return false;
+
+	VkDescriptorSetAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocInfo.descriptorPool = Pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &SetLayout;
+
+	if (vkAllocateDescriptorSets(Device, &allocInfo, &Set) != VK_SUCCESS)
+		return false;
+
+	VkPushConstantRange pushConstants = GetPushConstantRange();
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &SetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+
+	return vkCreatePipelineLayout(Device, &pipelineLayoutInfo, nullptr, &PipelineLayout) == VK_SUCCESS;
+}
+
+void BindlessHeapVk::Destroy()
+{
+	if (PipelineLayout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(Device, PipelineLayout, nullptr);
+
+	// Frees the set with it
+	if (Pool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(Device, Pool, nullptr);
+
+	if (SetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(Device, SetLayout, nullptr);
+
+	for (VkSampler& sampler : Samplers)
+	{
+		if (sampler != VK_NULL_HANDLE)
+			vkDestroySampler(Device, sampler, nullptr);
+		sampler = VK_NULL_HANDLE;
+	}
+
+	PipelineLayout = VK_NULL_HANDLE;
+	Pool = VK_NULL_HANDLE;
+	Set = VK_NULL_HANDLE;
+	SetLayout = VK_NULL_HANDLE;
+
+	for (IndexTable& table : Tables)
+		table = IndexTable{};
+}
+
+uint32_t BindlessHeapVk::RegisterStorageImage(VkImageView view)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	return Write(STORAGE_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo, nullptr);
+}
+
+uint32_t BindlessHeapVk::RegisterSampledImage(VkImageView view)
+{
+	// The layout ResourceUsage::ShaderRead transitions to
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	return Write(SAMPLED_IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo, nullptr);
+}
+
+uint32_t BindlessHeapVk::RegisterStorageBuffer(VkBuffer buffer, VkDeviceSize size)
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = size;
+
+	return Write(STORAGE_BUFFER_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo);
+}
+
+void BindlessHeapVk::Release(uint32_t binding, uint32_t index)
+{
+	if (binding >= TABLE_COUNT || index == BINDLESS_INVALID_INDEX)
+		return;
+
+	std::lock_guard<std::mutex> lock(HeapMutex);
+
+	// Partially bound, the stale descriptor stays until the index is written again
+	Tables[binding].Retired.push_back({ index, rendersystem->GetCurrentFrame() });
+}
+
+void BindlessHeapVk::Bind(VkCommandBuffer cmd, VkPipelineBindPoint point)
+{
+	vkCmdBindDescriptorSets(cmd, point, PipelineLayout, 0, 1, &Set, 0, nullptr);
+}
+
+uint32_t BindlessHeapVk::Allocate(uint32_t binding)
+{
+	IndexTable& table = Tables[binding];
+
+	uint64_t completedFrame = rendersystem->GetCompletedFrame();
+	for (auto iter = table.Retired.begin(); iter != table.Retired.end();)
+	{
+		if (iter->Frame > completedFrame)
+		{
+			++iter;
+			continue;
+		}
+
+		table.Free.push_back(iter->Index);
+		iter = table.Retired.erase(iter);
+	}
+
+	if (!table.Free.empty())
+	{
+		uint32_t index = table.Free.back();
+		table.Free.pop_back();
+		return index;
+	}
+
+	if (table.Next == table.Capacity)
+	{
+		// std::cout << "bindless heap is full\n";
+		return BINDLESS_INVALID_INDEX;
+	}
+
+	return table.Next++;
+}
+
+uint32_t BindlessHeapVk::Write(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo)
+{
+	// Writes into the set have to be externally synchronized, even for different indices
+	std::lock_guard<std::mutex> lock(HeapMutex);
+
+	uint32_t index = Allocate(binding);
+	if (index == BINDLESS_INVALID_INDEX)
+		return index;
+
+	VkWriteDescriptorSet write = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	write.dstSet = Set;
+	write.dstBinding = binding;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = type;
+	write.pImageInfo = imageInfo;
+	write.pBufferInfo = bufferInfo;
+
+	vkUpdateDescriptorSets(Device, 1, &write, 0, nullptr);
+	return index;
+}
+
+bool BindlessHeapVk::CreateSamplers()
+{
+	struct SamplerDesc
+	{
+		VkFilter Filter;
+		VkSamplerMipmapMode MipMode;
+		VkSamplerAddressMode AddressMode;
+	};
+
+	const SamplerDesc descs[SAMPLER_COUNT] =
+	{
+		{ VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+		{ VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT },
+		{ VK_FILTER_NEAREST, VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+		{ VK_FILTER_NEAREST, VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT },
+	};
+
+	for (uint32_t i = 0; i < SAMPLER_COUNT; ++i)
+	{
+		VkSamplerCreateInfo samplerInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = descs[i].Filter;
+		samplerInfo.minFilter = descs[i].Filter;
+		samplerInfo.mipmapMode = descs[i].MipMode;
+		samplerInfo.addressModeU = descs[i].AddressMode;
+		samplerInfo.addressModeV = descs[i].AddressMode;
+		samplerInfo.addressModeW = descs[i].AddressMode;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(Device, &samplerInfo, nullptr, &Samplers[i]) != VK_SUCCESS)
+			return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/rendersystem_types.h"
+#include "vulkan_common.h"
+#include "descriptorsets.h"
+
+#include <mutex>
+
+// One descriptor set holding every storage image, sampled image and storage buffer, bound once per command buffer.
+// Resources are written into it when they are created and shaders reach them by the index they got, usually
+// passed in push constants. The arrays are update after bind and partially bound, so registering a resource
+// never touches the command buffers using the set. Freed indices are handed out again once the frames that
+// could still read them are done.
+class BindlessHeapVk
+{
+public:
+
+	// Bindings of the set, the same in every shader built against the heap
+	static constexpr uint32_t STORAGE_IMAGE_BINDING = 0;
+	static constexpr uint32_t SAMPLED_IMAGE_BINDING = 1;
+	static constexpr uint32_t STORAGE_BUFFER_BINDING = 2;
+	static constexpr uint32_t SAMPLER_BINDING = 3;
+
+	// Immutable samplers, indexed by shaders like the resources
+	enum SamplerIndex : uint32_t
+	{
+		SAMPLER_LINEAR_CLAMP = 0,
+		SAMPLER_LINEAR_WRAP,
+		SAMPLER_POINT_CLAMP,
+		SAMPLER_POINT_WRAP,
+		SAMPLER_COUNT,
+	};
+
+	// Every shader using the heap gets this range, pipeline layouts have to match exactly for the heap to stay bound
+	static constexpr uint32_t PUSH_CONSTANT_SIZE = 128;
+	static constexpr VkShaderStageFlags PUSH_CONSTANT_STAGES = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+
+	bool Init(VkDevice device, VkPhysicalDevice physicalDevice);
+	void Destroy();
+
+	// Thread safe. Index in the binding's array, BINDLESS_INVALID_INDEX when the array is full
+	uint32_t RegisterStorageImage(VkImageView view);
+	uint32_t RegisterSampledImage(VkImageView view);
+	uint32_t RegisterStorageBuffer(VkBuffer buffer, VkDeviceSize size);
+
+	// Thread safe. The resource goes away, its index is reused once the frame being recorded is done
+	void Release(uint32_t binding, uint32_t index);
+
+	// The set goes in as set 0, for every pipeline built against the heap at that bind point
+	void Bind(VkCommandBuffer cmd, VkPipelineBindPoint point);
+
+	// What shaders are built with, their own descriptor layout and push constant range are replaced by the heap's
+	DescriptorLayoutVk* GetLayout() { return &Layout; }
+	VkPushConstantRange GetPushConstantRange() const { return { PUSH_CONSTANT_STAGES, 0, PUSH_CONSTANT_SIZE }; }
+
+private:
+
+	static constexpr uint32_t TABLE_COUNT = 3;
+
+	struct RetiredIndex
+	{
+		uint32_t Index;
+		uint64_t Frame;
+	};
+
+	// Indices of one binding, never used ones come from the end
+	struct IndexTable
+	{
+		uint32_t Capacity = 0;
+		uint32_t Next = 0;
+		Array<uint32_t> Free;
+		Array<RetiredIndex> Retired;
+	};
+
+	uint32_t Allocate(uint32_t binding);
+	uint32_t Write(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo* imageInfo, const VkDescriptorBufferInfo* bufferInfo);
+
+	bool CreateSamplers();
+
+	VkDevice Device = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout SetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool Pool = VK_NULL_HANDLE;
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+
+	// Only used for binding, identical to the layouts of the shaders built against the heap
+	VkPipelineLayout PipelineLayout = VK_NULL_HANDLE;
+
+	DescriptorLayoutVk Layout;
+
+	ConstArray<VkSampler, SAMPLER_COUNT> Samplers = {};
+
+	std::mutex HeapMutex;
+	ConstArray<IndexTable, TABLE_COUNT> Tables;
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "common_stl.h"
+#include "buffer.h"
+#include "rendersystem.h"
+
+#include <cstring>
+
+bool BufferVk::Create(VkDeviceSize size, VkBufferUsageFlags usage, BufferUsageHint hint)
+{
+	Size = size;
+	Usage = usage;
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = size;
+	// staging copies need to write into it
+	bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocInfo = {};
+	switch (hint)
+	{
+	case BufferUsageHint::Static:
+		// plain VRAM, never mapped
+		allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+		break;
+	case BufferUsageHint::Dynamic:
+		// VRAM the CPU can see through a resizable BAR, or a staging copy when there is none
+		allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+		allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+			VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		break;
+	case BufferUsageHint::Stream:
+		// system memory, the GPU reads it once over the bus
+		allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+		allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		break;
+	}
+
+	VmaAllocationInfo allocationResult = {};
+	if (vmaCreateBuffer(rendersystem->GetAllocator(), &bufferInfo, &allocInfo, &Buffer, &Allocation, &allocationResult) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create buffer\n";
+		return false;
+	}
+
+	// Only set when the memory really ended up host visible
+	Mapped = allocationResult.pMappedData;
+
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		HeapIndex = rendersystem->GetBindlessHeap().RegisterStorageBuffer(Buffer, size);
+
+	return true;
+}
+
+void BufferVk::Destroy()
+{
+	rendersystem->GetBindlessHeap().Release(BindlessHeapVk::STORAGE_BUFFER_BINDING, HeapIndex);
+	HeapIndex = BINDLESS_INVALID_INDEX;
+
+	if (Buffer != VK_NULL_HANDLE)
+		vmaDestroyBuffer(rendersystem->GetAllocator(), Buffer, Allocation);
+
+	Buffer = VK_NULL_HANDLE;
+	Allocation = VK_NULL_HANDLE;
+	Mapped = nullptr;
+}
+
+bool BufferVk::Write(const void* data, VkDeviceSize size, VkDeviceSize offset)
+{
+	if (!data || offset + size > Size)
+		return false;
+
+	if (!Mapped)
+		return WriteStaged(data, size, offset);
+
+	memcpy(static_cast<char*>(Mapped) + offset, data, size);
+
+	// no-op on coherent memory
+	vmaFlushAllocation(rendersystem->GetAllocator(), Allocation, offset, size);
+	return true;
+}
+
+bool BufferVk::WriteStaged(const void* data, VkDeviceSize size, VkDeviceSize offset)
+{
+	// The first upload can run on the transfer queue, later ones are ordered with the frames using the buffer
+	bool fresh = Fresh;
+	Fresh = false;
+
+	return rendersystem->UploadBuffer(Buffer, offset, data, size, fresh);
+}
+
+bool VertexBufferVk::Init(uint32_t size, uint32_t stride, BufferUsageHint hint)
+{
+	Stride = stride;
+	// Also readable as a storage buffer, for shaders that fetch their vertices themselves
+	return Create(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hint);
+}
+
+bool VertexBufferVk::Update(const void* data, uint32_t size, uint32_t offset)
+{
+	return Write(data, size, offset);
+}
+
+bool IndexBufferVk::Init(uint32_t size, IndexFormat format, BufferUsageHint hint)
+{
+	Format = format;
+	return Create(size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hint);
+}
+
+bool IndexBufferVk::Update(const void* data, uint32_t size, uint32_t offset)
+{
+	return Write(data, size, offset);
+}
\ No newline at end of file
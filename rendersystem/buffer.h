@@ -0,0 +1,75 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/irendersystem.h"
+#include "vulkan_common.h"
+
+#include "vk_mem_alloc.h"
+
+// VMA backed buffer, the usage hint decides the memory it lands in.
+// Mapped memory is written directly, anything else goes through the upload engine.
+class BufferVk
+{
+public:
+
+	bool Create(VkDeviceSize size, VkBufferUsageFlags usage, BufferUsageHint hint);
+	void Destroy();
+
+	bool Write(const void* data, VkDeviceSize size, VkDeviceSize offset);
+
+	VkBuffer GetBuffer() const { return Buffer; }
+	VkDeviceSize GetBufferSize() const { return Size; }
+
+	// Host visible memory, written without a copy on the GPU
+	bool IsMapped() const { return Mapped != nullptr; }
+
+	// Storage buffers are registered in the bindless heap
+	uint32_t GetHeapIndex() const { return HeapIndex; }
+
+private:
+
+	bool WriteStaged(const void* data, VkDeviceSize size, VkDeviceSize offset);
+
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VmaAllocation Allocation = VK_NULL_HANDLE;
+	VkDeviceSize Size = 0;
+	VkBufferUsageFlags Usage = 0;
+	void* Mapped = nullptr;
+	uint32_t HeapIndex = BINDLESS_INVALID_INDEX;
+
+	// Nothing was staged into it yet, so no frame can have used its contents
+	bool Fresh = true;
+};
+
+class VertexBufferVk : public IVertexBuffer, public BufferVk
+{
+public:
+
+	bool Init(uint32_t size, uint32_t stride, BufferUsageHint hint);
+
+	virtual bool Update(const void* data, uint32_t size, uint32_t offset = 0);
+	virtual uint32_t GetSize() { return (uint32_t)GetBufferSize(); }
+	virtual uint32_t GetStride() { return Stride; }
+	virtual uint32_t GetBindlessIndex() { return GetHeapIndex(); }
+
+private:
+
+	uint32_t Stride = 0;
+};
+
+class IndexBufferVk : public IIndexBuffer, public BufferVk
+{
+public:
+
+	bool Init(uint32_t size, IndexFormat format, BufferUsageHint hint);
+
+	virtual bool Update(const void* data, uint32_t size, uint32_t offset = 0);
+	virtual uint32_t GetSize() { return (uint32_t)GetBufferSize(); }
+	virtual IndexFormat GetIndexFormat() { return Format; }
+	virtual uint32_t GetBindlessIndex() { return GetHeapIndex(); }
+
+	VkIndexType GetIndexType() const { return Format == IndexFormat::UInt16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32; }
+
+private:
+
+	IndexFormat Format = IndexFormat::UInt16;
+};
\ No newline at end of file
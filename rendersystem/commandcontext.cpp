@@ -0,0 +1,283 @@
+#include "common_stl.h"
+#include "commandcontext.h"
+#include "rendersystem.h"
+#include "rendertarget.h"
+#include "shader.h"
+#include "descriptorsets.h"
+#include "buffer.h"
+
+bool CommandContextVk::Init(uint32_t queueFamily)
+{
+	VkCommandPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamily;
+
+	for (FramePool& framePool : Pools)
+	{
+		if (vkCreateCommandPool(rendersystem->GetDevice(), &poolInfo, nullptr, &framePool.Pool) != VK_SUCCESS)
+			return false;
+	}
+
+	return true;
+}
+
+void CommandContextVk::Destroy()
+{
+	for (FramePool& framePool : Pools)
+	{
+		if (framePool.Pool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(rendersystem->GetDevice(), framePool.Pool, nullptr);
+	}
+}
+
+VkCommandBuffer CommandContextVk::NextCommandBuffer()
+{
+	FrameSchedulerVk& scheduler = rendersystem->GetFrameScheduler();
+	FramePool& framePool = Pools[scheduler.GetSlotIndex()];
+
+	// First use this frame, everything recorded from this pool before has finished on the GPU
+	if (framePool.Frame != scheduler.GetCurrentFrame())
+	{
+		vkResetCommandPool(rendersystem->GetDevice(), framePool.Pool, 0);
+		framePool.UsedBuffers = 0;
+		framePool.Frame = scheduler.GetCurrentFrame();
+	}
+
+	// The context can be acquired several times a frame, each recording gets its own buffer
+	if (framePool.UsedBuffers == framePool.Buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocInfo.commandPool = framePool.Pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer cmd;
+		if (vkAllocateCommandBuffers(rendersystem->GetDevice(), &allocInfo, &cmd) != VK_SUCCESS)
+			return VK_NULL_HANDLE;
+
+		framePool.Buffers.push_back(cmd);
+	}
+
+	return framePool.Buffers[framePool.UsedBuffers++];
+}
+
+void CommandContextVk::Begin(CommandContextType type, IRenderTarget* target)
+{
+	Type = type;
+	BoundShader = nullptr;
+	BoundShaderReady = false;
+	BoundSets.clear();
+	BindlessGraphicsBound = false;
+	BindlessComputeBound = false;
+	DescriptorBufferBound = false;
+
+	CommandBuffer = NextCommandBuffer();
+
+	VkCommandBufferInheritanceRenderingInfo renderingInheritance = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+	VkCommandBufferInheritanceInfo inheritance = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+
+	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritance;
+
+	if (Type == CommandContextType::Graphics)
+	{
+		if (target)
+		{
+			RenderTargetVk* vkRT = static_cast<RenderTargetVk*>(target);
+
+			int width, height;
+			vkRT->GetExtent(width, height);
+
+			TargetView = vkRT->GetImageView();
+			TargetFormat = vkRT->GetFormat();
+			TargetExtent = { (uint32_t)width, (uint32_t)height };
+		}
+		else
+		{
+			TargetView = rendersystem->GetBackBufferView();
+			TargetFormat = rendersystem->GetBackBufferFormat();
+			TargetExtent = rendersystem->GetBackBufferExtent();
+		}
+
+		// Secondaries continue the dynamic rendering scope the main thread begins around them
+		renderingInheritance.colorAttachmentCount = 1;
+		renderingInheritance.pColorAttachmentFormats = &TargetFormat;
+		renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		inheritance.pNext = &renderingInheritance;
+		beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	}
+
+	vkBeginCommandBuffer(CommandBuffer, &beginInfo);
+
+	if (Type == CommandContextType::Graphics)
+	{
+		// Dynamic state is not inherited, start from the whole target
+		SetViewport({ 0, 0, TargetExtent.width, TargetExtent.height });
+		SetScissorRectangle({ 0, 0, (int)TargetExtent.width, (int)TargetExtent.height });
+	}
+}
+
+void CommandContextVk::End()
+{
+	vkEndCommandBuffer(CommandBuffer);
+}
+
+void CommandContextVk::SetViewport(Viewport settings)
+{
+	VkViewport viewport = {};
+	viewport.x = settings.x;
+	viewport.y = settings.y;
+	viewport.width = (float)settings.w;
+	viewport.height = (float)settings.h;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	vkCmdSetViewport(CommandBuffer, 0, 1, &viewport);
+}
+
+void CommandContextVk::SetScissorRectangle(ScissorRectangle settings)
+{
+	VkRect2D scissor = {};
+	scissor.offset = { settings.x, settings.y };
+	scissor.extent = { static_cast<uint32_t>(settings.w), static_cast<uint32_t>(settings.h) };
+
+	vkCmdSetScissor(CommandBuffer, 0, 1, &scissor);
+}
+
+void CommandContextVk::BindShader(IShader* shader, PipelineBindPoint point)
+{
+	ShaderVk* vkShader = static_cast<ShaderVk*>(shader);
+	if (vkShader == BoundShader && BoundShaderReady)
+		return;
+
+	BoundShader = vkShader;
+
+	// Still compiling, nothing gets recorded with it
+	BoundShaderReady = BoundShader && BoundShader->IsReady();
+	if (!BoundShaderReady)
+		return;
+
+	// The heap goes in once, the images reached through it are declared on the main thread with UseBindlessTarget
+	bool& bindlessBound = point == PipelineBindPoint::Compute ? BindlessComputeBound : BindlessGraphicsBound;
+	if (BoundShader->IsBindless() && !bindlessBound)
+	{
+		rendersystem->GetBindlessHeap().Bind(CommandBuffer, RenderUtils::PipelineBindPointToVulkan(point));
+		bindlessBound = true;
+	}
+
+	if (point == PipelineBindPoint::Compute)
+	{
+		vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, BoundShader->GetPipeline());
+		return;
+	}
+
+	// Contexts draw with the default render state, into the target they were begun with
+	VkPipeline pipeline = BoundShader->GetPipelineVariant(BlendState(), TargetFormat, VK_FORMAT_UNDEFINED);
+	if (pipeline == VK_NULL_HANDLE)
+	{
+		BoundShaderReady = false;
+		return;
+	}
+
+	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	BoundShader->RecordDynamicState(CommandBuffer, DepthStencilState(), RasterizerState());
+}
+
+void CommandContextVk::BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point, const uint32_t* constantOffsets, uint32_t numOffsets)
+{
+	DescriptorSetVk* vkSet = static_cast<DescriptorSetVk*>(set);
+
+	if (!BoundShaderReady)
+		return;
+
+	vkSet->Bind(CommandBuffer, RenderUtils::PipelineBindPointToVulkan(point), BoundShader->GetPipelineLayout(), constantOffsets, numOffsets, DescriptorBufferBound);
+
+	BoundSets.push_back({ vkSet, point });
+
+	// Took the heap's place at set 0
+	if (point == PipelineBindPoint::Compute)
+		BindlessComputeBound = false;
+	else
+		BindlessGraphicsBound = false;
+}
+
+void CommandContextVk::SetPushConstants(const void* data, uint32_t size, uint32_t offset)
+{
+	if (!BoundShaderReady)
+		return;
+
+	vkCmdPushConstants(CommandBuffer, BoundShader->GetPipelineLayout(), BoundShader->GetPushConstantStages(), offset, size, data);
+}
+
+void CommandContextVk::TransitionResources(ResourceStateTracker& tracker)
+{
+	for (BoundSet& bound : BoundSets)
+		bound.Set->TransitionImages(tracker, bound.Point == PipelineBindPoint::Compute ? ResourceUsage::ComputeStorage : ResourceUsage::GraphicsStorage);
+}
+
+void CommandContextVk::SetVertexBuffer(IVertexBuffer* buffer)
+{
+	VertexBufferVk* vkBuffer = static_cast<VertexBufferVk*>(buffer);
+	if (!vkBuffer)
+		return;
+
+	VkBuffer vertexBuffer = vkBuffer->GetBuffer();
+	VkDeviceSize offset = 0;
+
+	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &vertexBuffer, &offset);
+}
+
+void CommandContextVk::SetIndexBuffer(IIndexBuffer* buffer)
+{
+	IndexBufferVk* vkBuffer = static_cast<IndexBufferVk*>(buffer);
+	if (!vkBuffer)
+		return;
+
+	vkCmdBindIndexBuffer(CommandBuffer, vkBuffer->GetBuffer(), 0, vkBuffer->GetIndexType());
+}
+
+void CommandContextVk::DrawPrimitive(int first_vertex, int vertex_count)
+{
+	if (!BoundShaderReady)
+		return;
+
+	vkCmdDraw(CommandBuffer, vertex_count, 1, first_vertex, 0);
+}
+
+void CommandContextVk::DrawIndexedPrimitives(int index_count, int first_index, int base_vertex, int instance_count, int first_instance)
+{
+	if (!BoundShaderReady)
+		return;
+
+	vkCmdDrawIndexed(CommandBuffer, index_count, instance_count, first_index, base_vertex, first_instance);
+}
+
+void CommandContextVk::Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ)
+{
+	if (!BoundShaderReady)
+		return;
+
+	vkCmdDispatch(CommandBuffer, groupSizeX, groupSizeY, groupSizeZ);
+}
+
+void CommandContextVk::DispatchThreads(uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ)
+{
+	if (!BoundShaderReady)
+		return;
+
+	// Contexts record on other threads and aren't timed, they only pick up finished tuning
+	const uint32_t threads[3] = { threadsX, threadsY, threadsZ };
+	uint32_t size[3];
+	VkPipeline pipeline = rendersystem->GetWorkgroupTuner().Select(BoundShader, threads, size, nullptr);
+
+	bool variant = pipeline != BoundShader->GetPipeline();
+	if (variant)
+		vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	vkCmdDispatch(CommandBuffer, (threadsX + size[0] - 1) / size[0], (threadsY + size[1] - 1) / size[1], (threadsZ + size[2] - 1) / size[2]);
+
+	if (variant)
+		vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, BoundShader->GetPipeline());
+}
\ No newline at end of file
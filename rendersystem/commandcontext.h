@@ -0,0 +1,83 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/irendersystem.h"
+#include "rendersystem/icommandcontext.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+class ShaderVk;
+class DescriptorSetVk;
+class ResourceStateTracker;
+
+// Records into secondary command buffers from its own command pools, one pool per frame slot.
+// A pool is reset the first time the context is used in a new frame, by then the scheduler has
+// waited for the frame that last used the slot.
+class CommandContextVk : public ICommandContext
+{
+public:
+
+	bool Init(uint32_t queueFamily);
+	void Destroy();
+
+	virtual void Begin(CommandContextType type, IRenderTarget* target);
+	virtual void End();
+
+	virtual void SetViewport(Viewport settings);
+	virtual void SetScissorRectangle(ScissorRectangle settings);
+
+	virtual void BindShader(IShader* shader, PipelineBindPoint point);
+	virtual void BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point, const uint32_t* constantOffsets = nullptr, uint32_t numOffsets = 0);
+	virtual void SetPushConstants(const void* data, uint32_t size, uint32_t offset = 0);
+
+	virtual void SetVertexBuffer(IVertexBuffer* buffer);
+	virtual void SetIndexBuffer(IIndexBuffer* buffer);
+
+	virtual void DrawPrimitive(int first_vertex, int vertex_count);
+	virtual void DrawIndexedPrimitives(int index_count, int first_index = 0, int base_vertex = 0, int instance_count = 1, int first_instance = 0);
+	virtual void Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ);
+	virtual void DispatchThreads(uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ);
+
+	CommandContextType GetType() const { return Type; }
+	VkCommandBuffer GetCommandBuffer() const { return CommandBuffer; }
+
+	// Render pass the recorded draws expect to run in
+	VkImageView GetTargetView() const { return TargetView; }
+	VkExtent2D GetTargetExtent() const { return TargetExtent; }
+
+	// Recording threads can't touch the state tracker, bound resources are transitioned at execution
+	void TransitionResources(ResourceStateTracker& tracker);
+
+private:
+
+	struct FramePool
+	{
+		VkCommandPool Pool = VK_NULL_HANDLE;
+		Array<VkCommandBuffer> Buffers;
+		uint32_t UsedBuffers = 0;
+		uint64_t Frame = 0;
+	};
+
+	VkCommandBuffer NextCommandBuffer();
+
+	ConstArray<FramePool, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT> Pools;
+
+	VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+	CommandContextType Type = CommandContextType::Graphics;
+
+	VkImageView TargetView = VK_NULL_HANDLE;
+	VkFormat TargetFormat = VK_FORMAT_UNDEFINED;
+	VkExtent2D TargetExtent = {};
+
+	ShaderVk* BoundShader = nullptr;
+	bool BoundShaderReady = false;
+	bool BindlessGraphicsBound = false;
+	bool BindlessComputeBound = false;
+	bool DescriptorBufferBound = false;
+
+	struct BoundSet
+	{
+		DescriptorSetVk* Set;
+		PipelineBindPoint Point;
+	};
+	Array<BoundSet> BoundSets;
+};
\ No newline at end of file
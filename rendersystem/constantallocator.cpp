@@ -0,0 +1,84 @@
+#include "common_stl.h"
+#include "constantallocator.h"
+#include "rendersystem.h"
+
+#include <algorithm>
+
+bool ConstantAllocatorVk::Init(VkDeviceSize minAlignment, VkDeviceSize maxRange, const Array<uint32_t>& queueFamilies)
+{
+	Alignment = std::max<VkDeviceSize>(minAlignment, 16);
+	MaxRange = maxRange;
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = FRAME_CAPACITY * FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT;
+	// Descriptors in the descriptor buffer reach the ring by its address
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (queueFamilies.size() > 1)
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = (uint32_t)queueFamilies.size();
+		bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+	}
+
+	// VRAM the CPU can write through a resizable BAR when there is one, system memory otherwise
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocationResult = {};
+	if (vmaCreateBuffer(rendersystem->GetAllocator(), &bufferInfo, &allocInfo, &Buffer, &Allocation, &allocationResult) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create constant buffer ring\n";
+		return false;
+	}
+
+	Mapped = static_cast<char*>(allocationResult.pMappedData);
+
+	RegionBegin = 0;
+	Head = 0;
+
+	return true;
+}
+
+void ConstantAllocatorVk::Destroy()
+{
+	if (Buffer != VK_NULL_HANDLE)
+		vmaDestroyBuffer(rendersystem->GetAllocator(), Buffer, Allocation);
+
+	Buffer = VK_NULL_HANDLE;
+	Allocation = VK_NULL_HANDLE;
+	Mapped = nullptr;
+}
+
+void ConstantAllocatorVk::BeginFrame(uint32_t slotIndex)
+{
+	RegionBegin = FRAME_CAPACITY * slotIndex;
+	Head = RegionBegin;
+}
+
+bool ConstantAllocatorVk::Allocate(VkDeviceSize size, void*& data, uint32_t& offset)
+{
+	// Regions start at multiples of the capacity, so aligned sizes keep every offset aligned
+	VkDeviceSize alignedSize = (size + Alignment - 1) & ~(Alignment - 1);
+
+	VkDeviceSize begin = Head.fetch_add(alignedSize);
+	if (begin + alignedSize > RegionBegin + FRAME_CAPACITY)
+	{
+		// std::cout << "frame constants exceed the ring capacity\n";
+		data = nullptr;
+		return false;
+	}
+
+	data = Mapped + begin;
+	offset = (uint32_t)begin;
+	return true;
+}
+
+void ConstantAllocatorVk::Flush()
+{
+	VkDeviceSize end = std::min(Head.load(), RegionBegin + FRAME_CAPACITY);
+	if (end > RegionBegin)
+		vmaFlushAllocation(rendersystem->GetAllocator(), Allocation, RegionBegin, end - RegionBegin);
+}
\ No newline at end of file
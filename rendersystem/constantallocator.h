@@ -0,0 +1,49 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+#include "vk_mem_alloc.h"
+
+#include <atomic>
+
+// Per-frame linear allocator for shader constants.
+// One persistently mapped buffer split into a region per frame slot. Allocating bumps the head of the
+// current region, the region is reused once the scheduler has waited for the frame that last used its slot.
+// Descriptor sets bind the whole buffer as a dynamic uniform buffer, slices are selected by the dynamic offset.
+class ConstantAllocatorVk
+{
+public:
+	static constexpr VkDeviceSize FRAME_CAPACITY = 4 * 1024 * 1024;
+
+	// Queue families reading the constants, more than one makes the buffer concurrently shared
+	bool Init(VkDeviceSize minAlignment, VkDeviceSize maxRange, const Array<uint32_t>& queueFamilies);
+	void Destroy();
+
+	// Start handing out the region of the slot, everything allocated from it before is no longer in use
+	void BeginFrame(uint32_t slotIndex);
+
+	// Thread safe. Slice of the current frame, false when the frame ran out of space
+	bool Allocate(VkDeviceSize size, void*& data, uint32_t& offset);
+
+	// Make the writes of the frame visible to the device, no-op on coherent memory
+	void Flush();
+
+	VkBuffer GetBuffer() const { return Buffer; }
+
+	// Largest range a dynamic uniform buffer descriptor may cover
+	VkDeviceSize GetMaxRange() const { return MaxRange; }
+
+private:
+
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VmaAllocation Allocation = VK_NULL_HANDLE;
+	char* Mapped = nullptr;
+
+	VkDeviceSize Alignment = 256;
+	VkDeviceSize MaxRange = 0;
+
+	// Offsets into the whole buffer
+	VkDeviceSize RegionBegin = 0;
+	std::atomic<VkDeviceSize> Head = 0;
+};
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "common_stl.h"
+#include "descriptorallocator.h"
+#include "rendersystem.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
+#include <iterator>
+
+struct PoolSizeRatio
+{
+	VkDescriptorType Type;
+	float Ratio;
+};
+
+// Descriptors per set in a page, every type a layout can have is covered
+static const PoolSizeRatio POOL_RATIOS[] =
+{
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.0f },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+	{ VK_DESCRIPTOR_TYPE_SAMPLER, 1.0f },
+};
+
+bool DescriptorAllocatorVk::Init(VkDevice device)
+{
+	Device = device;
+
+	// One page up front, the first sets don't wait for a pool to be created
+	VkDescriptorPool page = CreatePage(Persistent.SetsPerPage, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
+	if (page == VK_NULL_HANDLE)
+		return false;
+
+	Persistent.Ready.push_back(page);
+	return true;
+}
+
+void DescriptorAllocatorVk::Destroy()
+{
+	DestroyChain(Persistent);
+
+	for (PageChain& chain : Transient)
+		DestroyChain(chain);
+
+	PersistentPages.clear();
+	RetiredSets.clear();
+}
+
+VkDescriptorSet DescriptorAllocatorVk::Allocate(VkDescriptorSetLayout layout)
+{
+	std::lock_guard<std::mutex> lock(AllocatorMutex);
+
+	VkDescriptorPool page = VK_NULL_HANDLE;
+	VkDescriptorSet set = Allocate(Persistent, layout, &page);
+	if (set != VK_NULL_HANDLE)
+		PersistentPages[set] = page;
+
+	return set;
+}
+
+VkDescriptorSet DescriptorAllocatorVk::AllocateTransient(VkDescriptorSetLayout layout)
+{
+	std::lock_guard<std::mutex> lock(AllocatorMutex);
+	return Allocate(Transient[CurrentSlot], layout, nullptr);
+}
+
+void DescriptorAllocatorVk::Free(VkDescriptorSet set, uint64_t frame)
+{
+	if (set == VK_NULL_HANDLE)
+		return;
+
+	std::lock_guard<std::mutex> lock(AllocatorMutex);
+	RetiredSets.push_back({ set, frame });
+}
+
+void DescriptorAllocatorVk::BeginFrame(uint32_t slotIndex)
+{
+	TRACE_SCOPE("ResetDescriptorPools");
+
+	std::lock_guard<std::mutex> lock(AllocatorMutex);
+
+	CurrentSlot = slotIndex;
+	PageChain& chain = Transient[slotIndex];
+
+	// Frees every set of the page at once, the sets of the frame are all gone
+	for (VkDescriptorPool page : chain.Full)
+		vkResetDescriptorPool(Device, page, 0);
+	for (VkDescriptorPool page : chain.Ready)
+		vkResetDescriptorPool(Device, page, 0);
+
+	chain.Ready.insert(chain.Ready.end(), chain.Full.begin(), chain.Full.end());
+	chain.Full.clear();
+
+	FreeRetired();
+}
+
+void DescriptorAllocatorVk::FreeRetired()
+{
+	uint64_t completedFrame = rendersystem->GetCompletedFrame();
+
+	while (!RetiredSets.empty() && RetiredSets.front().Frame <= completedFrame)
+	{
+		VkDescriptorSet set = RetiredSets.front().Set;
+		RetiredSets.pop_front();
+
+		auto iter = PersistentPages.find(set);
+		if (iter == PersistentPages.end())
+			continue;
+
+		VkDescriptorPool page = iter->second;
+		PersistentPages.erase(iter);
+
+		vkFreeDescriptorSets(Device, page, 1, &set);
+
+		// A full page has room again, it is tried before a new one is created
+		auto full = std::find(Persistent.Full.begin(), Persistent.Full.end(), page);
+		if (full != Persistent.Full.end())
+		{
+			Persistent.Full.erase(full);
+			Persistent.Ready.insert(Persistent.Ready.begin(), page);
+		}
+	}
+}
+
+VkDescriptorSet DescriptorAllocatorVk::Allocate(PageChain& chain, VkDescriptorSetLayout layout, VkDescriptorPool* page)
+{
+	// Only long lived sets are freed on their own, transient pages are reset whole
+	VkDescriptorPoolCreateFlags flags = &chain == &Persistent ? VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT : 0;
+
+	VkDescriptorSetAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	// A fresh page failing too means the layout doesn't fit into any page
+	bool freshPage = false;
+	while (true)
+	{
+		if (chain.Ready.empty())
+		{
+			VkDescriptorPool newPage = CreatePage(chain.SetsPerPage, flags);
+			if (newPage == VK_NULL_HANDLE)
+				return VK_NULL_HANDLE;
+
+			chain.Ready.push_back(newPage);
+			chain.SetsPerPage = std::min(chain.SetsPerPage * 2, MAX_SETS_PER_PAGE);
+			freshPage = true;
+		}
+
+		allocInfo.descriptorPool = chain.Ready.back();
+
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		VkResult result = vkAllocateDescriptorSets(Device, &allocInfo, &set);
+		if (result == VK_SUCCESS)
+		{
+			if (page)
+				*page = allocInfo.descriptorPool;
+			return set;
+		}
+
+		if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || freshPage)
+		{
+			// std::cout << "failed to allocate descriptor set\n";
+			return VK_NULL_HANDLE;
+		}
+
+		// Out of sets or descriptors, the page stays full until it is reset
+		chain.Full.push_back(chain.Ready.back());
+		chain.Ready.pop_back();
+	}
+}
+
+VkDescriptorPool DescriptorAllocatorVk::CreatePage(uint32_t maxSets, VkDescriptorPoolCreateFlags flags)
+{
+	ConstArray<VkDescriptorPoolSize, std::size(POOL_RATIOS)> poolSizes;
+	for (uint32_t i = 0; i < poolSizes.size(); ++i)
+		poolSizes[i] = { POOL_RATIOS[i].Type, uint32_t(POOL_RATIOS[i].Ratio * maxSets) };
+
+	VkDescriptorPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.flags = flags;
+	poolInfo.maxSets = maxSets;
+	poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool page = VK_NULL_HANDLE;
+	if (vkCreateDescriptorPool(Device, &poolInfo, nullptr, &page) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create descriptor pool\n";
+		return VK_NULL_HANDLE;
+	}
+
+	return page;
+}
+
+void DescriptorAllocatorVk::DestroyChain(PageChain& chain)
+{
+	for (VkDescriptorPool page : chain.Full)
+		vkDestroyDescriptorPool(Device, page, nullptr);
+	for (VkDescriptorPool page : chain.Ready)
+		vkDestroyDescriptorPool(Device, page, nullptr);
+
+	chain = PageChain{};
+}
\ No newline at end of file
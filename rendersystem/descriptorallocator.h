@@ -0,0 +1,67 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+#include <mutex>
+
+// Hands out descriptor sets from pages of descriptor pools, a new page is added whenever the current one runs out
+// of sets or descriptors, or is too fragmented. Long lived sets and the transient sets of each frame slot come from
+// separate pages. Transient pages are reset all at once when their slot comes around again. Long lived sets are
+// freed one by one, once the frames that could still read them are done.
+class DescriptorAllocatorVk
+{
+public:
+
+	bool Init(VkDevice device);
+	void Destroy();
+
+	// Thread safe. Lives as long as the allocator, VK_NULL_HANDLE when even a fresh page can't hold the layout
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+	// Thread safe. Only valid for the frame being recorded
+	VkDescriptorSet AllocateTransient(VkDescriptorSetLayout layout);
+
+	// Long lived set nothing hands out anymore, freed once the frame is complete
+	void Free(VkDescriptorSet set, uint64_t frame);
+
+	// The frame that last used this slot is done, its transient pages go back in one reset each.
+	// Freed sets whose frame is complete go back to their page.
+	void BeginFrame(uint32_t slotIndex);
+
+private:
+
+	// Sets of the first page, every new page doubles it up to the maximum
+	static constexpr uint32_t INITIAL_SETS_PER_PAGE = 64;
+	static constexpr uint32_t MAX_SETS_PER_PAGE = 4096;
+
+	// Pages of one lifetime, allocations go to the last page that isn't full
+	struct PageChain
+	{
+		Array<VkDescriptorPool> Full;
+		Array<VkDescriptorPool> Ready;
+		uint32_t SetsPerPage = INITIAL_SETS_PER_PAGE;
+	};
+
+	struct RetiredSet
+	{
+		VkDescriptorSet Set;
+		uint64_t Frame;
+	};
+
+	VkDescriptorSet Allocate(PageChain& chain, VkDescriptorSetLayout layout, VkDescriptorPool* page);
+	VkDescriptorPool CreatePage(uint32_t maxSets, VkDescriptorPoolCreateFlags flags);
+	void DestroyChain(PageChain& chain);
+	void FreeRetired();
+
+	VkDevice Device = VK_NULL_HANDLE;
+
+	std::mutex AllocatorMutex;
+	PageChain Persistent;
+
+	// Page every long lived set came from, and the sets freed in frame order
+	Dict<VkDescriptorSet, VkDescriptorPool> PersistentPages;
+	Queue<RetiredSet> RetiredSets;
+	ConstArray<PageChain, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT> Transient;
+	uint32_t CurrentSlot = 0;
+};
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "common_stl.h"
+#include "descriptorbuffer.h"
+#include "descriptorsets.h"
+#include "rendersystem.h"
+
+#include <algorithm>
+
+bool DescriptorBufferVk::Init(VkDevice device, const VkPhysicalDeviceDescriptorBufferPropertiesEXT& properties, const Array<uint32_t>& queueFamilies)
+{
+	Device = device;
+	Properties = properties;
+
+	GetLayoutSizeFn = (PFN_vkGetDescriptorSetLayoutSizeEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutSizeEXT");
+	GetBindingOffsetFn = (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+	GetDescriptorFn = (PFN_vkGetDescriptorEXT)vkGetDeviceProcAddr(device, "vkGetDescriptorEXT");
+	CmdBindBuffersFn = (PFN_vkCmdBindDescriptorBuffersEXT)vkGetDeviceProcAddr(device, "vkCmdBindDescriptorBuffersEXT");
+	CmdSetOffsetsFn = (PFN_vkCmdSetDescriptorBufferOffsetsEXT)vkGetDeviceProcAddr(device, "vkCmdSetDescriptorBufferOffsetsEXT");
+
+	if (!GetLayoutSizeFn || !GetBindingOffsetFn || !GetDescriptorFn || !CmdBindBuffersFn || !CmdSetOffsetsFn)
+	{
+		// std::cout << "descriptor buffer entry points are missing\n";
+		return false;
+	}
+
+	VkBufferCreateInfo bufferInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = PERSISTENT_CAPACITY + FRAME_CAPACITY * FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT;
+	bufferInfo.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (queueFamilies.size() > 1)
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = (uint32_t)queueFamilies.size();
+		bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+	}
+
+	// Same placement as the constant ring, the device reads descriptors every draw
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocationResult = {};
+	if (vmaCreateBuffer(rendersystem->GetAllocator(), &bufferInfo, &allocInfo, &Buffer, &Allocation, &allocationResult) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create descriptor buffer\n";
+		return false;
+	}
+
+	Mapped = static_cast<char*>(allocationResult.pMappedData);
+
+	VkBufferDeviceAddressInfo addressInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addressInfo.buffer = Buffer;
+	Address = vkGetBufferDeviceAddress(Device, &addressInfo);
+
+	PersistentHead = 0;
+	RetiredRanges.clear();
+	FreeRanges.clear();
+	RegionBegin = PERSISTENT_CAPACITY;
+	Head = RegionBegin;
+
+	return true;
+}
+
+void DescriptorBufferVk::Destroy()
+{
+	if (Buffer != VK_NULL_HANDLE)
+		vmaDestroyBuffer(rendersystem->GetAllocator(), Buffer, Allocation);
+
+	Buffer = VK_NULL_HANDLE;
+	Allocation = VK_NULL_HANDLE;
+	Mapped = nullptr;
+}
+
+void DescriptorBufferVk::BeginFrame(uint32_t slotIndex)
+{
+	RegionBegin = PERSISTENT_CAPACITY + FRAME_CAPACITY * slotIndex;
+	Head = RegionBegin;
+
+	std::lock_guard<std::mutex> lock(PersistentMutex);
+
+	uint64_t completedFrame = rendersystem->GetCompletedFrame();
+	bool freed = false;
+	while (!RetiredRanges.empty() && RetiredRanges.front().Frame <= completedFrame)
+	{
+		FreeRanges.push_back(RetiredRanges.front());
+		RetiredRanges.pop_front();
+		freed = true;
+	}
+
+	if (!freed)
+		return;
+
+	// Neighbours become one range, a larger set fits where two smaller ones were
+	std::sort(FreeRanges.begin(), FreeRanges.end(), [](const FreeRange& a, const FreeRange& b) { return a.Offset < b.Offset; });
+
+	Array<FreeRange> merged;
+	for (const FreeRange& range : FreeRanges)
+	{
+		if (!merged.empty() && merged.back().Offset + merged.back().Size == range.Offset)
+			merged.back().Size += range.Size;
+		else
+			merged.push_back(range);
+	}
+
+	// The end of the bump allocated part goes back to the head
+	if (!merged.empty() && merged.back().Offset + merged.back().Size == PersistentHead)
+	{
+		PersistentHead = merged.back().Offset;
+		merged.pop_back();
+	}
+
+	FreeRanges = std::move(merged);
+}
+
+VkDeviceSize DescriptorBufferVk::Allocate(VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = AlignSize(size);
+
+	std::lock_guard<std::mutex> lock(PersistentMutex);
+
+	// First fit among the freed ranges, the rest of the range stays free
+	for (auto iter = FreeRanges.begin(); iter != FreeRanges.end(); ++iter)
+	{
+		if (iter->Size < alignedSize)
+			continue;
+
+		VkDeviceSize offset = iter->Offset;
+		iter->Offset += alignedSize;
+		iter->Size -= alignedSize;
+		if (iter->Size == 0)
+			FreeRanges.erase(iter);
+
+		return offset;
+	}
+
+	if (PersistentHead + alignedSize > PERSISTENT_CAPACITY)
+	{
+		// std::cout << "descriptor buffer is full\n";
+		return INVALID_OFFSET;
+	}
+
+	VkDeviceSize offset = PersistentHead;
+	PersistentHead += alignedSize;
+	return offset;
+}
+
+void DescriptorBufferVk::Free(VkDeviceSize offset, VkDeviceSize size, uint64_t frame)
+{
+	if (offset == INVALID_OFFSET)
+		return;
+
+	std::lock_guard<std::mutex> lock(PersistentMutex);
+	RetiredRanges.push_back({ offset, AlignSize(size), frame });
+}
+
+VkDeviceSize DescriptorBufferVk::AllocateTransient(VkDeviceSize size)
+{
+	return AllocateFrom(Head, RegionBegin + FRAME_CAPACITY, size);
+}
+
+VkDeviceSize DescriptorBufferVk::AllocateFrom(std::atomic<VkDeviceSize>& head, VkDeviceSize end, VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = AlignSize(size);
+
+	VkDeviceSize begin = head.fetch_add(alignedSize);
+	if (begin + alignedSize > end)
+	{
+		// std::cout << "descriptor buffer is full\n";
+		return INVALID_OFFSET;
+	}
+
+	return begin;
+}
+
+VkDeviceSize DescriptorBufferVk::AlignSize(VkDeviceSize size) const
+{
+	// Regions start at multiples of the capacity, so aligned sizes keep every offset aligned
+	VkDeviceSize alignment = std::max<VkDeviceSize>(Properties.descriptorBufferOffsetAlignment, 1);
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+VkDeviceSize DescriptorBufferVk::GetDescriptorSize(VkDescriptorType type) const
+{
+	switch (type)
+	{
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		return Properties.uniformBufferDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		return Properties.storageBufferDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		return Properties.storageImageDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		return Properties.sampledImageDescriptorSize;
+	default:
+		return 0;
+	}
+}
+
+void DescriptorBufferVk::WriteDescriptor(void* dst, VkDescriptorType type, const DescriptorData& data, VkDeviceSize extraOffset) const
+{
+	VkDescriptorGetInfoEXT info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+	info.type = type;
+
+	VkDescriptorAddressInfoEXT addressInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT };
+	if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+	{
+		VkBufferDeviceAddressInfo bufferAddress = { .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+		bufferAddress.buffer = data.Buffer.buffer;
+
+		addressInfo.address = vkGetBufferDeviceAddress(Device, &bufferAddress) + data.Buffer.offset + extraOffset;
+		addressInfo.range = data.Buffer.range;
+		addressInfo.format = VK_FORMAT_UNDEFINED;
+	}
+
+	switch (type)
+	{
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		info.data.pUniformBuffer = &addressInfo;
+		break;
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		info.data.pStorageBuffer = &addressInfo;
+		break;
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		info.data.pStorageImage = &data.Image;
+		break;
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		info.data.pSampledImage = &data.Image;
+		break;
+	default:
+		// std::cout << "descriptor type can't go into the descriptor buffer\n";
+		return;
+	}
+
+	GetDescriptorFn(Device, &info, GetDescriptorSize(type), dst);
+}
+
+void DescriptorBufferVk::Flush(VkDeviceSize offset, VkDeviceSize size)
+{
+	vmaFlushAllocation(rendersystem->GetAllocator(), Allocation, offset, size);
+}
+
+void DescriptorBufferVk::FlushFrame()
+{
+	VkDeviceSize end = std::min(Head.load(), RegionBegin + FRAME_CAPACITY);
+	if (end > RegionBegin)
+		Flush(RegionBegin, end - RegionBegin);
+}
+
+VkDeviceSize DescriptorBufferVk::GetLayoutSize(VkDescriptorSetLayout layout) const
+{
+	VkDeviceSize size = 0;
+	GetLayoutSizeFn(Device, layout, &size);
+	return size;
+}
+
+VkDeviceSize DescriptorBufferVk::GetBindingOffset(VkDescriptorSetLayout layout, uint32_t binding) const
+{
+	VkDeviceSize offset = 0;
+	GetBindingOffsetFn(Device, layout, binding, &offset);
+	return offset;
+}
+
+void DescriptorBufferVk::BindSet(VkCommandBuffer cmd, VkPipelineBindPoint point, VkPipelineLayout layout, VkDeviceSize offset, bool& bound)
+{
+	if (!bound)
+	{
+		VkDescriptorBufferBindingInfoEXT bindingInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT };
+		bindingInfo.address = Address;
+		bindingInfo.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+
+		CmdBindBuffersFn(cmd, 1, &bindingInfo);
+		bound = true;
+	}
+
+	uint32_t bufferIndex = 0;
+	CmdSetOffsetsFn(cmd, point, layout, 0, 1, &bufferIndex, &offset);
+}
\ No newline at end of file
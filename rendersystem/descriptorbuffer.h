@@ -0,0 +1,94 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+#include "vk_mem_alloc.h"
+
+#include <atomic>
+#include <mutex>
+
+union DescriptorData;
+
+// Descriptor sets kept straight in a persistently mapped buffer through VK_EXT_descriptor_buffer.
+// Writing a set is copying descriptors into the buffer and binding it is setting an offset, no pools involved.
+// Long lived sets come from the front of the buffer, freed ranges are handed out again once the frames reading them
+// are done. Transient sets come from a region per frame slot, reused once the slot's frame is done.
+class DescriptorBufferVk
+{
+public:
+	static constexpr VkDeviceSize PERSISTENT_CAPACITY = 1024 * 1024;
+	static constexpr VkDeviceSize FRAME_CAPACITY = 1024 * 1024;
+	static constexpr VkDeviceSize INVALID_OFFSET = ~VkDeviceSize(0);
+
+	// Queue families reading the descriptors, more than one makes the buffer concurrently shared
+	bool Init(VkDevice device, const VkPhysicalDeviceDescriptorBufferPropertiesEXT& properties, const Array<uint32_t>& queueFamilies);
+	void Destroy();
+
+	// Start handing out the region of the slot, everything allocated from it before is no longer in use.
+	// Freed long lived ranges whose frame is complete can be allocated again.
+	void BeginFrame(uint32_t slotIndex);
+
+	// Thread safe. Offset of a range for the descriptors of a set, INVALID_OFFSET when the buffer is full
+	VkDeviceSize Allocate(VkDeviceSize size);
+	VkDeviceSize AllocateTransient(VkDeviceSize size);
+
+	// Thread safe. Long lived range nothing binds anymore, reused once the frame is complete
+	void Free(VkDeviceSize offset, VkDeviceSize size, uint64_t frame);
+
+	void* GetMapped(VkDeviceSize offset) const { return Mapped + offset; }
+
+	// Write the descriptor of a binding, buffers are offset by extraOffset on top of their own offset
+	void WriteDescriptor(void* dst, VkDescriptorType type, const DescriptorData& data, VkDeviceSize extraOffset = 0) const;
+
+	// Make writes to the range visible to the device, no-op on coherent memory
+	void Flush(VkDeviceSize offset, VkDeviceSize size);
+
+	// Make the transient writes of the frame visible to the device
+	void FlushFrame();
+
+	// Size of a set of the layout in the buffer, and where the descriptor of a binding starts in it
+	VkDeviceSize GetLayoutSize(VkDescriptorSetLayout layout) const;
+	VkDeviceSize GetBindingOffset(VkDescriptorSetLayout layout, uint32_t binding) const;
+
+	// The buffer goes in once per command buffer, bound tracks that, then set 0 is pointed at the set
+	void BindSet(VkCommandBuffer cmd, VkPipelineBindPoint point, VkPipelineLayout layout, VkDeviceSize offset, bool& bound);
+
+private:
+
+	struct FreeRange
+	{
+		VkDeviceSize Offset;
+		VkDeviceSize Size;
+		uint64_t Frame;
+	};
+
+	VkDeviceSize AllocateFrom(std::atomic<VkDeviceSize>& head, VkDeviceSize end, VkDeviceSize size);
+	VkDeviceSize AlignSize(VkDeviceSize size) const;
+	VkDeviceSize GetDescriptorSize(VkDescriptorType type) const;
+
+	VkDevice Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT Properties = {};
+
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VmaAllocation Allocation = VK_NULL_HANDLE;
+	VkDeviceAddress Address = 0;
+	char* Mapped = nullptr;
+
+	// Offsets into the whole buffer, the transient regions follow the persistent one
+	VkDeviceSize PersistentHead = 0;
+	VkDeviceSize RegionBegin = PERSISTENT_CAPACITY;
+	std::atomic<VkDeviceSize> Head = PERSISTENT_CAPACITY;
+
+	// Freed long lived ranges, waiting for their frame in free order, then sorted by offset and merged
+	std::mutex PersistentMutex;
+	Queue<FreeRange> RetiredRanges;
+	Array<FreeRange> FreeRanges;
+
+	// Extension entry points, not exported by the loader
+	PFN_vkGetDescriptorSetLayoutSizeEXT GetLayoutSizeFn = nullptr;
+	PFN_vkGetDescriptorSetLayoutBindingOffsetEXT GetBindingOffsetFn = nullptr;
+	PFN_vkGetDescriptorEXT GetDescriptorFn = nullptr;
+	PFN_vkCmdBindDescriptorBuffersEXT CmdBindBuffersFn = nullptr;
+	PFN_vkCmdSetDescriptorBufferOffsetsEXT CmdSetOffsetsFn = nullptr;
+};
\ No newline at end of file
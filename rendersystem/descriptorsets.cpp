@@ -1,58 +1,391 @@
 #include "rendersystem.h"
 #include "descriptorsets.h"
+#include "libcommon/hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+static bool IsImageDescriptor(VkDescriptorType type)
+{
+	return type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+		type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
 
 void DescriptorLayoutVk::AddBinding(uint32_t binding, DescriptorType type, VkShaderStageFlagBits stage)
 {
 	VkDescriptorType vkType = RenderUtils::DescriptorTypeToVulkan(type);
 
-	LayoutBuilder.AddBinding(0, vkType, stage);
+	LayoutBuilder.AddBinding(binding, vkType, stage);
 }
 
 void DescriptorLayoutVk::Build()
 {
-	Layout = LayoutBuilder.Build();
+	DescriptorBuffer = rendersystem->IsDescriptorBufferActive();
+
+	CollectSlots();
+
+	if (DescriptorBuffer)
+	{
+		Layout = LayoutBuilder.Build(nullptr, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT);
+		QueryBufferLayout();
+	}
+	else
+	{
+		Layout = LayoutBuilder.Build();
+
+		if (!CreateUpdateTemplate())
+		{
+			// std::cout << "failed to create descriptor update template\n";
+		}
+	}
 
 	LayoutBuilder.Clear();
 }
 
 void DescriptorLayoutVk::Destroy()
 {
+	if (UpdateTemplate != VK_NULL_HANDLE)
+		vkDestroyDescriptorUpdateTemplate(rendersystem->GetDevice(), UpdateTemplate, nullptr);
+
 	vkDestroyDescriptorSetLayout(rendersystem->GetDevice(), Layout, nullptr);
+
+	// Frames already recorded may still bind the cached sets
+	uint64_t frame = rendersystem->GetCurrentFrame();
+	for (auto& [hash, bucket] : SetCache)
+	{
+		for (CachedSet& cached : bucket)
+			FreeSet(cached.Location, frame);
+	}
+	SetCache.clear();
+}
+
+void DescriptorLayoutVk::FreeSet(const DescriptorSetLocation& location, uint64_t frame)
+{
+	if (DescriptorBuffer)
+		rendersystem->GetDescriptorBuffer().Free(location.Offset, BufferSize, frame);
+	else
+		rendersystem->GetDescriptorAllocator().Free(location.Set, frame);
+}
+
+void DescriptorLayoutVk::CollectSlots()
+{
+	for (VkDescriptorSetLayoutBinding& binding : LayoutBuilder.Bindings)
+	{
+		if (DescriptorBuffer && binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+		{
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			DynamicSlots.push_back((uint32_t)SlotBindings.size());
+		}
+
+		SlotBindings.push_back(binding.binding);
+		SlotTypes.push_back(binding.descriptorType);
+	}
+
+	std::sort(DynamicSlots.begin(), DynamicSlots.end(), [this](uint32_t a, uint32_t b) { return SlotBindings[a] < SlotBindings[b]; });
+}
+
+void DescriptorLayoutVk::QueryBufferLayout()
+{
+	DescriptorBufferVk& buffer = rendersystem->GetDescriptorBuffer();
+
+	BufferSize = buffer.GetLayoutSize(Layout);
+	for (uint32_t binding : SlotBindings)
+		SlotOffsets.push_back(buffer.GetBindingOffset(Layout, binding));
+}
+
+bool DescriptorLayoutVk::CreateUpdateTemplate()
+{
+	Array<VkDescriptorUpdateTemplateEntry> entries;
+	for (size_t i = 0; i < SlotBindings.size(); ++i)
+	{
+		VkDescriptorUpdateTemplateEntry entry = {};
+		entry.dstBinding = SlotBindings[i];
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = 1;
+		entry.descriptorType = SlotTypes[i];
+		entry.offset = i * sizeof(DescriptorData);
+		entry.stride = sizeof(DescriptorData);
+
+		entries.push_back(entry);
+	}
+
+	if (entries.empty())
+		return true;
+
+	VkDescriptorUpdateTemplateCreateInfo info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+	info.descriptorUpdateEntryCount = (uint32_t)entries.size();
+	info.pDescriptorUpdateEntries = entries.data();
+	info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	info.descriptorSetLayout = Layout;
+
+	return vkCreateDescriptorUpdateTemplate(rendersystem->GetDevice(), &info, nullptr, &UpdateTemplate) == VK_SUCCESS;
+}
+
+int32_t DescriptorLayoutVk::FindSlot(uint32_t binding) const
+{
+	auto it = std::find(SlotBindings.begin(), SlotBindings.end(), binding);
+	if (it == SlotBindings.end())
+		return -1;
+
+	return (int32_t)(it - SlotBindings.begin());
+}
+
+bool DescriptorLayoutVk::FindSet(uint64_t hash, const Array<DescriptorData>& contents, DescriptorSetLocation& location)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	auto it = SetCache.find(hash);
+	if (it == SetCache.end())
+		return false;
+
+	for (CachedSet& cached : it->second)
+	{
+		if (SameContents(cached.Contents, contents))
+		{
+			location = cached.Location;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+DescriptorSetLocation DescriptorLayoutVk::AddSet(uint64_t hash, const Array<DescriptorData>& contents, const DescriptorSetLocation& location)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	// Colliding contents get their own entry, whatever is written is owned by the cache
+	Array<CachedSet>& bucket = SetCache[hash];
+	for (CachedSet& cached : bucket)
+	{
+		if (SameContents(cached.Contents, contents))
+		{
+			// Never bound, nothing recorded so far reads it
+			FreeSet(location, rendersystem->GetCurrentFrame());
+			return cached.Location;
+		}
+	}
+
+	bucket.push_back({ contents, location });
+	return location;
+}
+
+void DescriptorLayoutVk::EvictImageView(VkImageView view)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	// Frames already recorded may still bind them
+	uint64_t frame = rendersystem->GetCurrentFrame();
+
+	for (auto it = SetCache.begin(); it != SetCache.end();)
+	{
+		Array<CachedSet>& bucket = it->second;
+		for (auto cached = bucket.begin(); cached != bucket.end();)
+		{
+			bool reads = false;
+			for (size_t i = 0; i < SlotTypes.size() && !reads; ++i)
+				reads = IsImageDescriptor(SlotTypes[i]) && cached->Contents[i].Image.imageView == view;
+
+			if (!reads)
+			{
+				++cached;
+				continue;
+			}
+
+			FreeSet(cached->Location, frame);
+			cached = bucket.erase(cached);
+		}
+
+		it = bucket.empty() ? SetCache.erase(it) : std::next(it);
+	}
+}
+
+bool DescriptorLayoutVk::SameContents(const Array<DescriptorData>& a, const Array<DescriptorData>& b)
+{
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(DescriptorData)) == 0;
 }
 
 void DescriptorSetVk::Init(IDescriptorLayout *layout)
 {
-	DescriptorLayoutVk *vkLayout = static_cast<DescriptorLayoutVk*>(layout);
-	DescriptorSet = rendersystem->GetDescriptorPool().Build(rendersystem->GetDevice(), vkLayout->GetLayout());
+	Reset(layout, false);
+}
+
+void DescriptorSetVk::InitTransient(IDescriptorLayout *layout)
+{
+	Reset(layout, true);
+}
+
+void DescriptorSetVk::Reset(IDescriptorLayout *layout, bool transient)
+{
+	Layout = static_cast<DescriptorLayoutVk*>(layout);
+	Transient = transient;
+	Location = DescriptorSetLocation();
+
+	// Padding is hashed and compared too, it has to be zero
+	Contents.resize(Layout->GetSlotCount());
+	memset(Contents.data(), 0, Contents.size() * sizeof(DescriptorData));
+	Bound.assign(Layout->GetSlotCount(), false);
 
 	ImageBindings.clear();
 }
 
+DescriptorData* DescriptorSetVk::Stage(uint32_t binding)
+{
+	int32_t slot = Layout->FindSlot(binding);
+	if (slot < 0)
+	{
+		// std::cout << "binding is not in the descriptor layout\n";
+		return nullptr;
+	}
+
+	Bound[slot] = true;
+	return &Contents[slot];
+}
+
 void DescriptorSetVk::BindImage(uint32_t binding, HImageView img)
 {
-	VkDescriptorImageInfo imgInfo{};
-	imgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-	imgInfo.imageView = static_cast<VkImageView>(img);
+	DescriptorData* data = Stage(binding);
+	if (!data)
+		return;
+
+	VkImageView view = static_cast<VkImageView>(img);
+
+	// Rebinding replaces the view, the old one no longer needs a transition
+	if (data->Image.imageView != VK_NULL_HANDLE)
+		std::erase(ImageBindings, data->Image.imageView);
+
+	data->Image.sampler = VK_NULL_HANDLE;
+	data->Image.imageView = view;
+	data->Image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	ImageBindings.push_back(view);
+}
+
+void DescriptorSetVk::BindConstantBuffer(uint32_t binding, uint32_t size)
+{
+	DescriptorData* data = Stage(binding);
+	if (!data)
+		return;
+
+	ConstantAllocatorVk& allocator = rendersystem->GetConstantAllocator();
+
+	data->Buffer.buffer = allocator.GetBuffer();
+	data->Buffer.offset = 0;
+	data->Buffer.range = std::min<VkDeviceSize>(size, allocator.GetMaxRange());
+}
+
+void DescriptorSetVk::TransitionImages(ResourceStateTracker& tracker, ResourceUsage usage)
+{
+	for (VkImageView view : ImageBindings)
+		tracker.TransitionImageView(view, usage);
+}
+
+void DescriptorSetVk::CollectImages(ResourceStateTracker& tracker, Array<VkImage>& images)
+{
+	for (VkImageView view : ImageBindings)
+	{
+		VkImage image = tracker.GetViewImage(view);
+		if (image != VK_NULL_HANDLE)
+			images.push_back(image);
+	}
+}
+
+bool DescriptorSetVk::Update()
+{
+	if (!Layout->IsDescriptorBuffer() && Layout->GetUpdateTemplate() == VK_NULL_HANDLE)
+		return false;
+
+	// Without the null descriptor feature every binding the template writes needs something behind it
+	if (std::find(Bound.begin(), Bound.end(), false) != Bound.end())
+	{
+		// std::cout << "descriptor set updated with unbound bindings\n";
+		return false;
+	}
+
+	uint64_t hash = Hash::Fnv1a(Contents.data(), Contents.size() * sizeof(DescriptorData));
+
+	DescriptorSetLocation location;
+	if (Layout->FindSet(hash, Contents, location))
+	{
+		Location = location;
+		return true;
+	}
+
+	// Whatever the set held before stays with the cache, binding it now would read the old contents
+	Location = DescriptorSetLocation();
+
+	// Pool sets can't stand in when the buffer is full, the layout was built for the buffer only
+	if (Layout->IsDescriptorBuffer())
+	{
+		location.Offset = WriteDescriptors(Transient, nullptr, 0);
+		if (location.Offset == DescriptorBufferVk::INVALID_OFFSET)
+			return false;
+	}
+	else
+	{
+		DescriptorAllocatorVk& allocator = rendersystem->GetDescriptorAllocator();
+		location.Set = Transient ? allocator.AllocateTransient(Layout->GetLayout()) : allocator.Allocate(Layout->GetLayout());
+		if (location.Set == VK_NULL_HANDLE)
+			return false;
+
+		vkUpdateDescriptorSetWithTemplate(rendersystem->GetDevice(), location.Set, Layout->GetUpdateTemplate(), Contents.data());
+	}
 
-	ImageBindings.push_back({ binding, imgInfo });
+	// Transient sets are gone under the cache with their frame, only long lived sets can be shared
+	Location = Transient ? location : Layout->AddSet(hash, Contents, location);
+	return true;
 }
 
-void DescriptorSetVk::Update()
+VkDeviceSize DescriptorSetVk::WriteDescriptors(bool transient, const uint32_t* dynamicOffsets, uint32_t numOffsets)
 {
-	for (auto& imgBind : ImageBindings)
+	DescriptorBufferVk& buffer = rendersystem->GetDescriptorBuffer();
+
+	VkDeviceSize size = Layout->GetBufferSize();
+	VkDeviceSize offset = transient ? buffer.AllocateTransient(size) : buffer.Allocate(size);
+	if (offset == DescriptorBufferVk::INVALID_OFFSET)
+		return offset;
+
+	char* dst = static_cast<char*>(buffer.GetMapped(offset));
+	const Array<uint32_t>& dynamicSlots = Layout->GetDynamicSlots();
+
+	for (uint32_t slot = 0; slot < Contents.size(); ++slot)
 	{
-		VkWriteDescriptorSet imageWrite = {};
-		imageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		imageWrite.pNext = nullptr;
+		VkDeviceSize extraOffset = 0;
 
-		imageWrite.dstBinding = imgBind.binding;
-		imageWrite.dstSet = DescriptorSet;
-		imageWrite.descriptorCount = 1;
-		imageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-		imageWrite.pImageInfo = &imgBind.dscImgInfo;
+		auto it = std::find(dynamicSlots.begin(), dynamicSlots.end(), slot);
+		size_t dynamicIndex = it - dynamicSlots.begin();
+		if (it != dynamicSlots.end() && dynamicIndex < numOffsets)
+			extraOffset = dynamicOffsets[dynamicIndex];
 
-		DescriptorBindings.push_back(imageWrite);
+		buffer.WriteDescriptor(dst + Layout->GetSlotOffset(slot), Layout->GetSlotType(slot), Contents[slot], extraOffset);
 	}
 
-	vkUpdateDescriptorSets(rendersystem->GetDevice(), DescriptorBindings.size(), DescriptorBindings.data(), 0, nullptr);
+	// Transient ranges are flushed with the rest of the frame
+	if (!transient)
+		buffer.Flush(offset, size);
+
+	return offset;
 }
+
+void DescriptorSetVk::Bind(VkCommandBuffer cmd, VkPipelineBindPoint point, VkPipelineLayout pipelineLayout, const uint32_t* constantOffsets, uint32_t numOffsets, bool& bufferBound)
+{
+	if (!Layout->IsDescriptorBuffer())
+	{
+		// Never written, see Update
+		if (Location.Set == VK_NULL_HANDLE)
+			return;
+
+		vkCmdBindDescriptorSets(cmd, point, pipelineLayout, 0, 1, &Location.Set, numOffsets, constantOffsets);
+		return;
+	}
+
+	// Constants move with every bind, a set reading them is written again with the offsets applied
+	VkDeviceSize offset = Location.Offset;
+	if (numOffsets > 0 && !Layout->GetDynamicSlots().empty())
+		offset = WriteDescriptors(true, constantOffsets, numOffsets);
+
+	if (offset == DescriptorBufferVk::INVALID_OFFSET)
+		return;
+
+	rendersystem->GetDescriptorBuffer().BindSet(cmd, point, pipelineLayout, offset, bufferBound);
+}
\ No newline at end of file
@@ -2,6 +2,24 @@
 #include "rendersystem/irendersystem.h"
 #include "vulkan_common.h"
 #include "utils.h"
+#include "resourcestate.h"
+#include "descriptorbuffer.h"
+
+#include <mutex>
+
+// What an update template reads for one binding, the layout decides which member is used
+union DescriptorData
+{
+	VkDescriptorImageInfo Image;
+	VkDescriptorBufferInfo Buffer;
+};
+
+// Where the descriptors of a set live, a set from a pool or a range of the descriptor buffer
+struct DescriptorSetLocation
+{
+	VkDescriptorSet Set = VK_NULL_HANDLE;
+	VkDeviceSize Offset = DescriptorBufferVk::INVALID_OFFSET;
+};
 
 class DescriptorLayoutVk : public IDescriptorLayout
 {
@@ -11,42 +29,134 @@ public:
 	
 	void Destroy();
 
+	// Stands for the set layout of the bindless heap, which owns it
+	void InitBindless(VkDescriptorSetLayout layout) { Layout = layout; Bindless = true; }
+	bool IsBindless() const { return Bindless; }
+
 	VkDescriptorSetLayout& GetLayout()
 	{
 		return Layout;
 	}
 
+	// Sets of the layout live in the descriptor buffer, picked when the layout is built
+	bool IsDescriptorBuffer() const { return DescriptorBuffer; }
+
+	// Writes a whole set from one DescriptorData per binding, in the order the bindings were added.
+	// Null for layouts in the descriptor buffer.
+	VkDescriptorUpdateTemplate GetUpdateTemplate() const { return UpdateTemplate; }
+	uint32_t GetSlotCount() const { return (uint32_t)SlotBindings.size(); }
+	VkDescriptorType GetSlotType(uint32_t slot) const { return SlotTypes[slot]; }
+
+	// Descriptor buffer only. Bytes a set takes and where the descriptor of each slot starts in it
+	VkDeviceSize GetBufferSize() const { return BufferSize; }
+	VkDeviceSize GetSlotOffset(uint32_t slot) const { return SlotOffsets[slot]; }
+
+	// Descriptor buffer only. Constant buffer slots in binding order, the order dynamic offsets come in
+	const Array<uint32_t>& GetDynamicSlots() const { return DynamicSlots; }
+
+	// Slot of the binding in the template data, -1 when the layout doesn't have it
+	int32_t FindSlot(uint32_t binding) const;
+
+	// Thread safe. Set already written with exactly these contents, false when there is none
+	bool FindSet(uint64_t hash, const Array<DescriptorData>& contents, DescriptorSetLocation& location);
+
+	// Thread safe. Returns the set that ends up cached, an earlier one when another thread got there first.
+	// The cache owns the location either way, a duplicate is freed right away.
+	DescriptorSetLocation AddSet(uint64_t hash, const Array<DescriptorData>& contents, const DescriptorSetLocation& location);
+
+	// The view is going away, sets reading it are never handed out again.
+	// They are freed once the frames recorded so far are done with them.
+	void EvictImageView(VkImageView view);
+
 private:
 
+	// Dynamic constant buffers become plain ones in the descriptor buffer, their offsets are applied at bind
+	void CollectSlots();
+	bool CreateUpdateTemplate();
+	void QueryBufferLayout();
+
+	// Back to the pool page or the descriptor buffer once the frame is complete
+	void FreeSet(const DescriptorSetLocation& location, uint64_t frame);
+
+	static bool SameContents(const Array<DescriptorData>& a, const Array<DescriptorData>& b);
+
 	RenderUtils::DescriptorLayoutBuilder LayoutBuilder;
-	VkDescriptorSetLayout Layout;
+	VkDescriptorSetLayout Layout = VK_NULL_HANDLE;
+	bool Bindless = false;
+
+	VkDescriptorUpdateTemplate UpdateTemplate = VK_NULL_HANDLE;
+	Array<uint32_t> SlotBindings;
+	Array<VkDescriptorType> SlotTypes;
+
+	bool DescriptorBuffer = false;
+	VkDeviceSize BufferSize = 0;
+	Array<VkDeviceSize> SlotOffsets;
+	Array<uint32_t> DynamicSlots;
+
+	struct CachedSet
+	{
+		Array<DescriptorData> Contents;
+		DescriptorSetLocation Location;
+	};
+
+	// Sets whose contents hash the same share a bucket
+	std::mutex CacheMutex;
+	Dict<uint64_t, Array<CachedSet>> SetCache;
 };
 
+// Bindings are staged on the CPU, Update picks a set with those contents. Identical contents share one set from the
+// layout's cache, so updating never rewrites a set a frame in flight may still read.
 class DescriptorSetVk : public IDescriptorSet
 {
 public:
 
 	virtual void Init(IDescriptorLayout *layout);
 
+	// Sets written from the pages of the frame being recorded, gone when the frame's slot is reused
+	void InitTransient(IDescriptorLayout *layout);
+
 	virtual void BindImage(uint32_t binding, HImageView img);
 
-	virtual void Update();
+	virtual void BindConstantBuffer(uint32_t binding, uint32_t size);
+
+	// Every binding of the layout has to be bound first
+	virtual bool Update();
+
+	bool HasImages() const { return !ImageBindings.empty(); }
+
+	// Queue the layout every bound image needs for the coming draw or dispatch
+	void TransitionImages(ResourceStateTracker& tracker, ResourceUsage usage);
+
+	// Images behind the bound views, for work that has to hand them to another queue
+	void CollectImages(ResourceStateTracker& tracker, Array<VkImage>& images);
 
 	VkDescriptorSet& GetDescriptor()
 	{
-		return DescriptorSet;
+		return Location.Set;
 	}
 
+	// Records the set as set 0 of the pipeline layout, whichever backend its layout uses.
+	// bufferBound tracks whether the command buffer has the descriptor buffer bound yet.
+	void Bind(VkCommandBuffer cmd, VkPipelineBindPoint point, VkPipelineLayout pipelineLayout, const uint32_t* constantOffsets, uint32_t numOffsets, bool& bufferBound);
+
 private:
 
-	VkDescriptorSet DescriptorSet;
+	void Reset(IDescriptorLayout *layout, bool transient);
 
-	struct BindImageInfo
-	{
-		uint32_t binding;
-		VkDescriptorImageInfo dscImgInfo;
-	};
-	Array<BindImageInfo> ImageBindings;
+	// Descriptor buffer only. Range with every slot written, dynamic offsets applied when given
+	VkDeviceSize WriteDescriptors(bool transient, const uint32_t* dynamicOffsets, uint32_t numOffsets);
+
+	// Slot of the binding, null when the layout doesn't have it
+	DescriptorData* Stage(uint32_t binding);
+
+	DescriptorLayoutVk* Layout = nullptr;
+	bool Transient = false;
+
+	DescriptorSetLocation Location;
+
+	// One per slot of the layout's update template
+	Array<DescriptorData> Contents;
+	Array<bool> Bound;
 
-	Array<VkWriteDescriptorSet> DescriptorBindings;
+	Array<VkImageView> ImageBindings;
 };
\ No newline at end of file
@@ -0,0 +1,470 @@
+#include "common_stl.h"
+#include "framegraph.h"
+#include "rendersystem.h"
+#include "rendertarget.h"
+#include "libcommon/hash.h"
+
+#include <algorithm>
+
+ResourceUsage FrameGraphVk::AccessToUsage(FrameGraphAccess access)
+{
+	switch (access)
+	{
+	case FrameGraphAccess::ColorAttachment: return ResourceUsage::ColorAttachment;
+	case FrameGraphAccess::DepthAttachment: return ResourceUsage::DepthAttachment;
+	case FrameGraphAccess::ComputeStorage: return ResourceUsage::ComputeStorage;
+	case FrameGraphAccess::GraphicsStorage: return ResourceUsage::GraphicsStorage;
+	case FrameGraphAccess::ShaderRead: return ResourceUsage::ShaderRead;
+	case FrameGraphAccess::TransferSrc: return ResourceUsage::TransferSrc;
+	case FrameGraphAccess::TransferDst: return ResourceUsage::TransferDst;
+	}
+
+	return ResourceUsage::Undefined;
+}
+
+void FrameGraphVk::Destroy()
+{
+	ReleaseCompiled(0);
+	FreeRetired(true);
+
+	CompiledHash = 0;
+}
+
+void FrameGraphVk::Reset()
+{
+	Resources.clear();
+	Passes.clear();
+	SetupPass = nullptr;
+}
+
+FrameGraphResource FrameGraphVk::ImportRenderTarget(const char* name, IRenderTarget* target)
+{
+	Resources.push_back({ name, ResourceKind::Imported, {}, target });
+	return (FrameGraphResource)Resources.size() - 1;
+}
+
+FrameGraphResource FrameGraphVk::ImportBackBuffer()
+{
+	Resources.push_back({ "BackBuffer", ResourceKind::BackBuffer, {}, nullptr });
+	return (FrameGraphResource)Resources.size() - 1;
+}
+
+void FrameGraphVk::AddPass(const char* name, FrameGraphSetupFunc setup, FrameGraphExecuteFunc execute)
+{
+	Passes.push_back({ name, {}, false, std::move(execute) });
+
+	SetupPass = &Passes.back();
+	setup(*this);
+	SetupPass = nullptr;
+}
+
+FrameGraphResource FrameGraphVk::CreateTexture(const char* name, const FrameGraphTextureDesc& desc)
+{
+	Resources.push_back({ name, ResourceKind::Transient, desc, nullptr });
+	return (FrameGraphResource)Resources.size() - 1;
+}
+
+void FrameGraphVk::Read(FrameGraphResource resource, FrameGraphAccess access)
+{
+	AddAccess(resource, access, false);
+}
+
+void FrameGraphVk::Write(FrameGraphResource resource, FrameGraphAccess access)
+{
+	AddAccess(resource, access, true);
+}
+
+void FrameGraphVk::SideEffect()
+{
+	if (SetupPass)
+		SetupPass->SideEffect = true;
+}
+
+void FrameGraphVk::AddAccess(FrameGraphResource resource, FrameGraphAccess access, bool write)
+{
+	if (!SetupPass || resource >= Resources.size())
+	{
+		assert(0);
+		return;
+	}
+
+	// A read-modify-write in the same way is one access, and one barrier
+	for (PassAccess& existing : SetupPass->Accesses)
+	{
+		if (existing.Resource == resource && existing.Access == access)
+		{
+			existing.Write |= write;
+			return;
+		}
+	}
+
+	SetupPass->Accesses.push_back({ resource, access, write });
+}
+
+IRenderTarget* FrameGraphVk::GetRenderTarget(FrameGraphResource resource)
+{
+	if (resource >= Resources.size())
+		return nullptr;
+
+	ResourceNode& node = Resources[resource];
+	if (node.Kind == ResourceKind::Transient)
+	{
+		int32_t index = TransientIndex[resource];
+		return index >= 0 ? Transients[index].Target : nullptr;
+	}
+
+	return node.Target;
+}
+
+VkImage FrameGraphVk::GetImage(FrameGraphResource resource)
+{
+	ResourceNode& node = Resources[resource];
+	if (node.Kind == ResourceKind::BackBuffer)
+		return rendersystem->GetBackBufferImage();
+
+	RenderTargetVk* target = static_cast<RenderTargetVk*>(GetRenderTarget(resource));
+	return target ? target->GetImage() : VK_NULL_HANDLE;
+}
+
+uint64_t FrameGraphVk::HashTopology()
+{
+	uint64_t hash = Hash::FNV_OFFSET_BASIS;
+
+	// Imported targets may change every frame without changing the topology.
+	// Field by field, the padding of the descriptions is never written.
+	for (ResourceNode& node : Resources)
+	{
+		hash = Hash::Combine(hash, (uint64_t)node.Kind);
+		if (node.Kind == ResourceKind::Transient)
+		{
+			hash = Hash::Combine(hash, (uint64_t)node.Desc.Format);
+			hash = Hash::Combine(hash, (uint64_t)node.Desc.Width);
+			hash = Hash::Combine(hash, (uint64_t)node.Desc.Height);
+		}
+	}
+
+	for (PassNode& pass : Passes)
+	{
+		hash = Hash::Fnv1a(pass.Name.data(), pass.Name.size(), hash);
+		hash = Hash::Combine(hash, pass.SideEffect);
+
+		for (PassAccess& access : pass.Accesses)
+		{
+			hash = Hash::Combine(hash, access.Resource);
+			hash = Hash::Combine(hash, (uint64_t)access.Access);
+			hash = Hash::Combine(hash, access.Write);
+		}
+	}
+
+	return hash;
+}
+
+bool FrameGraphVk::Execute()
+{
+	uint64_t hash = HashTopology();
+	if (hash != CompiledHash)
+	{
+		// the old transients may still be in use by frames in flight
+		ReleaseCompiled(rendersystem->GetCurrentFrame());
+
+		// Nothing is left compiled, so any topology compiles again next frame
+		if (!Compile())
+		{
+			ReleaseCompiled(rendersystem->GetCurrentFrame());
+			CompiledHash = 0;
+			return false;
+		}
+
+		CompiledHash = hash;
+		Stats.Compiles++;
+	}
+
+	FreeRetired(false);
+
+	ResourceStateTracker& tracker = rendersystem->GetStateTracker();
+
+	for (uint32_t position = 0; position < Schedule.size(); ++position)
+	{
+		PassNode& pass = Passes[Schedule[position]];
+
+		// Transients start out with undefined contents, after whatever shared their memory
+		for (TransientTexture& transient : Transients)
+		{
+			if (transient.FirstUse == position)
+				tracker.Discard(transient.Target->GetImage(), transient.AliasWaitStages, transient.AliasWaitAccess);
+		}
+
+		// Every transition the pass needs goes out in one barrier
+		for (PassAccess& access : pass.Accesses)
+			tracker.PrepareImage(GetImage(access.Resource), AccessToUsage(access.Access));
+
+		rendersystem->FlushBarriers();
+
+		rendersystem->BeginGpuScope(pass.Name.c_str());
+		pass.Execute(*this);
+		rendersystem->EndGpuScope();
+
+		tracker.EndPrepared();
+	}
+
+	return true;
+}
+
+bool FrameGraphVk::Compile()
+{
+	uint32_t resourceCount = (uint32_t)Resources.size();
+	uint32_t passCount = (uint32_t)Passes.size();
+
+	// Cull from the end, a pass lives if it writes something that is imported or read by a living pass
+	Array<bool> needed(resourceCount, false);
+	Array<bool> alive(passCount, false);
+
+	for (uint32_t i = 0; i < resourceCount; ++i)
+		needed[i] = Resources[i].Kind != ResourceKind::Transient;
+
+	for (int32_t i = (int32_t)passCount - 1; i >= 0; --i)
+	{
+		PassNode& pass = Passes[i];
+
+		bool keep = pass.SideEffect;
+		for (PassAccess& access : pass.Accesses)
+		{
+			if (access.Write && needed[access.Resource])
+				keep = true;
+		}
+
+		if (!keep)
+			continue;
+
+		alive[i] = true;
+
+		// writes count too, a partial write needs whatever was written before it
+		for (PassAccess& access : pass.Accesses)
+			needed[access.Resource] = true;
+	}
+
+	Schedule.clear();
+	for (uint32_t i = 0; i < passCount; ++i)
+	{
+		if (alive[i])
+			Schedule.push_back(i);
+	}
+
+	// Lifetimes of the transients that survived, in schedule positions
+	TransientIndex.assign(resourceCount, -1);
+	Transients.clear();
+
+	for (uint32_t position = 0; position < Schedule.size(); ++position)
+	{
+		for (PassAccess& access : Passes[Schedule[position]].Accesses)
+		{
+			if (Resources[access.Resource].Kind != ResourceKind::Transient)
+				continue;
+
+			int32_t& index = TransientIndex[access.Resource];
+			if (index < 0)
+			{
+				index = (int32_t)Transients.size();
+				Transients.push_back({});
+			}
+
+			TransientTexture& transient = Transients[index];
+			transient.FirstUse = std::min(transient.FirstUse, position);
+			transient.LastUse = std::max(transient.LastUse, position);
+		}
+	}
+
+	for (uint32_t i = 0; i < resourceCount; ++i)
+	{
+		if (TransientIndex[i] < 0)
+			continue;
+
+		FrameGraphTextureDesc& desc = Resources[i].Desc;
+
+		RenderTargetVk* target = new RenderTargetVk;
+		Transients[TransientIndex[i]].Target = target;
+
+		if (!target->CreateAliased(desc.Format, desc.Width, desc.Height))
+		{
+			// std::cout << "failed to create transient " << Resources[i].Name << "\n";
+			return false;
+		}
+
+		target->GetMemoryRequirements(Transients[TransientIndex[i]].Requirements);
+	}
+
+	if (!PlaceTransients())
+		return false;
+
+	// Anything sharing memory with a transient may have run before it, earlier this frame or in the last one
+	for (TransientTexture& transient : Transients)
+	{
+		for (uint32_t i = 0; i < resourceCount; ++i)
+		{
+			if (TransientIndex[i] < 0)
+				continue;
+
+			TransientTexture& other = Transients[TransientIndex[i]];
+			if (&other == &transient)
+				continue;
+
+			bool overlaps = other.Offset < transient.Offset + transient.Requirements.size &&
+				transient.Offset < other.Offset + other.Requirements.size;
+			if (!overlaps)
+				continue;
+
+			for (uint32_t position = other.FirstUse; position <= other.LastUse; ++position)
+			{
+				for (PassAccess& access : Passes[Schedule[position]].Accesses)
+				{
+					if (access.Resource != i)
+						continue;
+
+					ResourceStateTracker::UsageInfo usage = ResourceStateTracker::GetUsageInfo(AccessToUsage(access.Access));
+					transient.AliasWaitStages |= usage.Stage;
+
+					// Its writes have to be made available before the layout transition overwrites the memory
+					if (access.Write)
+						transient.AliasWaitAccess |= usage.Access;
+				}
+			}
+		}
+	}
+
+	Stats.Passes = (uint32_t)Schedule.size();
+	Stats.CulledPasses = passCount - Stats.Passes;
+	Stats.TransientTextures = (uint32_t)Transients.size();
+
+	return true;
+}
+
+bool FrameGraphVk::PlaceTransients()
+{
+	Stats.TransientBytes = 0;
+	Stats.RequestedBytes = 0;
+
+	if (Transients.empty())
+		return true;
+
+	// Largest first, each one goes to the lowest offset free for its whole lifetime
+	Array<TransientTexture*> order;
+	for (TransientTexture& transient : Transients)
+		order.push_back(&transient);
+
+	std::sort(order.begin(), order.end(), [](TransientTexture* a, TransientTexture* b) {
+		return a->Requirements.size > b->Requirements.size;
+	});
+
+	VkMemoryRequirements combined = {};
+	combined.memoryTypeBits = UINT32_MAX;
+	combined.alignment = 1;
+
+	Array<TransientTexture*> placed;
+	for (TransientTexture* transient : order)
+	{
+		VkMemoryRequirements& requirements = transient->Requirements;
+		combined.memoryTypeBits &= requirements.memoryTypeBits;
+		combined.alignment = std::max(combined.alignment, requirements.alignment);
+
+		// Candidates are the start of the heap and the end of every live neighbour
+		Array<VkDeviceSize> candidates = { 0 };
+		for (TransientTexture* other : placed)
+		{
+			if (other->FirstUse <= transient->LastUse && transient->FirstUse <= other->LastUse)
+				candidates.push_back(other->Offset + other->Requirements.size);
+		}
+
+		VkDeviceSize best = UINT64_MAX;
+		for (VkDeviceSize candidate : candidates)
+		{
+			VkDeviceSize offset = (candidate + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+
+			bool fits = true;
+			for (TransientTexture* other : placed)
+			{
+				bool lifetimeOverlap = other->FirstUse <= transient->LastUse && transient->FirstUse <= other->LastUse;
+				bool memoryOverlap = other->Offset < offset + requirements.size && offset < other->Offset + other->Requirements.size;
+
+				if (lifetimeOverlap && memoryOverlap)
+				{
+					fits = false;
+					break;
+				}
+			}
+
+			if (fits)
+				best = std::min(best, offset);
+		}
+
+		transient->Offset = best;
+		placed.push_back(transient);
+
+		combined.size = std::max(combined.size, best + requirements.size);
+		Stats.RequestedBytes += requirements.size;
+	}
+
+	if (combined.memoryTypeBits == 0)
+	{
+		// std::cout << "transient textures have no memory type in common\n";
+		return false;
+	}
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	if (vmaAllocateMemory(rendersystem->GetAllocator(), &combined, &allocInfo, &TransientMemory, nullptr) != VK_SUCCESS)
+		return false;
+
+	for (TransientTexture& transient : Transients)
+	{
+		if (!transient.Target->BindAliasedMemory(TransientMemory, transient.Offset))
+			return false;
+	}
+
+	Stats.TransientBytes = combined.size;
+	return true;
+}
+
+void FrameGraphVk::ReleaseCompiled(uint64_t frame)
+{
+	RetiredMemory retired = { frame, TransientMemory, {} };
+	for (TransientTexture& transient : Transients)
+		retired.Targets.push_back(transient.Target);
+
+	if (retired.Memory != VK_NULL_HANDLE || !retired.Targets.empty())
+		Retired.push_back(std::move(retired));
+
+	TransientMemory = VK_NULL_HANDLE;
+	Transients.clear();
+	TransientIndex.clear();
+	Schedule.clear();
+}
+
+void FrameGraphVk::FreeRetired(bool all)
+{
+	uint64_t completed = all ? UINT64_MAX : rendersystem->GetCompletedFrame();
+
+	for (auto iter = Retired.begin(); iter != Retired.end();)
+	{
+		if (iter->Frame > completed)
+		{
+			++iter;
+			continue;
+		}
+
+		for (RenderTargetVk* target : iter->Targets)
+		{
+			if (!target)
+				continue;
+
+			target->Destroy();
+			delete target;
+		}
+
+		if (iter->Memory != VK_NULL_HANDLE)
+			vmaFreeMemory(rendersystem->GetAllocator(), iter->Memory);
+
+		iter = Retired.erase(iter);
+	}
+}
\ No newline at end of file
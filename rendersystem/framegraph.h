@@ -0,0 +1,118 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/iframegraph.h"
+#include "vulkan_common.h"
+#include "resourcestate.h"
+
+#include "vk_mem_alloc.h"
+
+class RenderTargetVk;
+
+// Passes and resources are declared again every frame, but only a change of the topology hash
+// recompiles the schedule and the transient memory. Transients share one VMA allocation,
+// textures whose lifetimes never overlap are placed at the same offsets.
+class FrameGraphVk : public IFrameGraph, public IFrameGraphBuilder, public IFrameGraphResources
+{
+public:
+
+	void Destroy();
+
+	// IFrameGraph
+	virtual void Reset();
+	virtual FrameGraphResource ImportRenderTarget(const char* name, IRenderTarget* target);
+	virtual FrameGraphResource ImportBackBuffer();
+	virtual void AddPass(const char* name, FrameGraphSetupFunc setup, FrameGraphExecuteFunc execute);
+	virtual bool Execute();
+	virtual FrameGraphStats GetStats() { return Stats; }
+
+	// IFrameGraphBuilder
+	virtual FrameGraphResource CreateTexture(const char* name, const FrameGraphTextureDesc& desc);
+	virtual void Read(FrameGraphResource resource, FrameGraphAccess access);
+	virtual void Write(FrameGraphResource resource, FrameGraphAccess access);
+	virtual void SideEffect();
+
+	// IFrameGraphResources
+	virtual IRenderTarget* GetRenderTarget(FrameGraphResource resource);
+
+	static ResourceUsage AccessToUsage(FrameGraphAccess access);
+
+private:
+
+	enum class ResourceKind : unsigned char
+	{
+		Transient = 0,
+		Imported,
+		BackBuffer,
+	};
+
+	struct ResourceNode
+	{
+		String Name;
+		ResourceKind Kind;
+		FrameGraphTextureDesc Desc;
+		IRenderTarget* Target;
+	};
+
+	struct PassAccess
+	{
+		FrameGraphResource Resource;
+		FrameGraphAccess Access;
+		bool Write;
+	};
+
+	struct PassNode
+	{
+		String Name;
+		Array<PassAccess> Accesses;
+		bool SideEffect;
+		FrameGraphExecuteFunc Execute;
+	};
+
+	// Compiled placement of a transient texture
+	struct TransientTexture
+	{
+		RenderTargetVk* Target = nullptr;
+
+		// First and last position in the schedule
+		uint32_t FirstUse = UINT32_MAX;
+		uint32_t LastUse = 0;
+
+		VkMemoryRequirements Requirements = {};
+		VkDeviceSize Offset = 0;
+
+		// Stages of every texture sharing its memory and what they write, the first write waits for them
+		VkPipelineStageFlags2 AliasWaitStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 AliasWaitAccess = VK_ACCESS_2_NONE;
+	};
+
+	// Memory of an old compile, kept until the frames that used it are done
+	struct RetiredMemory
+	{
+		uint64_t Frame;
+		VmaAllocation Memory;
+		Array<RenderTargetVk*> Targets;
+	};
+
+	uint64_t HashTopology();
+	bool Compile();
+	bool PlaceTransients();
+	void ReleaseCompiled(uint64_t frame);
+	void FreeRetired(bool all);
+
+	void AddAccess(FrameGraphResource resource, FrameGraphAccess access, bool write);
+	VkImage GetImage(FrameGraphResource resource);
+
+	Array<ResourceNode> Resources;
+	Array<PassNode> Passes;
+	PassNode* SetupPass = nullptr;
+
+	uint64_t CompiledHash = 0;
+	Array<uint32_t> Schedule;
+	Array<int32_t> TransientIndex; // per resource, -1 if not a live transient
+	Array<TransientTexture> Transients;
+	VmaAllocation TransientMemory = VK_NULL_HANDLE;
+
+	Array<RetiredMemory> Retired;
+
+	FrameGraphStats Stats = {};
+};
\ No newline at end of file
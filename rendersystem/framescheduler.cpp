@@ -0,0 +1,165 @@
+#include "common_stl.h"
+#include "framescheduler.h"
+#include "rendersystem.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
+
+bool FrameSchedulerVk::Init(VkCommandPool pool, uint32_t framesInFlight)
+{
+	VkDevice device = rendersystem->GetDevice();
+
+	CommandPool = pool;
+
+	VkSemaphoreTypeCreateInfo timelineInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo timelineSemaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	timelineSemaphoreInfo.pNext = &timelineInfo;
+
+	if (vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &Timeline) != VK_SUCCESS)
+		return false;
+
+	VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+	Array<VkCommandBuffer> commandBuffers(MAX_FRAMES_IN_FLIGHT);
+
+	VkCommandBufferAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	allocInfo.commandPool = pool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		return false;
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		FrameSlot& slot = Slots[i];
+		slot.CommandBuffer = commandBuffers[i];
+		slot.CommandBuffers = { commandBuffers[i] };
+		slot.CommandBufferIndex = 0;
+		slot.SubmittedValue = 0;
+
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &slot.SwapSemaphore) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &slot.RenderSemaphore) != VK_SUCCESS)
+		{
+			return false;
+		}
+	}
+
+	FramesInFlight = std::clamp<uint32_t>(framesInFlight, 1, MAX_FRAMES_IN_FLIGHT);
+	SlotIndex = 0;
+	FrameValue = 0;
+
+	return true;
+}
+
+void FrameSchedulerVk::Destroy()
+{
+	VkDevice device = rendersystem->GetDevice();
+
+	for (FrameSlot& slot : Slots)
+	{
+		vkDestroySemaphore(device, slot.SwapSemaphore, nullptr);
+		vkDestroySemaphore(device, slot.RenderSemaphore, nullptr);
+	}
+
+	vkDestroySemaphore(device, Timeline, nullptr);
+}
+
+void FrameSchedulerVk::SetFramesInFlight(uint32_t count)
+{
+	// The open frame would end on a slot that isn't the one it began on
+	assert(!FrameOpen);
+
+	count = std::clamp<uint32_t>(count, 1, MAX_FRAMES_IN_FLIGHT);
+	if (count == FramesInFlight)
+		return;
+
+	// Every slot has to be idle before the ring can be reshaped
+	for (FrameSlot& slot : Slots)
+		WaitForFrame(slot.SubmittedValue);
+
+	FramesInFlight = count;
+	SlotIndex = 0;
+}
+
+FrameSchedulerVk::FrameSlot& FrameSchedulerVk::BeginFrame()
+{
+	FrameSlot& slot = Slots[SlotIndex];
+
+	// Only the frame that last used this slot has to be finished, newer frames keep running
+	{
+		TRACE_SCOPE("WaitForFrameSlot");
+		WaitForFrame(slot.SubmittedValue);
+	}
+
+	FrameValue++;
+	FrameOpen = true;
+
+	slot.CommandBufferIndex = 0;
+	slot.CommandBuffer = slot.CommandBuffers[0];
+
+	return slot;
+}
+
+VkCommandBuffer FrameSchedulerVk::NextCommandBuffer()
+{
+	FrameSlot& slot = Slots[SlotIndex];
+
+	// Buffers are kept for the next frames that split as often
+	if (slot.CommandBufferIndex + 1 == slot.CommandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocInfo.commandPool = CommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer cmd;
+		if (vkAllocateCommandBuffers(rendersystem->GetDevice(), &allocInfo, &cmd) != VK_SUCCESS)
+			return VK_NULL_HANDLE;
+
+		slot.CommandBuffers.push_back(cmd);
+	}
+
+	slot.CommandBuffer = slot.CommandBuffers[++slot.CommandBufferIndex];
+	return slot.CommandBuffer;
+}
+
+VkSemaphoreSubmitInfo FrameSchedulerVk::SubmitFrame(VkPipelineStageFlags2 stageMask)
+{
+	Slots[SlotIndex].SubmittedValue = FrameValue;
+
+	VkSemaphoreSubmitInfo signalInfo = RenderUtils::semaphore_submit_info(stageMask, Timeline);
+	signalInfo.value = FrameValue;
+
+	return signalInfo;
+}
+
+void FrameSchedulerVk::EndFrame()
+{
+	SlotIndex = (SlotIndex + 1) % FramesInFlight;
+	FrameOpen = false;
+}
+
+uint64_t FrameSchedulerVk::GetCompletedFrame()
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(rendersystem->GetDevice(), Timeline, &value);
+
+	return value;
+}
+
+bool FrameSchedulerVk::WaitForFrame(uint64_t frame, uint64_t timeout)
+{
+	if (frame == 0)
+		return true;
+
+	VkSemaphoreWaitInfo waitInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &Timeline;
+	waitInfo.pValues = &frame;
+
+	return vkWaitSemaphores(rendersystem->GetDevice(), &waitInfo, timeout) == VK_SUCCESS;
+}
\ No newline at end of file
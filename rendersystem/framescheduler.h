@@ -0,0 +1,79 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+
+// Paces frames with a single timeline semaphore.
+// Each submitted frame signals its own frame number, so a frame slot can be recorded
+// again as soon as the GPU has reached the value the slot was last submitted with.
+class FrameSchedulerVk
+{
+public:
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+	struct FrameSlot
+	{
+		// Buffer being recorded. A frame split into several submissions records into the next one of the slot.
+		VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+		Array<VkCommandBuffer> CommandBuffers;
+		uint32_t CommandBufferIndex = 0;
+
+		// The swapchain still needs binary semaphores for acquire and present
+		VkSemaphore SwapSemaphore = VK_NULL_HANDLE;
+		VkSemaphore RenderSemaphore = VK_NULL_HANDLE;
+
+		// Timeline value of the last frame submitted from this slot
+		uint64_t SubmittedValue = 0;
+	};
+
+	bool Init(VkCommandPool pool, uint32_t framesInFlight);
+	void Destroy();
+
+	// Waits for all submitted frames, then changes how many frames may be recorded ahead.
+	// Clamped to [1, MAX_FRAMES_IN_FLIGHT]. Only between frames, the ring starts over at slot 0.
+	void SetFramesInFlight(uint32_t count);
+	uint32_t GetFramesInFlight() const { return FramesInFlight; }
+
+	// Waits until the next slot is free and starts a new frame number
+	FrameSlot& BeginFrame();
+
+	// Signal info for the frame submission, marks the slot as in flight
+	VkSemaphoreSubmitInfo SubmitFrame(VkPipelineStageFlags2 stageMask);
+
+	// Continue the frame in another command buffer of the slot, e.g. to submit the part recorded so far on its own
+	VkCommandBuffer NextCommandBuffer();
+
+	// Move on to the next slot, call after the frame has been submitted
+	void EndFrame();
+
+	// Between BeginFrame and EndFrame
+	bool IsFrameOpen() const { return FrameOpen; }
+
+	FrameSlot& GetCurrentSlot() { return Slots[SlotIndex]; }
+	uint32_t GetSlotIndex() const { return SlotIndex; }
+
+	// Frame number being recorded, frames are numbered from 1
+	uint64_t GetCurrentFrame() const { return FrameValue; }
+
+	// Latest frame number the GPU has finished
+	uint64_t GetCompletedFrame();
+
+	// Blocks until the GPU has finished the given frame, false on timeout
+	bool WaitForFrame(uint64_t frame, uint64_t timeout = UINT64_MAX);
+
+	VkSemaphore GetTimeline() const { return Timeline; }
+
+private:
+
+	VkSemaphore Timeline = VK_NULL_HANDLE;
+	VkCommandPool CommandPool = VK_NULL_HANDLE;
+
+	// Always sized for MAX_FRAMES_IN_FLIGHT so the depth can change without reallocating
+	ConstArray<FrameSlot, MAX_FRAMES_IN_FLIGHT> Slots;
+
+	uint32_t FramesInFlight = 2;
+	uint32_t SlotIndex = 0;
+	bool FrameOpen = false;
+
+	// Last frame number handed out by BeginFrame
+	uint64_t FrameValue = 0;
+};
\ No newline at end of file
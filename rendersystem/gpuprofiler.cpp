@@ -0,0 +1,208 @@
+#include "common_stl.h"
+#include "gpuprofiler.h"
+#include "rendersystem.h"
+#include "libcommon/trace.h"
+
+#include <fstream>
+
+bool GpuProfilerVk::Init(VkDevice device, float timestampPeriod, uint32_t timestampValidBits)
+{
+	Device = device;
+	TimestampPeriod = timestampPeriod;
+
+	// queue family can't write timestamps at all
+	if (timestampValidBits == 0)
+		return false;
+
+	TimestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+
+	VkQueryPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = MAX_SCOPES_PER_FRAME * 2;
+
+	for (SlotQueries& slot : Slots)
+	{
+		if (vkCreateQueryPool(Device, &poolInfo, nullptr, &slot.Pool) != VK_SUCCESS)
+			return false;
+
+		slot.Scopes.reserve(MAX_SCOPES_PER_FRAME);
+	}
+
+	// Only present when the debug utils extension is enabled, labels are skipped otherwise
+	CmdBeginDebugLabel = (PFN_vkCmdBeginDebugUtilsLabelEXT)vkGetDeviceProcAddr(Device, "vkCmdBeginDebugUtilsLabelEXT");
+	CmdEndDebugLabel = (PFN_vkCmdEndDebugUtilsLabelEXT)vkGetDeviceProcAddr(Device, "vkCmdEndDebugUtilsLabelEXT");
+
+	Enabled = true;
+	return true;
+}
+
+void GpuProfilerVk::Destroy()
+{
+	for (SlotQueries& slot : Slots)
+	{
+		if (slot.Pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(Device, slot.Pool, nullptr);
+
+		slot.Pool = VK_NULL_HANDLE;
+	}
+
+	Enabled = false;
+}
+
+void GpuProfilerVk::BeginFrame(VkCommandBuffer cmd, uint32_t slotIndex, uint64_t frameNumber)
+{
+	if (!Enabled)
+		return;
+
+	ResolveSlot(slotIndex);
+
+	CurrentSlot = slotIndex;
+
+	SlotQueries& slot = Slots[slotIndex];
+	slot.Scopes.clear();
+	slot.FrameNumber = frameNumber;
+
+	ScopeStack.clear();
+
+	vkCmdResetQueryPool(cmd, slot.Pool, 0, MAX_SCOPES_PER_FRAME * 2);
+}
+
+void GpuProfilerVk::EndFrame(VkCommandBuffer cmd)
+{
+	while (!ScopeStack.empty())
+		EndScope(cmd);
+}
+
+void GpuProfilerVk::BeginScope(VkCommandBuffer cmd, const char* name)
+{
+	if (!Enabled)
+		return;
+
+	if (CmdBeginDebugLabel)
+	{
+		VkDebugUtilsLabelEXT label = { .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT };
+		label.pLabelName = name;
+		CmdBeginDebugLabel(cmd, &label);
+	}
+
+	SlotQueries& slot = Slots[CurrentSlot];
+
+	// Out of queries, keep the stack balanced but stop measuring
+	if (slot.Scopes.size() >= MAX_SCOPES_PER_FRAME)
+	{
+		ScopeStack.push_back(UINT32_MAX);
+		return;
+	}
+
+	ScopeRecord record = {};
+	record.Name = InternName(name);
+	record.Depth = (uint32_t)ScopeStack.size();
+	record.BeginQuery = (uint32_t)slot.Scopes.size() * 2;
+
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, slot.Pool, record.BeginQuery);
+
+	ScopeStack.push_back((uint32_t)slot.Scopes.size());
+	slot.Scopes.push_back(record);
+}
+
+void GpuProfilerVk::EndScope(VkCommandBuffer cmd)
+{
+	if (!Enabled || ScopeStack.empty())
+		return;
+
+	uint32_t scopeIdx = ScopeStack.back();
+	ScopeStack.pop_back();
+
+	if (scopeIdx != UINT32_MAX)
+	{
+		SlotQueries& slot = Slots[CurrentSlot];
+		vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, slot.Pool, slot.Scopes[scopeIdx].BeginQuery + 1);
+	}
+
+	if (CmdEndDebugLabel)
+		CmdEndDebugLabel(cmd);
+}
+
+void GpuProfilerVk::ResolveSlot(uint32_t slotIndex)
+{
+	SlotQueries& slot = Slots[slotIndex];
+	if (slot.Scopes.empty())
+		return;
+
+	uint32_t queryCount = (uint32_t)slot.Scopes.size() * 2;
+
+	// Pairs of timestamp and availability
+	Array<uint64_t> results(queryCount * 2);
+
+	VkResult res = vkGetQueryPoolResults(Device, slot.Pool, 0, queryCount, results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t) * 2,
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	if (res != VK_SUCCESS && res != VK_NOT_READY)
+		return;
+
+	ResolvedTimings.clear();
+	ResolvedFrame = slot.FrameNumber;
+
+	uint64_t frameStart = results[0] & TimestampMask;
+
+	for (const ScopeRecord& scope : slot.Scopes)
+	{
+		uint64_t* begin = &results[scope.BeginQuery * 2];
+		uint64_t* end = &results[(scope.BeginQuery + 1) * 2];
+
+		// availability, never block on a missing result
+		if (begin[1] == 0 || end[1] == 0)
+			continue;
+
+		uint64_t beginTicks = begin[0] & TimestampMask;
+		uint64_t endTicks = end[0] & TimestampMask;
+
+		GpuScopeTiming timing = {};
+		timing.Name = scope.Name;
+		timing.Depth = scope.Depth;
+		timing.StartMs = (double)(beginTicks - frameStart) * TimestampPeriod / 1000000.0;
+		timing.DurationMs = (double)(endTicks - beginTicks) * TimestampPeriod / 1000000.0;
+		ResolvedTimings.push_back(timing);
+
+		History.push_back({ scope.Name, scope.Depth, slot.FrameNumber, beginTicks, endTicks });
+	}
+
+	// History is trimmed by whole frames
+	while (!History.empty() && History.front().Frame + MAX_HISTORY_FRAMES <= slot.FrameNumber)
+		History.pop_front();
+}
+
+const char* GpuProfilerVk::InternName(const char* name)
+{
+	auto iter = InternedNames.try_emplace(name, 0).first;
+	return iter->first.c_str();
+}
+
+bool GpuProfilerVk::WriteChromeTrace(const char* filepath)
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+
+	uint64_t origin = History.empty() ? 0 : History.front().BeginTicks;
+
+	file << std::fixed;
+	file.precision(3);
+
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+
+	for (const HistoryEntry& entry : History)
+	{
+		double startUs = (double)(entry.BeginTicks - origin) * TimestampPeriod / 1000.0;
+		double durationUs = (double)(entry.EndTicks - entry.BeginTicks) * TimestampPeriod / 1000.0;
+
+		file << ",\n{\"name\":\"" << Trace::EscapeJson(entry.Name) << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+			<< ",\"ts\":" << startUs << ",\"dur\":" << durationUs
+			<< ",\"args\":{\"frame\":" << entry.Frame << ",\"depth\":" << entry.Depth << "}}";
+	}
+
+	file << "\n]}\n";
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/rendersystem_types.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+// Timestamp queries around named, nested scopes.
+// Every frame slot owns a query pool, results are read back when the slot comes around again.
+// By then the frame scheduler has already waited for that frame, so reading never stalls.
+class GpuProfilerVk
+{
+public:
+	static constexpr uint32_t MAX_SCOPES_PER_FRAME = 256;
+
+	// Frames of scope history kept for trace dumps
+	static constexpr uint32_t MAX_HISTORY_FRAMES = 600;
+
+	bool Init(VkDevice device, float timestampPeriod, uint32_t timestampValidBits);
+	void Destroy();
+
+	bool IsEnabled() const { return Enabled; }
+
+	// Resolve the frame that last used this slot, then reset the slot's queries
+	void BeginFrame(VkCommandBuffer cmd, uint32_t slotIndex, uint64_t frameNumber);
+
+	// Closes any scope left open, so every query of the frame gets written
+	void EndFrame(VkCommandBuffer cmd);
+
+	void BeginScope(VkCommandBuffer cmd, const char* name);
+	void EndScope(VkCommandBuffer cmd);
+
+	// Timings of the latest resolved frame
+	const Array<GpuScopeTiming>& GetResolvedTimings() const { return ResolvedTimings; }
+	uint64_t GetResolvedFrame() const { return ResolvedFrame; }
+
+	// Chrome trace event JSON of the recorded history
+	bool WriteChromeTrace(const char* filepath);
+
+private:
+
+	void ResolveSlot(uint32_t slotIndex);
+	const char* InternName(const char* name);
+
+	struct ScopeRecord
+	{
+		const char* Name;
+		uint32_t Depth;
+		uint32_t BeginQuery;
+	};
+
+	struct SlotQueries
+	{
+		VkQueryPool Pool = VK_NULL_HANDLE;
+		Array<ScopeRecord> Scopes;
+		uint64_t FrameNumber = 0;
+	};
+
+	struct HistoryEntry
+	{
+		const char* Name;
+		uint32_t Depth;
+		uint64_t Frame;
+		uint64_t BeginTicks;
+		uint64_t EndTicks;
+	};
+
+	bool Enabled = false;
+
+	VkDevice Device = VK_NULL_HANDLE;
+	float TimestampPeriod = 1.0f; // nanoseconds per tick
+	uint64_t TimestampMask = ~0ull;
+
+	PFN_vkCmdBeginDebugUtilsLabelEXT CmdBeginDebugLabel = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT CmdEndDebugLabel = nullptr;
+
+	ConstArray<SlotQueries, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT> Slots;
+	uint32_t CurrentSlot = 0;
+
+	// Indices into the current slot's scopes
+	Array<uint32_t> ScopeStack;
+
+	Array<GpuScopeTiming> ResolvedTimings;
+	uint64_t ResolvedFrame = 0;
+
+	Queue<HistoryEntry> History;
+
+	// Node based, so the interned pointers stay valid
+	Dict<String, int> InternedNames;
+};
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "common_stl.h"
+#include "pipelinecache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+bool PipelineCacheVk::Init(VkDevice device, const VkPhysicalDeviceProperties& properties, const char* filepath)
+{
+	Filepath = filepath;
+
+	Array<char> data;
+
+	std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+	if (file.is_open())
+	{
+		data.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		file.close();
+	}
+
+	// A stale cache is no worse than none, the driver would reject it anyway or, worse, trust it
+	Loaded = !data.empty() && IsValid(data, properties);
+	if (!Loaded)
+		data.clear();
+
+	VkPipelineCacheCreateInfo cacheInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &Cache) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create pipeline cache\n";
+		Cache = VK_NULL_HANDLE;
+		Loaded = false;
+		return false;
+	}
+
+	return true;
+}
+
+void PipelineCacheVk::Destroy(VkDevice device)
+{
+	if (Cache == VK_NULL_HANDLE)
+		return;
+
+	Save(device);
+
+	vkDestroyPipelineCache(device, Cache, nullptr);
+	Cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCacheVk::IsValid(const Array<char>& data, const VkPhysicalDeviceProperties& properties) const
+{
+	VkPipelineCacheHeaderVersionOne header;
+	if (data.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, data.data(), sizeof(header));
+
+	return header.headerSize >= sizeof(header) &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == properties.vendorID &&
+		header.deviceID == properties.deviceID &&
+		memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCacheVk::Save(VkDevice device)
+{
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, Cache, &size, nullptr) != VK_SUCCESS || size == 0)
+		return false;
+
+	Array<char> data(size);
+	if (vkGetPipelineCacheData(device, Cache, &size, data.data()) != VK_SUCCESS)
+		return false;
+
+	// Written next to the old file first, a crash while saving never leaves a truncated cache behind
+	String tempPath = Filepath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file.write(data.data(), size);
+		if (!file.good())
+			return false;
+	}
+
+	std::remove(Filepath.c_str());
+	return std::rename(tempPath.c_str(), Filepath.c_str()) == 0;
+}
+
+void PipelineCacheVk::BeginFeedback(Feedback& feedback, const void* next)
+{
+	feedback.Pipeline = {};
+	feedback.Info = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO };
+	feedback.Info.pNext = next;
+	feedback.Info.pPipelineCreationFeedback = &feedback.Pipeline;
+	feedback.Start = std::chrono::steady_clock::now();
+}
+
+void PipelineCacheVk::Record(const Feedback& feedback)
+{
+	auto elapsed = std::chrono::steady_clock::now() - feedback.Start;
+	CreationMicroseconds += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+	Pipelines++;
+
+	// Drivers are free to leave the feedback invalid, those count as misses
+	const VkPipelineCreationFeedbackFlags hit = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT | VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+	if ((feedback.Pipeline.flags & hit) == hit)
+		CacheHits++;
+}
+
+PipelineCacheStats PipelineCacheVk::GetStats() const
+{
+	PipelineCacheStats stats = {};
+	stats.LoadedFromDisk = Loaded;
+	stats.Pipelines = Pipelines;
+	stats.CacheHits = CacheHits;
+	stats.CreationMs = (double)CreationMicroseconds / 1000.0;
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/rendersystem_types.h"
+#include "vulkan_common.h"
+
+#include <atomic>
+#include <chrono>
+
+// Device wide VkPipelineCache that survives between runs.
+// Loaded from disk when the device is created and written back on shutdown. A file made by another
+// driver, GPU or cache version is ignored and overwritten. Pipelines are created with creation feedback,
+// so the share of pipelines the driver found in the cache is known after startup.
+class PipelineCacheVk
+{
+public:
+
+	bool Init(VkDevice device, const VkPhysicalDeviceProperties& properties, const char* filepath);
+
+	// Writes the cache to disk, then destroys it
+	void Destroy(VkDevice device);
+
+	VkPipelineCache GetCache() const { return Cache; }
+
+	// Chain into a pipeline create info, then hand it back to Record once the pipeline was created.
+	// Thread safe, every creation has its own feedback.
+	struct Feedback
+	{
+		VkPipelineCreationFeedback Pipeline = {};
+		VkPipelineCreationFeedbackCreateInfo Info = { .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO };
+		std::chrono::steady_clock::time_point Start;
+	};
+	void BeginFeedback(Feedback& feedback, const void* next);
+	void Record(const Feedback& feedback);
+
+	PipelineCacheStats GetStats() const;
+
+private:
+
+	bool IsValid(const Array<char>& data, const VkPhysicalDeviceProperties& properties) const;
+	bool Save(VkDevice device);
+
+	VkPipelineCache Cache = VK_NULL_HANDLE;
+	String Filepath;
+	bool Loaded = false;
+
+	std::atomic<uint32_t> Pipelines = 0;
+	std::atomic<uint32_t> CacheHits = 0;
+	std::atomic<uint64_t> CreationMicroseconds = 0;
+};
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "common_stl.h"
+#include "pipelinecompiler.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
+
+bool PipelineCompilerVk::Init(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	Stopping = false;
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+		Workers.emplace_back(&PipelineCompilerVk::WorkerMain, this);
+
+	return true;
+}
+
+void PipelineCompilerVk::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(JobsMutex);
+		Stopping = true;
+	}
+	JobsAvailable.notify_all();
+
+	for (std::thread& worker : Workers)
+		worker.join();
+
+	Workers.clear();
+}
+
+void PipelineCompilerVk::Submit(std::function<void()>&& job)
+{
+	// Nothing to run it on, build right away
+	if (Workers.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(JobsMutex);
+		Jobs.push_back(std::move(job));
+		PendingJobs++;
+	}
+	JobsAvailable.notify_one();
+}
+
+void PipelineCompilerVk::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(JobsMutex);
+	JobsDone.wait(lock, [&] { return PendingJobs == 0; });
+}
+
+void PipelineCompilerVk::WorkerMain()
+{
+	Trace::SetThreadName("PipelineCompiler");
+
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(JobsMutex);
+			JobsAvailable.wait(lock, [&] { return Stopping || !Jobs.empty(); });
+
+			// Queued jobs still run when stopping, shaders waiting on them get destroyed right after
+			if (Jobs.empty())
+				return;
+
+			job = std::move(Jobs.front());
+			Jobs.pop_front();
+		}
+
+		{
+			TRACE_SCOPE("CompilePipeline");
+			job();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(JobsMutex);
+			PendingJobs--;
+		}
+		JobsDone.notify_all();
+	}
+}
\ No newline at end of file
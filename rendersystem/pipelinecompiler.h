@@ -0,0 +1,43 @@
+#pragma once
+#include "common_stl.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Worker threads that build pipelines in the background.
+// Drivers compile shaders while creating a pipeline, which is by far the slowest part of loading a shader.
+// Pipeline creation is thread safe and the pipeline cache synchronizes itself, so every core can compile
+// one pipeline at a time. Jobs run in submission order, Destroy finishes the queued ones first.
+class PipelineCompilerVk
+{
+public:
+
+	// 0 threads picks one per core, minus the main thread
+	bool Init(uint32_t threadCount = 0);
+	void Destroy();
+
+	// Thread safe
+	void Submit(std::function<void()>&& job);
+
+	// Blocks until every submitted job has finished
+	void WaitIdle();
+
+	uint32_t GetThreadCount() const { return (uint32_t)Workers.size(); }
+
+private:
+
+	void WorkerMain();
+
+	Array<std::thread> Workers;
+
+	std::mutex JobsMutex;
+	std::condition_variable JobsAvailable;
+	std::condition_variable JobsDone;
+	Queue<std::function<void()>> Jobs;
+
+	// Queued plus running
+	uint32_t PendingJobs = 0;
+	bool Stopping = false;
+};
\ No newline at end of file
@@ -3,8 +3,65 @@ set(LIBNAME rendersystem)
 set(src_dir ${PROJECT_ROOT_PATH}/rendersystem)
 set(public_dir ${PROJECT_ROOT_PATH}/public/rendersystem)
 
-set(sources ${src_dir}/rendersystem.cpp ${src_dir}/utils.cpp ${src_dir}/shader.cpp ${src_dir}/rendertarget.cpp ${src_dir}/descriptorsets.cpp)
-set(headers ${src_dir}/rendersystem.h ${src_dir}/utils.h ${src_dir}/shader.h ${src_dir}/rendertarget.h ${src_dir}/descriptorsets.h ${src_dir}/vulkan_common.h ${public_dir}/irendersystem.h ${public_dir}/ishader.h ${public_dir}/rendersystem_types.h)
+set(sources 
+    ${src_dir}/rendersystem.cpp
+    ${src_dir}/utils.cpp
+    ${src_dir}/shader.cpp
+    ${src_dir}/rendertarget.cpp
+    ${src_dir}/descriptorsets.cpp
+    ${src_dir}/framescheduler.cpp
+    ${src_dir}/gpuprofiler.cpp
+    ${src_dir}/commandcontext.cpp
+    ${src_dir}/resourcestate.cpp
+    ${src_dir}/framegraph.cpp
+    ${src_dir}/buffer.cpp
+    ${src_dir}/uploadengine.cpp
+    ${src_dir}/asynccompute.cpp
+    ${src_dir}/constantallocator.cpp
+    ${src_dir}/pipelinecache.cpp
+    ${src_dir}/pipelinecompiler.cpp
+    ${src_dir}/shadermodulecache.cpp
+    ${src_dir}/shaderarchive.cpp
+    ${src_dir}/shaderwatcher.cpp
+    ${src_dir}/workgrouptuner.cpp
+    ${src_dir}/bindlessheap.cpp
+    ${src_dir}/descriptorallocator.cpp
+    ${src_dir}/descriptorbuffer.cpp
+    ${src_dir}/rendertargetpool.cpp
+)
+set(headers 
+    ${src_dir}/rendersystem.h
+    ${src_dir}/utils.h
+    ${src_dir}/shader.h
+    ${src_dir}/rendertarget.h
+    ${src_dir}/descriptorsets.h
+    ${src_dir}/framescheduler.h
+    ${src_dir}/gpuprofiler.h
+    ${src_dir}/commandcontext.h
+    ${src_dir}/resourcestate.h
+    ${src_dir}/framegraph.h
+    ${src_dir}/buffer.h
+    ${src_dir}/uploadengine.h
+    ${src_dir}/asynccompute.h
+    ${src_dir}/constantallocator.h
+    ${src_dir}/pipelinecache.h
+    ${src_dir}/pipelinecompiler.h
+    ${src_dir}/shadermodulecache.h
+    ${src_dir}/shaderarchive.h
+    ${src_dir}/shaderwatcher.h
+    ${src_dir}/workgrouptuner.h
+    ${src_dir}/bindlessheap.h
+    ${src_dir}/descriptorallocator.h
+    ${src_dir}/descriptorbuffer.h
+    ${src_dir}/rendertargetpool.h
+    ${src_dir}/vulkan_common.h
+    ${public_dir}/irendersystem.h
+    ${public_dir}/ishader.h
+    ${public_dir}/icommandcontext.h
+    ${public_dir}/iframegraph.h
+    ${public_dir}/rendersystem_types.h
+    ${public_dir}/shaderpack_format.h
+)
 
 add_library(${LIBNAME} SHARED ${sources} ${headers} )
 
@@ -2,10 +2,14 @@
 #include "rendertarget.h"
 #include "shader.h"
 #include "descriptorsets.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
 
 Modules::DeclareModule<RenderSystemVulkan> rendersystem;
 
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Everything that may write the swapchain image: draws and the render target blit
+static constexpr VkPipelineStageFlags2 SWAPCHAIN_WAIT_STAGES = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
 
 ReleaseFuncQueue ReleaseQueue;
 
@@ -18,6 +22,11 @@ bool RenderSystemVulkan::Create()
                         .require_api_version(1, 3, 0)
                         .build();
     if (!inst_ret)
+    {
+        // Machines without a window system expose no surface extensions, that still leaves headless rendering
+        inst_ret = builder.set_headless(true).build();
+    }
+    if (!inst_ret)
     {
         // std::cerr << "Failed to create Vulkan instance. Error: " << inst_ret.error().message() << "\n";
         return false;
@@ -51,74 +60,37 @@ void RenderSystemVulkan::AttachWindow(void *window_handle, int width, int height
     }
 #endif
 
-    //vulkan 1.3 features
-    VkPhysicalDeviceVulkan13Features features13{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
-    features13.dynamicRendering = true;
-    features13.synchronization2 = true;
-
-    //vulkan 1.2 features
-    VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
-    features12.bufferDeviceAddress = true;
-    features12.descriptorIndexing = true;
-
-    vkb::PhysicalDeviceSelector selector{VulkanInstance};
-    auto phys_ret = selector.set_surface(CurrentWindow.vkSurface)
-                        .set_minimum_version(1, 3)
-                        .set_required_features_13(features13)
-                        .set_required_features_12(features12)
-                        .require_dedicated_transfer_queue()
-                        .select();
-    if (!phys_ret)
-    {
-        // std::cerr << "Failed to select Vulkan Physical Device. Error: " << phys_ret.error().message() << "\n";
-        return;
-    }
-
-    Device.Physical = phys_ret.value();
-
-    vkb::DeviceBuilder device_builder{Device.Physical};
-    // automatically propagate needed data from instance & physical device
-    auto dev_ret = device_builder.build();
-    if (!dev_ret)
-    {
-        // std::cerr << "Failed to create Vulkan device. Error: " << dev_ret.error().message() << "\n";
+    if (!CreateDevice())
         return;
-    }
-
-    Device.Logical = dev_ret.value();
-
-    Device.Dispatch = Device.Logical.make_table();
-
-    ReleaseQueue.Push([&]() {
-        vkb::destroy_surface(VulkanInstance, Device.Physical.surface);
-        vkb::destroy_device(Device.Logical);
-        });
-
-    // initialize the memory allocator
-    VmaAllocatorCreateInfo allocatorInfo = {};
-    allocatorInfo.physicalDevice = Device.Physical;
-    allocatorInfo.device = Device.Logical;
-    allocatorInfo.instance = VulkanInstance;
-    allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
-    vmaCreateAllocator(&allocatorInfo, &VulkanAllocator);
-
-    ReleaseQueue.Push([&]() {
-        vmaDestroyAllocator(VulkanAllocator);
-        });
-
     if (!CreateQueues())
         return;
     if (!CreateSwapchain(width, height))
         return;
     if (!CreateBackBufferObjects())
         return;
-    if (!CreateCommandPool())
+    if (!CreateFrameObjects())
+        return;
+
+    Initialized = true;
+}
+
+void RenderSystemVulkan::AttachHeadless(int width, int height)
+{
+    Headless = true;
+
+    CurrentWindow.Handle = nullptr;
+    CurrentWindow.vkSurface = VK_NULL_HANDLE;
+
+    CurrentWindow.Width = width;
+    CurrentWindow.Height = height;
+
+    if (!CreateDevice())
         return;
-    if (!CreateCommandBuffers())
+    if (!CreateQueues())
         return;
-    if (!CreateSyncObjects())
+    if (!CreateHeadlessBackBuffers())
         return;
-    if (!InitDescriptorPool())
+    if (!CreateFrameObjects())
         return;
 
     Initialized = true;
@@ -133,6 +105,21 @@ IRenderTarget* RenderSystemVulkan::CreateRenderTarget(BufferFormat fmt, int widt
     return rt;
 }
 
+IRenderTarget* RenderSystemVulkan::AcquireRenderTarget(BufferFormat fmt, int width, int height)
+{
+    return RenderTargetPool.Acquire(fmt, width, height);
+}
+
+void RenderSystemVulkan::ReleaseRenderTarget(IRenderTarget* target)
+{
+    RenderTargetPool.Release(static_cast<RenderTargetVk*>(target));
+}
+
+void RenderSystemVulkan::SetRenderTargetEviction(uint32_t frames)
+{
+    RenderTargetPool.SetEvictAfterFrames(frames);
+}
+
 IDescriptorLayout* RenderSystemVulkan::BuildDescriptorLayout(uint32_t numEntries, DescriptorLayoutEntry* entries)
 {
     DescriptorLayoutVk* layout = new DescriptorLayoutVk;
@@ -158,6 +145,25 @@ IDescriptorSet* RenderSystemVulkan::BuildDescriptorSet(IDescriptorLayout* layout
     return vkDescriptorSet;
 }
 
+IDescriptorSet* RenderSystemVulkan::BuildTransientDescriptorSet(IDescriptorLayout* layout)
+{
+    std::lock_guard<std::mutex> lock(TransientSetMutex);
+
+    TransientSetPool& pool = TransientSets[FrameScheduler.GetSlotIndex()];
+    if (pool.Used == pool.Sets.size())
+        pool.Sets.push_back(new DescriptorSetVk);
+
+    DescriptorSetVk* vkDescriptorSet = pool.Sets[pool.Used++];
+    vkDescriptorSet->InitTransient(layout);
+
+    return vkDescriptorSet;
+}
+
+IDescriptorLayout* RenderSystemVulkan::GetBindlessLayout()
+{
+    return BindlessHeap.GetLayout();
+}
+
 IShader* RenderSystemVulkan::CreateShader()
 {
     ShaderVk* shader = new ShaderVk();
@@ -165,31 +171,242 @@ IShader* RenderSystemVulkan::CreateShader()
     return shader;
 }
 
+IFrameGraph* RenderSystemVulkan::CreateFrameGraph()
+{
+    FrameGraphVk* graph = new FrameGraphVk;
+    AllocatedFrameGraphs.push_back(graph);
+    return graph;
+}
+
+IVertexBuffer* RenderSystemVulkan::CreateVertexBuffer(uint32_t size, uint32_t stride, BufferUsageHint usage, const void* data)
+{
+    VertexBufferVk* buffer = new VertexBufferVk;
+    if (!buffer->Init(size, stride, usage) || (data && !buffer->Update(data, size)))
+    {
+        buffer->Destroy();
+        delete buffer;
+        return nullptr;
+    }
+
+    AllocatedVertexBuffers.push_back(buffer);
+    return buffer;
+}
+
+IIndexBuffer* RenderSystemVulkan::CreateIndexBuffer(uint32_t size, IndexFormat format, BufferUsageHint usage, const void* data)
+{
+    IndexBufferVk* buffer = new IndexBufferVk;
+    if (!buffer->Init(size, format, usage) || (data && !buffer->Update(data, size)))
+    {
+        buffer->Destroy();
+        delete buffer;
+        return nullptr;
+    }
+
+    AllocatedIndexBuffers.push_back(buffer);
+    return buffer;
+}
+
 HShader RenderSystemVulkan::LoadShaderModule(const char* filepath)
 {
-    return RenderUtils::load_shader_module(GetDevice(), filepath);
+    VkShaderModule module = ShaderModuleCache.Acquire(GetDevice(), filepath);
+    if (module != VK_NULL_HANDLE)
+        ShaderFileWatcher.Watch(filepath);
+
+    return module;
+}
+
+void RenderSystemVulkan::ReleaseShaderModule(HShader module)
+{
+    ShaderModuleCache.Release(GetDevice(), static_cast<VkShaderModule>(module));
+}
+
+void RenderSystemVulkan::WaitForPipelines()
+{
+    PipelineCompiler.WaitIdle();
+}
+
+void RenderSystemVulkan::SetShaderHotReload(bool enable)
+{
+    if (enable)
+        ShaderFileWatcher.Start();
+    else
+        ShaderFileWatcher.Stop();
+}
+
+void RenderSystemVulkan::ProcessShaderReloads()
+{
+    TRACE_SCOPE("ProcessShaderReloads");
+
+    VkDevice device = GetDevice();
+
+    // The frames that could still use a retired pipeline are done
+    uint64_t completedFrame = FrameScheduler.GetCompletedFrame();
+    for (auto iter = RetiredPipelines.begin(); iter != RetiredPipelines.end();)
+    {
+        if (iter->Frame > completedFrame)
+        {
+            ++iter;
+            continue;
+        }
+
+        vkDestroyPipeline(device, iter->Pipeline, nullptr);
+        vkDestroyPipelineLayout(device, iter->Layout, nullptr);
+        iter = RetiredPipelines.erase(iter);
+    }
+
+    // Rebuilt pipelines go in before this frame records anything, frames in flight keep the old ones
+    for (ShaderVk* shader : AllocatedShaders)
+    {
+        Array<VkPipeline> pipelines;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        if (!shader->SwapReloadedPipeline(pipelines, layout))
+            continue;
+
+        // The layout goes with the first one
+        for (VkPipeline pipeline : pipelines)
+        {
+            RetiredPipelines.push_back({ pipeline, layout, FrameScheduler.GetCurrentFrame() - 1 });
+            layout = VK_NULL_HANDLE;
+        }
+    }
+
+    if (ShaderFileWatcher.IsRunning())
+        ShaderFileWatcher.TakeChanged(PendingShaderReloads);
+
+    Array<String> deferred;
+    for (const String& path : PendingShaderReloads)
+    {
+        VkShaderModule oldModule = ShaderModuleCache.Find(path.c_str());
+        if (oldModule == VK_NULL_HANDLE)
+        {
+            // Nobody holds the file anymore, the next load reads it fresh
+            ShaderModuleCache.Invalidate(path.c_str());
+            continue;
+        }
+
+        // A shader still building from the old module would race with the swap, try again next frame
+        bool busy = false;
+        for (ShaderVk* shader : AllocatedShaders)
+        {
+            if (shader->UsesModule(oldModule) && (!shader->IsReady() || shader->IsReloading()))
+            {
+                busy = true;
+                break;
+            }
+        }
+
+        if (busy)
+        {
+            deferred.push_back(path);
+            continue;
+        }
+
+        ShaderModuleCache.Invalidate(path.c_str());
+        VkShaderModule newModule = ShaderModuleCache.Acquire(device, path.c_str());
+
+        // Unreadable, or the same code written again
+        if (newModule == VK_NULL_HANDLE || newModule == oldModule)
+        {
+            ShaderModuleCache.Release(device, newModule);
+            continue;
+        }
+
+        // Every shader takes its own reference, ours is given back after
+        for (ShaderVk* shader : AllocatedShaders)
+        {
+            if (!shader->UsesModule(oldModule))
+                continue;
+
+            ShaderModuleCache.AddRef(newModule);
+            shader->Reload(oldModule, newModule);
+        }
+
+        ShaderModuleCache.Release(device, newModule);
+    }
+
+    PendingShaderReloads = std::move(deferred);
+}
+
+bool RenderSystemVulkan::UploadRenderTarget(IRenderTarget* target, const void* data, uint32_t size)
+{
+    RenderTargetVk* rt = static_cast<RenderTargetVk*>(target);
+    if (!rt)
+        return false;
+
+    // Depth targets are never a copy destination
+    VkFormat format = rt->GetFormat();
+    if (RenderUtils::IsDepthFormat(format))
+        return false;
+
+    VkExtent2D extent = rt->GetExtent();
+    if (size < (uint64_t)extent.width * extent.height * RenderUtils::FormatTexelSize(format))
+        return false;
+
+    bool recordNow = false;
+    uint64_t frame = GetUploadFrame(recordNow);
+
+    // Once a frame touched the image, the graphics queue owns it and writes it itself. So does the frame
+    // being recorded, it may use the image right away.
+    bool fresh = !recordNow && !StateTracker.HasBeenUsed(rt->GetImage());
+
+    if (!UploadEngine.UploadImage(rt->GetImage(), VK_IMAGE_ASPECT_COLOR_BIT, { extent.width, extent.height, 1 }, data, size, fresh, frame))
+        return false;
+
+    if (recordNow)
+        RecordUploads((uint64_t)rt->GetImage());
+
+    return true;
+}
+
+void* RenderSystemVulkan::AllocateConstants(uint32_t size, uint32_t& offset)
+{
+    void* data = nullptr;
+    ConstantAllocator.Allocate(size, data, offset);
+    return data;
 }
 
 void RenderSystemVulkan::BeginRendering()
 {
-    // wait for GPU to finish the work, then reset the fence
-    Device.Dispatch.waitForFences(1, &SwapChainSyncObjects[CurrentFrameIdx].Fence, VK_TRUE, UINT64_MAX);
-    Device.Dispatch.resetFences(1, &SwapChainSyncObjects[CurrentFrameIdx].Fence);
+    TRACE_SCOPE("BeginRendering");
 
-    // request the swapchain image
-    VkResult result = Device.Dispatch.acquireNextImageKHR(CurrentWindow.SwapChain, UINT64_MAX, SwapChainSyncObjects[CurrentFrameIdx].SwapSemaphore, NULL, &CurrentImageIdx);
+    // Asked for while the last frame was open
+    if (FrameScheduler.GetFramesInFlight() != (uint32_t)DesiredFramesInFlight)
+        FrameScheduler.SetFramesInFlight(DesiredFramesInFlight);
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    // wait until the GPU has finished the frame that last used this slot
+    FrameSchedulerVk::FrameSlot& frameSlot = FrameScheduler.BeginFrame();
+
+    ProcessShaderReloads();
+
+    if (Headless)
     {
-        RecreateSwapchain();
+        // Offscreen back buffers are tied to the frame slot, the wait above already guards them
+        CurrentImageIdx = FrameScheduler.GetSlotIndex();
     }
-    else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    else
     {
-        // std::cout << "failed to acquire swapchain image. Error " << result << "\n";
-        return;
+        // request the swapchain image
+        VkResult result;
+        {
+            TRACE_SCOPE("acquireNextImageKHR");
+            result = Device.Dispatch.acquireNextImageKHR(CurrentWindow.SwapChain, UINT64_MAX, frameSlot.SwapSemaphore, NULL, &CurrentImageIdx);
+        }
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            // the semaphore was not signalled, acquire again from the new swapchain
+            RecreateSwapchain();
+            result = Device.Dispatch.acquireNextImageKHR(CurrentWindow.SwapChain, UINT64_MAX, frameSlot.SwapSemaphore, NULL, &CurrentImageIdx);
+        }
+
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        {
+            // std::cout << "failed to acquire swapchain image. Error " << result << "\n";
+            return;
+        }
     }
 
-    VkCommandBuffer& CommandBuffer = CommandBuffers[CurrentFrameIdx];
+    VkCommandBuffer CommandBuffer = frameSlot.CommandBuffer;
 
     // reset command buffer to begin recording a new one
     Device.Dispatch.resetCommandBuffer(CommandBuffer, 0);
@@ -204,46 +421,190 @@ void RenderSystemVulkan::BeginRendering()
         return; // failed to begin recording command buffer
     }
 
-    // Transition the current image layout as general, so we can render into it
-    Cmd_TransitionImageLayout(CommandBuffer, BackBuffers[CurrentImageIdx].Image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    // The slot's region of the constant ring is free again
+    ConstantAllocator.BeginFrame(FrameScheduler.GetSlotIndex());
+
+    // So are its transient descriptor sets
+    DescriptorAllocator.BeginFrame(FrameScheduler.GetSlotIndex());
+    if (DescriptorBufferActive)
+        DescriptorBuffer.BeginFrame(FrameScheduler.GetSlotIndex());
+    TransientSets[FrameScheduler.GetSlotIndex()].Used = 0;
+
+    FrameRecording = true;
+    FrameSegments.clear();
+    SegmentJoinValue = 0;
+
+    // Nothing is bound on a fresh command buffer
+    BoundPipeline = VK_NULL_HANDLE;
+    PipelineStateDirty = true;
+    DynamicStateDirty = true;
+    BoundVertexBuffer = VK_NULL_HANDLE;
+    BoundIndexBuffer = VK_NULL_HANDLE;
+    BindlessGraphicsBound = false;
+    BindlessComputeBound = false;
+    DescriptorBufferBound = false;
+    BindlessAsyncBound = false;
+    DescriptorBufferAsyncBound = false;
+    ViewportSet = false;
+    ScissorSet = false;
+
+    // Collect the timings of the frame that last used this slot, it is already complete
+    GpuProfiler.BeginFrame(CommandBuffer, FrameScheduler.GetSlotIndex(), FrameScheduler.GetCurrentFrame());
+    GpuProfiler.BeginScope(CommandBuffer, "Frame");
+
+    // Same for the workgroup sizes being tuned
+    WorkgroupTuner.BeginFrame(CommandBuffer, FrameScheduler.GetSlotIndex());
+
+    // Pooled render targets nobody asked for in a while go away
+    RenderTargetPool.BeginFrame();
+
+    // Kick off the uploads made since the last frame, this frame acquires what the transfer queue finished
+    // releasing and waits for it on the upload timeline. Copies the graphics queue makes itself come first.
+    UploadEngine.Submit();
+    if (UploadEngine.HasGraphicsWork())
+        UploadEngine.RecordGraphicsWork(CommandBuffer);
+
+    // The back buffer is fully overwritten every frame, its first write has to wait for the acquire
+    StateTracker.Discard(BackBuffers[CurrentImageIdx].Image, Headless ? VK_PIPELINE_STAGE_2_NONE : SWAPCHAIN_WAIT_STAGES);
 }
 
 void RenderSystemVulkan::EndRendering()
 {
+    TRACE_SCOPE("EndRendering");
+
+    if (CurrentPass.Open && !CurrentPass.Implicit)
+    {
+        assert(0); // missing EndPass
+        EndPass();
+    }
+
+    LeavePass();
+
+    // Async work is always joined within its frame, the frame timeline then covers it too
+    if (AsyncComputeOpen)
+        EndAsyncCompute();
+    WaitAsyncCompute();
+
+    FrameRecording = false;
+
+    ConstantAllocator.Flush();
+    if (DescriptorBufferActive)
+        DescriptorBuffer.FlushFrame();
+
+    // Closes the frame scope along with anything the caller left open
+    GpuProfiler.EndFrame(GetCommandBuffer());
+
     // Transition the current image layout to presentable, so it can be presented
-    Cmd_TransitionImageLayout(CommandBuffers[CurrentFrameIdx], BackBuffers[CurrentImageIdx].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    if (!Headless)
+        StateTracker.TransitionImage(BackBuffers[CurrentImageIdx].Image, ResourceUsage::Present);
 
-    if (Device.Dispatch.endCommandBuffer(CommandBuffers[CurrentFrameIdx]) != VK_SUCCESS)
+    StateTracker.Flush(GetCommandBuffer());
+
+    if (Device.Dispatch.endCommandBuffer(GetCommandBuffer()) != VK_SUCCESS)
     {
         // std::cout << "failed to record command buffer\n";
         return; // failed to record command buffer!
     }
 
-    VkCommandBufferSubmitInfo commandSubmitInfo{};
-    commandSubmitInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
-    commandSubmitInfo.pNext = nullptr;
-    commandSubmitInfo.commandBuffer = CommandBuffers[CurrentFrameIdx];
-    commandSubmitInfo.deviceMask = 0;
+    FrameSegments.push_back({ GetCommandBuffer(), 0, SegmentJoinValue });
+    SegmentJoinValue = 0;
+
+    FrameSchedulerVk::FrameSlot& frameSlot = FrameScheduler.GetCurrentSlot();
+
+    uint32_t segmentCount = (uint32_t)FrameSegments.size();
+
+    Array<VkCommandBufferSubmitInfo> commandSubmitInfos(segmentCount);
+    Array<VkSemaphoreSubmitInfo> waitSemaphoreInfos;
+    Array<VkSemaphoreSubmitInfo> forkSemaphoreInfos;
+    Array<VkSubmitInfo2> submitInfos(segmentCount);
+
+    // The submit infos point into these, they must not grow past what is reserved
+    waitSemaphoreInfos.reserve(segmentCount * 2 + 2);
+    forkSemaphoreInfos.reserve(segmentCount);
+
+    // the frame number on the timeline, plus the binary semaphore the present waits on
+    VkSemaphoreSubmitInfo signalSemaphoreInfos[2] = {
+        FrameScheduler.SubmitFrame(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT),
+        RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, frameSlot.RenderSemaphore)
+    };
+
+    uint64_t forkValue = 0;
+    for (uint32_t i = 0; i < segmentCount; ++i)
+    {
+        FrameSegment& segment = FrameSegments[i];
+        uint32_t firstWait = (uint32_t)waitSemaphoreInfos.size();
+
+        if (i == 0)
+        {
+            // Without a swapchain there is no image to wait for
+            if (!Headless)
+                waitSemaphoreInfos.push_back(RenderUtils::semaphore_submit_info(SWAPCHAIN_WAIT_STAGES, frameSlot.SwapSemaphore));
+
+            // Resources acquired from the transfer queue in this frame, only the stages reading them wait
+            uint64_t uploadValue = UploadEngine.GetAcquiredValue();
+            if (uploadValue > WaitedUploadValue)
+            {
+                VkSemaphoreSubmitInfo uploadWait = RenderUtils::semaphore_submit_info(UploadEngineVk::CONSUMER_STAGES, UploadEngine.GetTimeline());
+                uploadWait.value = uploadValue;
+                waitSemaphoreInfos.push_back(uploadWait);
+                WaitedUploadValue = uploadValue;
+            }
+        }
+        else if (forkValue)
+        {
+            // Chained to the waits of the first part through the fork signalled after it
+            VkSemaphoreSubmitInfo forkWait = RenderUtils::semaphore_submit_info(SWAPCHAIN_WAIT_STAGES | UploadEngineVk::CONSUMER_STAGES, AsyncCompute.GetForkTimeline());
+            forkWait.value = forkValue;
+            waitSemaphoreInfos.push_back(forkWait);
+        }
+
+        if (segment.JoinValue)
+        {
+            VkSemaphoreSubmitInfo joinWait = RenderUtils::semaphore_submit_info(AsyncComputeVk::CONSUMER_STAGES, AsyncCompute.GetComputeTimeline());
+            joinWait.value = segment.JoinValue;
+            waitSemaphoreInfos.push_back(joinWait);
+        }
+
+        commandSubmitInfos[i] = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+        commandSubmitInfos[i].commandBuffer = segment.CommandBuffer;
+
+        VkSubmitInfo2& submitInfo = submitInfos[i];
+        submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+
+        submitInfo.waitSemaphoreInfoCount = (uint32_t)waitSemaphoreInfos.size() - firstWait;
+        submitInfo.pWaitSemaphoreInfos = waitSemaphoreInfos.data() + firstWait;
 
-    VkSemaphoreSubmitInfo waitSemaphoreInfo = RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, SwapChainSyncObjects[CurrentFrameIdx].SwapSemaphore);
-    VkSemaphoreSubmitInfo signalSemaphoreInfo = RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, SwapChainSyncObjects[CurrentFrameIdx].RenderSemaphore);
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandSubmitInfos[i];
 
-    VkSubmitInfo2 submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
-    submitInfo.pNext = nullptr;
+        if (segment.ForkValue)
+        {
+            VkSemaphoreSubmitInfo forkSignal = RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, AsyncCompute.GetForkTimeline());
+            forkSignal.value = segment.ForkValue;
+            forkSemaphoreInfos.push_back(forkSignal);
 
-    submitInfo.waitSemaphoreInfoCount = 1;
-    submitInfo.pWaitSemaphoreInfos = &waitSemaphoreInfo;
+            submitInfo.signalSemaphoreInfoCount = 1;
+            submitInfo.pSignalSemaphoreInfos = &forkSemaphoreInfos.back();
 
-    submitInfo.signalSemaphoreInfoCount = 1;
-    submitInfo.pSignalSemaphoreInfos = &signalSemaphoreInfo;
+            forkValue = segment.ForkValue;
+        }
+        else if (i == segmentCount - 1)
+        {
+            // Nothing to present to without a swapchain
+            submitInfo.signalSemaphoreInfoCount = Headless ? 1 : 2;
+            submitInfo.pSignalSemaphoreInfos = signalSemaphoreInfos;
+        }
+    }
 
-    submitInfo.commandBufferInfoCount = 1;
-    submitInfo.pCommandBufferInfos = &commandSubmitInfo;
+    {
+        TRACE_SCOPE("queueSubmit2");
+        Device.Dispatch.queueSubmit2(GraphicsQueue, segmentCount, submitInfos.data(), VK_NULL_HANDLE);
+    }
 
-    Device.Dispatch.queueSubmit2(GraphicsQueue, 1, &submitInfo, SwapChainSyncObjects[CurrentFrameIdx].Fence);
+    FrameSegments.clear();
 
     BoundShader = nullptr;
+    BoundShaderReady = false;
     BoundRenderTarget = nullptr;
 }
 
@@ -255,18 +616,62 @@ void RenderSystemVulkan::SetClearColor(ColorFloat &color)
 
 void RenderSystemVulkan::ClearColor()
 {
-    VkImageSubresourceRange imgClearColorRange = {};
-    imgClearColorRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    imgClearColorRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-    imgClearColorRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    if (CurrentPass.Open && (!CurrentPass.Implicit || CurrentPass.ColorImage == GetBoundImage()))
+    {
+        // Already rendering into it, clear the attachment in place
+        VkClearAttachment clearAttachment = {};
+        clearAttachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        clearAttachment.colorAttachment = 0;
+        clearAttachment.clearValue = ClearValue;
+
+        VkClearRect clearRect = {};
+        clearRect.rect = { { 0, 0 }, CurrentPass.Extent };
+        clearRect.layerCount = 1;
+
+        vkCmdClearAttachments(GetCommandBuffer(), 1, &clearAttachment, 1, &clearRect);
+        return;
+    }
+
+    CloseImplicitPass();
+
+    // A clear that is overwritten by another one never has to happen
+    if (DeferredClear.Pending && DeferredClear.Image != GetBoundImage())
+        ResolveDeferredClear();
+
+    DeferredClear.Pending = true;
+    DeferredClear.Image = GetBoundImage();
+    DeferredClear.Color = ClearColorValue;
+}
 
-    Device.Dispatch.cmdClearColorImage(CommandBuffers[CurrentFrameIdx], GetBoundImage(), VK_IMAGE_LAYOUT_GENERAL, &ClearColorValue, 1, &imgClearColorRange);
+void RenderSystemVulkan::BeginPass(const RenderPassDesc& desc)
+{
+    if (CurrentPass.Open && !CurrentPass.Implicit)
+    {
+        assert(0); // passes don't nest
+        EndPass();
+    }
+
+    CloseImplicitPass();
+    OpenPass(desc, false);
+}
+
+void RenderSystemVulkan::EndPass()
+{
+    if (!CurrentPass.Open || CurrentPass.Implicit)
+        return;
+
+    vkCmdEndRendering(GetCommandBuffer());
+    CurrentPass.Open = false;
 }
 
 void RenderSystemVulkan::SetRenderTarget(IRenderTarget *target)
 {
+    // Layout is resolved lazily by whatever uses the target next
     BoundRenderTarget = static_cast<RenderTargetVk*>(target);
-    Cmd_TransitionImageLayout(CommandBuffers[CurrentFrameIdx], GetBoundImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+    // Draws into the new target need their own pass
+    if (CurrentPass.Implicit && CurrentPass.ColorImage != GetBoundImage())
+        CloseImplicitPass();
 }
 
 void RenderSystemVulkan::SetViewport(Viewport settings)
@@ -281,7 +686,8 @@ void RenderSystemVulkan::SetViewport(Viewport settings)
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
 
-    Device.Dispatch.cmdSetViewport(CommandBuffers[CurrentFrameIdx], 0, 1, &viewport);
+    Device.Dispatch.cmdSetViewport(GetCommandBuffer(), 0, 1, &viewport);
+    ViewportSet = true;
 }
 
 void RenderSystemVulkan::SetScissorRectangle(ScissorRectangle settings)
@@ -292,60 +698,213 @@ void RenderSystemVulkan::SetScissorRectangle(ScissorRectangle settings)
     scissor.offset = {CurrentScissor.x, CurrentScissor.y};
     scissor.extent = {static_cast<uint32_t>(CurrentScissor.w), static_cast<uint32_t>(CurrentScissor.h)};
 
-    Device.Dispatch.cmdSetScissor(CommandBuffers[CurrentFrameIdx], 0, 1, &scissor);
+    Device.Dispatch.cmdSetScissor(GetCommandBuffer(), 0, 1, &scissor);
+    ScissorSet = true;
 }
 
 void RenderSystemVulkan::BindShader(IShader *shader, PipelineBindPoint point)
 {
     BoundShader = static_cast<ShaderVk*>(shader);
+    PipelineStateDirty = true;
+
+    // Still compiling, nothing gets recorded with it
+    BoundShaderReady = BoundShader && BoundShader->IsReady();
+    if (!BoundShaderReady)
+        return;
+
+    if (BoundShader->IsBindless())
+        BindBindlessHeap(point);
+
+    if (AsyncComputeOpen && point == PipelineBindPoint::Compute)
+    {
+        vkCmdBindPipeline(AsyncCompute.GetCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, BoundShader->GetPipeline());
+        return;
+    }
 
-    // Graphics pipeline is bound way further inside Draw scope
+    // Graphics pipeline is bound at the draw, and only when it changed
     if(point != PipelineBindPoint::Graphics)
-        vkCmdBindPipeline(CommandBuffers[CurrentFrameIdx], RenderUtils::PipelineBindPointToVulkan(point), BoundShader->GetPipeline());
+        vkCmdBindPipeline(GetCommandBuffer(), RenderUtils::PipelineBindPointToVulkan(point), BoundShader->GetPipeline());
 }
 
-void RenderSystemVulkan::BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point)
+void RenderSystemVulkan::BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point, const uint32_t* constantOffsets, uint32_t numOffsets)
 {
     DescriptorSetVk* vkSet = static_cast<DescriptorSetVk*>(set);
 
-    vkCmdBindDescriptorSets(CommandBuffers[CurrentFrameIdx], RenderUtils::PipelineBindPointToVulkan(point), BoundShader->GetPipelineLayout(), 0, 1, &vkSet->GetDescriptor(), 0, nullptr);
-}
+    // The pipeline layout comes with the pipeline
+    if (!BoundShaderReady)
+        return;
 
-void RenderSystemVulkan::SetVertexBuffer(IVertexBuffer *buffer)
-{
-}
+    if (AsyncComputeOpen && point == PipelineBindPoint::Compute)
+    {
+        // Transitioned on the graphics queue at the fork, then handed over to the compute queue
+        vkSet->TransitionImages(StateTracker, ResourceUsage::ComputeStorage);
 
-void RenderSystemVulkan::SetIndexBuffer(IIndexBuffer *buffer)
-{
-}
+        Array<VkImage> images;
+        vkSet->CollectImages(StateTracker, images);
+        for (VkImage image : images)
+            AsyncCompute.UseImage(image);
 
-void RenderSystemVulkan::DrawPrimitive(int first_vertex, int vertex_count)
-{
-    //begin a render pass  connected to our render target
-    VkRenderingAttachmentInfo colorAttachment = RenderUtils::attachment_info(GetBoundImageView(), nullptr, VK_IMAGE_LAYOUT_GENERAL);
+        vkSet->Bind(AsyncCompute.GetCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE, BoundShader->GetPipelineLayout(), constantOffsets, numOffsets, DescriptorBufferAsyncBound);
+        BindlessAsyncBound = false;
+        return;
+    }
 
-    VkRenderingInfo renderInfo = RenderUtils::rendering_info({ CurrentWindow.Width, CurrentWindow.Height }, &colorAttachment, nullptr);
-    vkCmdBeginRendering(CommandBuffers[CurrentFrameIdx], &renderInfo);
+    if (vkSet->HasImages())
+    {
+        // Transitions can't happen inside a pass, a pending clear has to land before the images are used
+        if (CurrentPass.Open && !CurrentPass.Implicit)
+            assert(!"images must be bound before BeginPass");
+        else
+            LeavePass();
+    }
 
-    vkCmdBindPipeline(CommandBuffers[CurrentFrameIdx], RenderUtils::PipelineBindPointToVulkan(PipelineBindPoint::Graphics), BoundShader->GetPipeline());
+    // Storage images are flushed right before the draw or dispatch that reads them
+    vkSet->TransitionImages(StateTracker, point == PipelineBindPoint::Compute ? ResourceUsage::ComputeStorage : ResourceUsage::GraphicsStorage);
 
-    // stub scissor for now
-    VkRect2D scissor = {};
-    scissor.offset.x = 0;
-    scissor.offset.y = 0;
-    scissor.extent.width = CurrentWindow.Width;
-    scissor.extent.height = CurrentWindow.Height;
+    vkSet->Bind(GetCommandBuffer(), RenderUtils::PipelineBindPointToVulkan(point), BoundShader->GetPipelineLayout(), constantOffsets, numOffsets, DescriptorBufferBound);
+
+    // Took the heap's place at set 0
+    if (point == PipelineBindPoint::Compute)
+        BindlessComputeBound = false;
+    else
+        BindlessGraphicsBound = false;
+}
+
+void RenderSystemVulkan::BindBindlessHeap(PipelineBindPoint point)
+{
+    if (AsyncComputeOpen && point == PipelineBindPoint::Compute)
+    {
+        if (!BindlessAsyncBound)
+            BindlessHeap.Bind(AsyncCompute.GetCommandBuffer(), VK_PIPELINE_BIND_POINT_COMPUTE);
+
+        BindlessAsyncBound = true;
+        return;
+    }
+
+    bool& bound = point == PipelineBindPoint::Compute ? BindlessComputeBound : BindlessGraphicsBound;
+    if (bound)
+        return;
+
+    BindlessHeap.Bind(GetCommandBuffer(), RenderUtils::PipelineBindPointToVulkan(point));
+    bound = true;
+}
+
+void RenderSystemVulkan::UseBindlessTarget(IRenderTarget* target, FrameGraphAccess access)
+{
+    RenderTargetVk* vkTarget = static_cast<RenderTargetVk*>(target);
+    if (!vkTarget)
+        return;
+
+    if (AsyncComputeOpen)
+    {
+        // Same as the images of a bound set, storage images handed over to the compute queue at the fork
+        StateTracker.TransitionImage(vkTarget->GetImage(), ResourceUsage::ComputeStorage);
+        AsyncCompute.UseImage(vkTarget->GetImage());
+        return;
+    }
+
+    // Transitions can't happen inside a pass, a pending clear has to land before the image is used
+    if (CurrentPass.Open && !CurrentPass.Implicit)
+        assert(!"images must be used before BeginPass");
+    else
+        LeavePass();
+
+    // Flushed right before the draw or dispatch that reads it
+    StateTracker.TransitionImage(vkTarget->GetImage(), FrameGraphVk::AccessToUsage(access));
+}
+
+void RenderSystemVulkan::SetPushConstants(const void* data, uint32_t size, uint32_t offset)
+{
+    if (!BoundShaderReady)
+        return;
+
+    // Compute work of an open async section reads them on the compute queue
+    bool async = AsyncComputeOpen && BoundShader->GetType() == ShaderType::Compute;
+    VkCommandBuffer cmd = async ? AsyncCompute.GetCommandBuffer() : GetCommandBuffer();
+
+    vkCmdPushConstants(cmd, BoundShader->GetPipelineLayout(), BoundShader->GetPushConstantStages(), offset, size, data);
+}
+
+void RenderSystemVulkan::SetVertexBuffer(IVertexBuffer *buffer)
+{
+    VertexBufferVk* vkBuffer = static_cast<VertexBufferVk*>(buffer);
+    if (!vkBuffer || vkBuffer->GetBuffer() == BoundVertexBuffer)
+        return;
 
-    vkCmdSetScissor(CommandBuffers[CurrentFrameIdx], 0, 1, &scissor);
+    BoundVertexBuffer = vkBuffer->GetBuffer();
 
-    vkCmdDraw(CommandBuffers[CurrentFrameIdx], vertex_count, 1, first_vertex, 0);
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(GetCommandBuffer(), 0, 1, &BoundVertexBuffer, &offset);
+}
+
+void RenderSystemVulkan::SetIndexBuffer(IIndexBuffer *buffer)
+{
+    IndexBufferVk* vkBuffer = static_cast<IndexBufferVk*>(buffer);
+    if (!vkBuffer || vkBuffer->GetBuffer() == BoundIndexBuffer)
+        return;
 
-    vkCmdEndRendering(CommandBuffers[CurrentFrameIdx]);
+    BoundIndexBuffer = vkBuffer->GetBuffer();
 
+    vkCmdBindIndexBuffer(GetCommandBuffer(), BoundIndexBuffer, 0, vkBuffer->GetIndexType());
 }
 
-void RenderSystemVulkan::DrawIndexedPrimitives(int index_count)
+void RenderSystemVulkan::DrawPrimitive(int first_vertex, int vertex_count)
 {
+    if (!PrepareDraw())
+        return;
+
+    vkCmdDraw(GetCommandBuffer(), vertex_count, 1, first_vertex, 0);
+}
+
+void RenderSystemVulkan::DrawIndexedPrimitives(int index_count, int first_index, int base_vertex, int instance_count, int first_instance)
+{
+    if (!PrepareDraw())
+        return;
+
+    vkCmdDrawIndexed(GetCommandBuffer(), index_count, instance_count, first_index, base_vertex, first_instance);
+}
+
+bool RenderSystemVulkan::PrepareDraw()
+{
+    if (!BoundShaderReady)
+        return false;
+
+    // Draws without an explicit pass keep appending to an implicit one on the bound target
+    if (!CurrentPass.Open || (CurrentPass.Implicit && StateTracker.HasPending()))
+    {
+        CloseImplicitPass();
+
+        RenderPassDesc desc;
+        desc.Color.Target = BoundRenderTarget;
+        OpenPass(desc, true);
+    }
+
+    // The variant only has to be looked up again when shader, blend state or pass changed
+    if (PipelineStateDirty)
+    {
+        VkPipeline pipeline = BoundShader->GetPipelineVariant(CurrentBlend, CurrentPass.ColorFormat, CurrentPass.DepthFormat);
+        if (pipeline == VK_NULL_HANDLE)
+            return false;
+
+        PipelineStateDirty = false;
+
+        if (pipeline != BoundPipeline)
+        {
+            BoundPipeline = pipeline;
+            vkCmdBindPipeline(GetCommandBuffer(), VK_PIPELINE_BIND_POINT_GRAPHICS, BoundPipeline);
+
+            // Cull mode and winding may come from the shader
+            DynamicStateDirty = true;
+        }
+    }
+
+    if (DynamicStateDirty)
+    {
+        BoundShader->RecordDynamicState(GetCommandBuffer(), CurrentDepthStencil, CurrentRasterizer);
+        DynamicStateDirty = false;
+    }
+
+    return true;
 }
 
 void RenderSystemVulkan::CopyRenderTargetToBackBuffer()
@@ -356,14 +915,18 @@ void RenderSystemVulkan::CopyRenderTargetToBackBuffer()
         return;
     }
 
+    LeavePass();
+
+    GpuProfiler.BeginScope(GetCommandBuffer(), "CopyRenderTargetToBackBuffer");
+
     RenderTargetVk *vkRT = static_cast<RenderTargetVk*>(BoundRenderTarget);
 
     int width, height;
     vkRT->GetExtent(width, height);
 
     VkExtent2D renderTargetExtent = {
-        min(CurrentWindow.Width, width),
-        min(CurrentWindow.Height, height)
+        std::min<uint32_t>(CurrentWindow.Width, width),
+        std::min<uint32_t>(CurrentWindow.Height, height)
     };
 
     VkExtent2D swapchainExtent = {
@@ -371,88 +934,668 @@ void RenderSystemVulkan::CopyRenderTargetToBackBuffer()
         CurrentWindow.Height
     };
 
-    Cmd_TransitionImageLayout(CommandBuffers[CurrentFrameIdx], GetBoundImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-    Cmd_TransitionImageLayout(CommandBuffers[CurrentFrameIdx], BackBuffers[CurrentImageIdx].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    // both transitions go out in a single barrier
+    StateTracker.TransitionImage(GetBoundImage(), ResourceUsage::TransferSrc);
+    StateTracker.TransitionImage(BackBuffers[CurrentImageIdx].Image, ResourceUsage::TransferDst);
+    StateTracker.Flush(GetCommandBuffer());
+
+    // copy render target into the swapchain
+    Cmd_BlitImage(GetCommandBuffer(), GetBoundImage(), BackBuffers[CurrentImageIdx].Image, renderTargetExtent, swapchainExtent);
+
+    GpuProfiler.EndScope(GetCommandBuffer());
+}
+
+void RenderSystemVulkan::Present()
+{
+    if (Headless)
+    {
+        // Nothing to show, the frame is retired once its timeline value is reached
+        FrameScheduler.EndFrame();
+        return;
+    }
+
+    VkPresentInfoKHR present_info = {};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &FrameScheduler.GetCurrentSlot().RenderSemaphore;
+
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &CurrentWindow.SwapChain.swapchain;
+
+    present_info.pImageIndices = &CurrentImageIdx;
+
+    {
+        TRACE_SCOPE("queuePresentKHR");
+        Device.Dispatch.queuePresentKHR(PresentQueue, &present_info);
+    }
+
+    FrameScheduler.EndFrame();
+}
+
+void RenderSystemVulkan::Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ)
+{
+    if (!BoundShaderReady)
+        return;
+
+    RecordDispatch(VK_NULL_HANDLE, groupSizeX, groupSizeY, groupSizeZ, WorkgroupTunerVk::NO_SAMPLE);
+}
+
+void RenderSystemVulkan::DispatchThreads(uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ)
+{
+    if (!BoundShaderReady)
+        return;
+
+    // The async queue isn't timed, its dispatches overlap whatever graphics runs
+    const uint32_t threads[3] = { threadsX, threadsY, threadsZ };
+    uint32_t size[3];
+    uint32_t sample = WorkgroupTunerVk::NO_SAMPLE;
+    VkPipeline pipeline = WorkgroupTuner.Select(BoundShader, threads, size, AsyncComputeOpen ? nullptr : &sample);
+
+    VkPipeline variant = pipeline != BoundShader->GetPipeline() ? pipeline : VK_NULL_HANDLE;
+    RecordDispatch(variant, (threadsX + size[0] - 1) / size[0], (threadsY + size[1] - 1) / size[1], (threadsZ + size[2] - 1) / size[2], sample);
+}
+
+void RenderSystemVulkan::RecordDispatch(VkPipeline variant, uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ, uint32_t sample)
+{
+    if (AsyncComputeOpen)
+    {
+        VkCommandBuffer asyncCmd = AsyncCompute.GetCommandBuffer();
+
+        // Barriers for the images it uses are flushed at the fork
+        if (variant != VK_NULL_HANDLE)
+            vkCmdBindPipeline(asyncCmd, VK_PIPELINE_BIND_POINT_COMPUTE, variant);
+
+        vkCmdDispatch(asyncCmd, groupsX, groupsY, groupsZ);
+
+        if (variant != VK_NULL_HANDLE)
+            vkCmdBindPipeline(asyncCmd, VK_PIPELINE_BIND_POINT_COMPUTE, BoundShader->GetPipeline());
+        return;
+    }
+
+    if (CurrentPass.Open && !CurrentPass.Implicit)
+    {
+        assert(0); // dispatches can't run inside a pass
+        return;
+    }
+
+    LeavePass();
+
+    VkCommandBuffer cmd = GetCommandBuffer();
+
+    GpuProfiler.BeginScope(cmd, "Dispatch");
+
+    StateTracker.Flush(cmd);
+
+    // Variants share the layout, descriptor sets and push constants stay bound
+    if (variant != VK_NULL_HANDLE)
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, variant);
+
+    WorkgroupTuner.BeginSample(cmd, sample);
+    vkCmdDispatch(cmd, groupsX, groupsY, groupsZ);
+    WorkgroupTuner.EndSample(cmd, sample);
+
+    if (variant != VK_NULL_HANDLE)
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, BoundShader->GetPipeline());
+
+    GpuProfiler.EndScope(cmd);
+}
+
+void RenderSystemVulkan::BeginAsyncCompute()
+{
+    if (!AsyncCompute.IsAvailable() || AsyncComputeOpen)
+        return;
+
+    if (CurrentPass.Open && !CurrentPass.Implicit)
+    {
+        assert(0); // the frame can't fork inside a pass
+        return;
+    }
+
+    AsyncComputeOpen = true;
+}
+
+void RenderSystemVulkan::EndAsyncCompute()
+{
+    if (!AsyncComputeOpen)
+        return;
+
+    AsyncComputeOpen = false;
+
+    // The next async section records into another command buffer
+    BindlessAsyncBound = false;
+    DescriptorBufferAsyncBound = false;
+
+    // Nothing was dispatched, no need to fork
+    if (!AsyncCompute.IsRecording())
+        return;
+
+    LeavePass();
+
+    // The images are brought into their compute layout before graphics lets go of them
+    StateTracker.Flush(GetCommandBuffer());
+
+    SplitFrame(AsyncCompute.Fork(GetCommandBuffer()));
+}
+
+void RenderSystemVulkan::WaitAsyncCompute()
+{
+    if (!AsyncCompute.HasUnjoinedWork())
+        return;
+
+    if (CurrentPass.Open && !CurrentPass.Implicit)
+    {
+        assert(0); // the frame can't join inside a pass
+        return;
+    }
+
+    LeavePass();
+    SplitFrame(0);
+
+    SegmentJoinValue = AsyncCompute.Join(GetCommandBuffer());
+}
+
+ICommandContext* RenderSystemVulkan::AcquireCommandContext()
+{
+    std::lock_guard<std::mutex> lock(CommandContextMutex);
+
+    if (!FreeCommandContexts.empty())
+    {
+        CommandContextVk* context = FreeCommandContexts.back();
+        FreeCommandContexts.pop_back();
+        return context;
+    }
+
+    CommandContextVk* context = new CommandContextVk;
+    if (!context->Init(Device.Logical.get_queue_index(vkb::QueueType::graphics).value()))
+    {
+        context->Destroy();
+        delete context;
+        return nullptr;
+    }
+
+    AllocatedCommandContexts.push_back(context);
+    return context;
+}
+
+void RenderSystemVulkan::ExecuteCommandContexts(ICommandContext** contexts, uint32_t count)
+{
+    VkCommandBuffer cmd = GetCommandBuffer();
+
+    LeavePass();
+
+    // Contexts may depend on each other or on earlier immediate commands
+    VkMemoryBarrier2 memoryBarrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+    memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memoryBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    memoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+
+    VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    depInfo.memoryBarrierCount = 1;
+    depInfo.pMemoryBarriers = &memoryBarrier;
+
+    uint32_t first = 0;
+    while (first < count)
+    {
+        CommandContextVk* groupContext = static_cast<CommandContextVk*>(contexts[first]);
+
+        // Gather the run of contexts that can execute under one render pass, or outside of one
+        Array<VkCommandBuffer> secondaries;
+        uint32_t last = first;
+        for (; last < count; ++last)
+        {
+            CommandContextVk* context = static_cast<CommandContextVk*>(contexts[last]);
+            if (context->GetType() != groupContext->GetType() ||
+                (context->GetType() == CommandContextType::Graphics && context->GetTargetView() != groupContext->GetTargetView()))
+                break;
+
+            secondaries.push_back(context->GetCommandBuffer());
+            context->TransitionResources(StateTracker);
+        }
+
+        if (groupContext->GetType() == CommandContextType::Graphics)
+            StateTracker.TransitionImageView(groupContext->GetTargetView(), ResourceUsage::ColorAttachment);
+
+        StateTracker.Flush(cmd);
+
+        // Buffers are not tracked yet
+        Device.Dispatch.cmdPipelineBarrier2(cmd, &depInfo);
+
+        if (groupContext->GetType() == CommandContextType::Graphics)
+        {
+            VkRenderingAttachmentInfo colorAttachment = RenderUtils::attachment_info(groupContext->GetTargetView(), nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+            VkRenderingInfo renderInfo = RenderUtils::rendering_info(groupContext->GetTargetExtent(), &colorAttachment, nullptr);
+            renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+            vkCmdBeginRendering(cmd, &renderInfo);
+            vkCmdExecuteCommands(cmd, (uint32_t)secondaries.size(), secondaries.data());
+            vkCmdEndRendering(cmd);
+        }
+        else
+        {
+            vkCmdExecuteCommands(cmd, (uint32_t)secondaries.size(), secondaries.data());
+        }
+
+        first = last;
+    }
+
+    // The main command buffer now references the recordings, the contexts can record again
+    std::lock_guard<std::mutex> lock(CommandContextMutex);
+    for (uint32_t i = 0; i < count; ++i)
+        FreeCommandContexts.push_back(static_cast<CommandContextVk*>(contexts[i]));
+
+    // Immediate commands that follow rebind their own state
+    BoundShader = nullptr;
+    BoundShaderReady = false;
+    BoundPipeline = VK_NULL_HANDLE;
+    PipelineStateDirty = true;
+    DynamicStateDirty = true;
+    BoundVertexBuffer = VK_NULL_HANDLE;
+    BoundIndexBuffer = VK_NULL_HANDLE;
+    BindlessGraphicsBound = false;
+    BindlessComputeBound = false;
+    DescriptorBufferBound = false;
+    ViewportSet = false;
+    ScissorSet = false;
+}
+
+void RenderSystemVulkan::Destroy()
+{
+    ShaderFileWatcher.Stop();
+    PipelineCompiler.Destroy();
+
+    vkDeviceWaitIdle(Device.Logical);
+
+    for (const RetiredPipeline& retired : RetiredPipelines)
+    {
+        vkDestroyPipeline(Device.Logical, retired.Pipeline, nullptr);
+        vkDestroyPipelineLayout(Device.Logical, retired.Layout, nullptr);
+    }
+    RetiredPipelines.clear();
+
+    for (auto* context : AllocatedCommandContexts)
+    {
+        context->Destroy();
+        delete context;
+    }
+
+    // Transient render targets go before the render targets they may alias with
+    for (auto* graph : AllocatedFrameGraphs)
+    {
+        graph->Destroy();
+        delete graph;
+    }
+
+    for (auto* buffer : AllocatedVertexBuffers)
+    {
+        buffer->Destroy();
+        delete buffer;
+    }
+    for (auto* buffer : AllocatedIndexBuffers)
+    {
+        buffer->Destroy();
+        delete buffer;
+    }
+
+    for (auto* shader : AllocatedShaders)
+    {
+        shader->Destroy();
+        delete shader;
+    }
+    for (auto* rendertarget : AllocatedRenderTargets)
+    {
+        rendertarget->Destroy();
+        delete rendertarget;
+    }
+    RenderTargetPool.Destroy();
+    for (auto* descriptor_layout : AllocatedDescriptorLayouts)
+    {
+        descriptor_layout->Destroy();
+        delete descriptor_layout;
+    }
+    for (TransientSetPool& pool : TransientSets)
+    {
+        for (auto* descriptor_set : pool.Sets)
+            delete descriptor_set;
+    }
+
+    ReleaseQueue.Release();
+}
+
+void RenderSystemVulkan::SetFramesInFlight(int count)
+{
+    DesiredFramesInFlight = std::clamp<int>(count, 1, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT);
+
+    // A frame in the middle of recording keeps its slot, the next BeginRendering picks the change up
+    if (Initialized && !FrameScheduler.IsFrameOpen())
+        FrameScheduler.SetFramesInFlight(DesiredFramesInFlight);
+}
+
+void RenderSystemVulkan::SetDescriptorBufferEnabled(bool enable)
+{
+    DescriptorBufferEnabled = enable;
+}
+
+bool RenderSystemVulkan::IsDescriptorBufferActive()
+{
+    return DescriptorBufferActive;
+}
+
+int RenderSystemVulkan::GetFramesInFlight()
+{
+    return Initialized ? FrameScheduler.GetFramesInFlight() : DesiredFramesInFlight;
+}
+
+uint64_t RenderSystemVulkan::GetCurrentFrame()
+{
+    return FrameScheduler.GetCurrentFrame();
+}
+
+uint64_t RenderSystemVulkan::GetCompletedFrame()
+{
+    return FrameScheduler.GetCompletedFrame();
+}
+
+bool RenderSystemVulkan::WaitForFrame(uint64_t frame, uint64_t timeoutNs)
+{
+    return FrameScheduler.WaitForFrame(frame, timeoutNs);
+}
+
+void RenderSystemVulkan::BeginGpuScope(const char* name)
+{
+    GpuProfiler.BeginScope(GetCommandBuffer(), name);
+}
+
+void RenderSystemVulkan::EndGpuScope()
+{
+    GpuProfiler.EndScope(GetCommandBuffer());
+}
+
+uint32_t RenderSystemVulkan::GetGpuScopeTimings(GpuScopeTiming* timings, uint32_t maxCount, uint64_t* frame)
+{
+    const Array<GpuScopeTiming>& resolved = GpuProfiler.GetResolvedTimings();
+
+    uint32_t count = std::min<uint32_t>(maxCount, (uint32_t)resolved.size());
+    for (uint32_t i = 0; i < count; ++i)
+        timings[i] = resolved[i];
+
+    if (frame)
+        *frame = GpuProfiler.GetResolvedFrame();
+
+    return count;
+}
+
+bool RenderSystemVulkan::WriteGpuTrace(const char* filepath)
+{
+    return GpuProfiler.WriteChromeTrace(filepath);
+}
+
+void RenderSystemVulkan::SetBlendState(BlendState settings)
+{
+    CurrentBlend = settings;
+    PipelineStateDirty = true;
+}
+
+void RenderSystemVulkan::SetDepthStencilState(DepthStencilState settings)
+{
+    CurrentDepthStencil = settings;
+    DynamicStateDirty = true;
+}
+
+void RenderSystemVulkan::SetRasterizerState(RasterizerState settings)
+{
+    CurrentRasterizer = settings;
+    DynamicStateDirty = true;
+}
+
+VmaAllocator &RenderSystemVulkan::GetAllocator()
+{
+    return VulkanAllocator;
+}
+
+vkb::Device &RenderSystemVulkan::GetDevice()
+{
+    return Device.Logical;
+}
+
+DescriptorAllocatorVk& RenderSystemVulkan::GetDescriptorAllocator()
+{
+    return DescriptorAllocator;
+}
+
+DescriptorBufferVk& RenderSystemVulkan::GetDescriptorBuffer()
+{
+    return DescriptorBuffer;
+}
+
+void RenderSystemVulkan::EvictDescriptorSets(VkImageView view)
+{
+    for (auto* descriptor_layout : AllocatedDescriptorLayouts)
+        descriptor_layout->EvictImageView(view);
+}
+
+FrameSchedulerVk& RenderSystemVulkan::GetFrameScheduler()
+{
+    return FrameScheduler;
+}
+
+ResourceStateTracker& RenderSystemVulkan::GetStateTracker()
+{
+    return StateTracker;
+}
+
+ConstantAllocatorVk& RenderSystemVulkan::GetConstantAllocator()
+{
+    return ConstantAllocator;
+}
+
+PipelineCacheVk& RenderSystemVulkan::GetPipelineCache()
+{
+    return PipelineCache;
+}
+
+PipelineCompilerVk& RenderSystemVulkan::GetPipelineCompiler()
+{
+    return PipelineCompiler;
+}
+
+ShaderModuleCacheVk& RenderSystemVulkan::GetShaderModuleCache()
+{
+    return ShaderModuleCache;
+}
+
+WorkgroupTunerVk& RenderSystemVulkan::GetWorkgroupTuner()
+{
+    return WorkgroupTuner;
+}
+
+BindlessHeapVk& RenderSystemVulkan::GetBindlessHeap()
+{
+    return BindlessHeap;
+}
+
+PipelineCacheStats RenderSystemVulkan::GetPipelineCacheStats()
+{
+    return PipelineCache.GetStats();
+}
+
+bool RenderSystemVulkan::UploadBuffer(VkBuffer dst, VkDeviceSize offset, const void* data, VkDeviceSize size, bool fresh)
+{
+    bool recordNow = false;
+    uint64_t frame = GetUploadFrame(recordNow);
+
+    // The frame being recorded may use it right away, the copy has to be in its command buffer
+    if (recordNow)
+        fresh = false;
+
+    if (!UploadEngine.UploadBuffer(dst, offset, data, size, fresh, frame))
+        return false;
+
+    if (recordNow)
+        RecordUploads((uint64_t)dst);
+
+    return true;
+}
+
+void RenderSystemVulkan::FlushBarriers()
+{
+    LeavePass();
+    StateTracker.Flush(GetCommandBuffer());
+}
+
+VkImage RenderSystemVulkan::GetBackBufferImage()
+{
+    return BackBuffers[CurrentImageIdx].Image;
+}
 
-    // copy render target into the swapchain
-    Cmd_BlitImage(CommandBuffers[CurrentFrameIdx], GetBoundImage(), BackBuffers[CurrentImageIdx].Image, renderTargetExtent, swapchainExtent);
+VkImageView RenderSystemVulkan::GetBackBufferView()
+{
+    return BackBuffers[CurrentImageIdx].ImageView;
+}
 
-    // restore image layouts
-    Cmd_TransitionImageLayout(CommandBuffers[CurrentFrameIdx], GetBoundImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
-    Cmd_TransitionImageLayout(CommandBuffers[CurrentFrameIdx], BackBuffers[CurrentImageIdx].Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+VkFormat RenderSystemVulkan::GetBackBufferFormat()
+{
+    return BackBufferFormat;
 }
 
-void RenderSystemVulkan::Present()
+VkExtent2D RenderSystemVulkan::GetBackBufferExtent()
 {
-    VkPresentInfoKHR present_info = {};
-    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    return { CurrentWindow.Width, CurrentWindow.Height };
+}
 
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &SwapChainSyncObjects[CurrentFrameIdx].RenderSemaphore;
+bool RenderSystemVulkan::CreateDevice()
+{
+    //vulkan 1.3 features
+    VkPhysicalDeviceVulkan13Features features13{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+    features13.dynamicRendering = true;
+    features13.synchronization2 = true;
 
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = &CurrentWindow.SwapChain.swapchain;
+    //vulkan 1.2 features
+    VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+    features12.bufferDeviceAddress = true;
+    features12.descriptorIndexing = true;
 
-    present_info.pImageIndices = &CurrentImageIdx;
+    // Bindless heap, unbounded arrays written while frames using other indices are in flight
+    features12.runtimeDescriptorArray = true;
+    features12.descriptorBindingPartiallyBound = true;
+    features12.descriptorBindingUpdateUnusedWhilePending = true;
+    features12.descriptorBindingStorageImageUpdateAfterBind = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+    features12.shaderSampledImageArrayNonUniformIndexing = true;
+    features12.shaderStorageBufferArrayNonUniformIndexing = true;
+
+    // Indexing the heap arrays with values from push constants
+    VkPhysicalDeviceFeatures features{};
+    features.shaderStorageImageArrayDynamicIndexing = true;
+    features.shaderSampledImageArrayDynamicIndexing = true;
+    features.shaderStorageBufferArrayDynamicIndexing = true;
 
-    Device.Dispatch.queuePresentKHR(PresentQueue, &present_info);
+    vkb::PhysicalDeviceSelector selector{VulkanInstance};
+    selector.set_minimum_version(1, 3)
+            .set_required_features(features)
+            .set_required_features_13(features13)
+            .set_required_features_12(features12);
 
-    CurrentFrameIdx = (CurrentFrameIdx + 1) % MAX_FRAMES_IN_FLIGHT;
-}
+    if (Headless)
+    {
+        // Nothing to present to, software devices like lavapipe only expose a single queue family
+        selector.defer_surface_initialization();
+    }
+    else
+    {
+        selector.set_surface(CurrentWindow.vkSurface)
+                .require_dedicated_transfer_queue();
+    }
 
-void RenderSystemVulkan::Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ)
-{
-    vkCmdDispatch(CommandBuffers[CurrentFrameIdx], groupSizeX, groupSizeY, groupSizeZ);
-}
+    auto phys_ret = selector.select();
+    if (!phys_ret)
+    {
+        // std::cerr << "Failed to select Vulkan Physical Device. Error: " << phys_ret.error().message() << "\n";
+        return false;
+    }
 
-void RenderSystemVulkan::Destroy()
-{
-    vkDeviceWaitIdle(Device.Logical);
+    Device.Physical = phys_ret.value();
 
-    for (auto* shader : AllocatedShaders)
+    // Descriptor sets go to a buffer when the device can, descriptor pools otherwise
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+    DescriptorBufferActive = false;
+    if (DescriptorBufferEnabled && Device.Physical.is_extension_present(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME))
     {
-        shader->Destroy();
-        delete shader;
+        VkPhysicalDeviceFeatures2 supported{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+        supported.pNext = &descriptorBufferFeatures;
+        vkGetPhysicalDeviceFeatures2(Device.Physical, &supported);
+
+        DescriptorBufferActive = descriptorBufferFeatures.descriptorBuffer && Device.Physical.enable_extension_if_present(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
     }
-    for (auto* rendertarget : AllocatedRenderTargets)
+
+    vkb::DeviceBuilder device_builder{Device.Physical};
+    if (DescriptorBufferActive)
     {
-        rendertarget->Destroy();
-        delete rendertarget;
+        // Only the base feature, capture replay and push descriptors aren't used
+        descriptorBufferFeatures = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT };
+        descriptorBufferFeatures.descriptorBuffer = true;
+        device_builder.add_pNext(&descriptorBufferFeatures);
+
+        DescriptorBufferProperties = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 properties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        properties.pNext = &DescriptorBufferProperties;
+        vkGetPhysicalDeviceProperties2(Device.Physical, &properties);
+        DescriptorBufferProperties.pNext = nullptr;
     }
-    for (auto* descriptor_layout : AllocatedDescriptorLayouts)
+    // automatically propagate needed data from instance & physical device
+    auto dev_ret = device_builder.build();
+    if (!dev_ret)
     {
-        descriptor_layout->Destroy();
-        delete descriptor_layout;
+        // std::cerr << "Failed to create Vulkan device. Error: " << dev_ret.error().message() << "\n";
+        return false;
     }
 
-    ReleaseQueue.Release();
-}
+    Device.Logical = dev_ret.value();
 
-void RenderSystemVulkan::SetBlendState(BlendState settings)
-{
-}
+    Device.Dispatch = Device.Logical.make_table();
 
-void RenderSystemVulkan::SetDepthStencilState(DepthStencilState settings)
-{
-}
+    ReleaseQueue.Push([&]() {
+        if (CurrentWindow.vkSurface != VK_NULL_HANDLE)
+            vkb::destroy_surface(VulkanInstance, CurrentWindow.vkSurface);
+        vkb::destroy_device(Device.Logical);
+        });
 
-void RenderSystemVulkan::SetRasterizerState(RasterizerState settings)
-{
-}
+    // initialize the memory allocator
+    VmaAllocatorCreateInfo allocatorInfo = {};
+    allocatorInfo.physicalDevice = Device.Physical;
+    allocatorInfo.device = Device.Logical;
+    allocatorInfo.instance = VulkanInstance;
+    allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    vmaCreateAllocator(&allocatorInfo, &VulkanAllocator);
 
-VmaAllocator &RenderSystemVulkan::GetAllocator()
-{
-    return VulkanAllocator;
-}
+    ReleaseQueue.Push([&]() {
+        vmaDestroyAllocator(VulkanAllocator);
+        });
 
-vkb::Device &RenderSystemVulkan::GetDevice()
-{
-    return Device.Logical;
+    if (!CreatePipelineCache())
+        return false;
+
+    // Packed next to the executable by the build, loose .spv files are used without it
+    ShaderModuleCache.OpenArchive("shaders.pak");
+
+    ReleaseQueue.Push([&]() { ShaderModuleCache.Destroy(Device.Logical); });
+
+    // Stopped at the start of Destroy, before the shaders it may still be building
+    return PipelineCompiler.Init();
 }
 
-RenderUtils::DescriptorPoolHelper& RenderSystemVulkan::GetDescriptorPool()
+bool RenderSystemVulkan::CreatePipelineCache()
 {
-    return DescriptorPool;
+    // Pipelines still get created without one, just never from disk
+    if (!PipelineCache.Init(Device.Logical, Device.Physical.properties, "pipeline_cache.bin"))
+        return true;
+
+    ReleaseQueue.Push([&]() { PipelineCache.Destroy(Device.Logical); });
+
+    return true;
 }
 
 bool RenderSystemVulkan::CreateQueues()
@@ -464,6 +1607,22 @@ bool RenderSystemVulkan::CreateQueues()
 
     GraphicsQueue = graphicsResult.value();
 
+    // Prefer a queue that does nothing but copies, it runs next to rendering
+    auto transferResult = Device.Logical.get_dedicated_queue(vkb::QueueType::transfer);
+    if (!transferResult.has_value())
+        transferResult = Device.Logical.get_queue(vkb::QueueType::transfer);
+    TransferQueue = transferResult.has_value() ? transferResult.value() : GraphicsQueue;
+
+    // Async compute needs a family of its own, dispatches stay on the graphics queue otherwise
+    auto computeResult = Device.Logical.get_dedicated_queue(vkb::QueueType::compute);
+    if (!computeResult.has_value())
+        computeResult = Device.Logical.get_queue(vkb::QueueType::compute);
+    ComputeQueue = computeResult.has_value() ? computeResult.value() : VK_NULL_HANDLE;
+
+    // Nothing is presented in headless mode
+    if (Headless)
+        return true;
+
     auto presentResult = Device.Logical.get_queue(vkb::QueueType::present);
     // Device is not suited
     if (!presentResult.has_value())
@@ -503,17 +1662,16 @@ bool RenderSystemVulkan::RecreateSwapchain()
 {
     Device.Dispatch.deviceWaitIdle();
 
-    Device.Dispatch.destroyCommandPool(CommandPool, nullptr);
-
     for (auto backbuffer : BackBuffers)
     {
+        StateTracker.UnregisterImage(backbuffer.Image);
+        EvictDescriptorSets(backbuffer.ImageView);
         vkDestroyImageView(Device.Logical, backbuffer.ImageView, nullptr);
     }
 
-    if (!CreateSwapchain(CurrentWindow.Width, CurrentWindow.Height) &&
-        !CreateBackBufferObjects() &&
-        !CreateCommandPool() &&
-        !CreateCommandBuffers())
+    // Command buffers belong to frame slots, not swapchain images, so they survive the swapchain
+    if (!CreateSwapchain(CurrentWindow.Width, CurrentWindow.Height) ||
+        !CreateBackBufferObjects())
         return false;
 
     return true;
@@ -523,6 +1681,8 @@ bool RenderSystemVulkan::CreateBackBufferObjects()
 {
     BackBuffers.resize(CurrentWindow.SwapChain.image_count);
 
+    BackBufferFormat = CurrentWindow.SwapChain.image_format;
+
     Array<VkImage> images= CurrentWindow.SwapChain.get_images().value();
     Array<VkImageView> image_views = CurrentWindow.SwapChain.get_image_views().value();
 
@@ -530,6 +1690,8 @@ bool RenderSystemVulkan::CreateBackBufferObjects()
     {
         BackBuffers[i].Image = images[i];
         BackBuffers[i].ImageView = image_views[i];
+
+        StateTracker.RegisterImage(images[i], image_views[i], VK_IMAGE_ASPECT_COLOR_BIT);
     }
 
     if (!Initialized)
@@ -543,6 +1705,54 @@ bool RenderSystemVulkan::CreateBackBufferObjects()
     return true;
 }
 
+bool RenderSystemVulkan::CreateHeadlessBackBuffers()
+{
+    // Offscreen stand-ins for swapchain images, one per frame slot so a frame is never
+    // rendered into an image the GPU is still using
+    BackBuffers.resize(FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT);
+    BackBufferFormat = RenderUtils::BufferFormatToVulkan(BufferFormat::RGBA16F);
+
+    for (size_t i = 0; i < BackBuffers.size(); i++)
+    {
+        RenderTargetVk* rt = new RenderTargetVk;
+        rt->Create(BufferFormat::RGBA16F, CurrentWindow.Width, CurrentWindow.Height);
+
+        // Destroyed along with the other render targets
+        AllocatedRenderTargets.push_back(rt);
+
+        BackBuffers[i].Image = rt->GetImage();
+        BackBuffers[i].ImageView = rt->GetImageView();
+    }
+
+    return true;
+}
+
+bool RenderSystemVulkan::CreateFrameObjects()
+{
+    if (!CreateCommandPool())
+        return false;
+    if (!CreateFrameScheduler())
+        return false;
+    if (!CreateProfiler())
+        return false;
+    if (!CreateWorkgroupTuner())
+        return false;
+    if (!CreateUploadEngine())
+        return false;
+    if (!CreateAsyncCompute())
+        return false;
+    if (!CreateConstantAllocator())
+        return false;
+    if (!CreateDescriptorAllocator())
+        return false;
+    if (!CreateDescriptorBuffer())
+        return false;
+    if (!CreateBindlessHeap())
+        return false;
+
+    return true;
+}
+
 bool RenderSystemVulkan::CreateCommandPool()
 {
     VkCommandPoolCreateInfo pool_info = {};
@@ -564,71 +1774,152 @@ bool RenderSystemVulkan::CreateCommandPool()
     return true;
 }
 
-bool RenderSystemVulkan::CreateCommandBuffers()
+bool RenderSystemVulkan::CreateFrameScheduler()
+{
+    if (!FrameScheduler.Init(CommandPool, DesiredFramesInFlight))
+    {
+        // std::cout << "failed to create sync objects\n";
+        return false; // failed to create synchronization objects for the frames
+    }
+
+    ReleaseQueue.Push([&]() { FrameScheduler.Destroy(); });
+
+    return true;
+}
+
+bool RenderSystemVulkan::CreateProfiler()
+{
+    uint32_t graphicsFamily = Device.Logical.get_queue_index(vkb::QueueType::graphics).value();
+    uint32_t validBits = Device.Physical.get_queue_families()[graphicsFamily].timestampValidBits;
+
+    // Profiling is optional, rendering goes on without timestamps
+    GpuProfiler.Init(Device.Logical, Device.Physical.properties.limits.timestampPeriod, validBits);
+
+    ReleaseQueue.Push([&]() { GpuProfiler.Destroy(); });
+
+    return true;
+}
+
+bool RenderSystemVulkan::CreateWorkgroupTuner()
+{
+    uint32_t graphicsFamily = Device.Logical.get_queue_index(vkb::QueueType::graphics).value();
+    uint32_t validBits = Device.Physical.get_queue_families()[graphicsFamily].timestampValidBits;
+
+    // Without timestamps DispatchThreads keeps the sizes the shaders were written with, or ones saved earlier
+    WorkgroupTuner.Init(Device.Logical, Device.Physical.properties, validBits, "workgroup_sizes.bin");
+
+    ReleaseQueue.Push([&]() { WorkgroupTuner.Destroy(); });
+
+    return true;
+}
+
+bool RenderSystemVulkan::CreateUploadEngine()
 {
-    CommandBuffers.resize(BackBuffers.size());
+    uint32_t graphicsFamily = Device.Logical.get_queue_index(vkb::QueueType::graphics).value();
+    uint32_t transferFamily = graphicsFamily;
 
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = CommandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)CommandBuffers.size();
+    // Same family as the graphics queue when the transfer queue fell back to it
+    auto transferIndex = Device.Logical.get_dedicated_queue_index(vkb::QueueType::transfer);
+    if (!transferIndex)
+        transferIndex = Device.Logical.get_queue_index(vkb::QueueType::transfer);
+    if (transferIndex && TransferQueue != GraphicsQueue)
+        transferFamily = transferIndex.value();
 
-    if (Device.Dispatch.allocateCommandBuffers(&allocInfo, CommandBuffers.data()) != VK_SUCCESS)
+    if (!UploadEngine.Init(TransferQueue, transferFamily, graphicsFamily))
     {
-        return false; // failed to allocate command buffers;
+        // std::cout << "failed to create upload engine\n";
+        return false;
     }
 
+    ReleaseQueue.Push([&]() { UploadEngine.Destroy(); });
+
     return true;
 }
 
-bool RenderSystemVulkan::CreateSyncObjects()
+bool RenderSystemVulkan::CreateAsyncCompute()
 {
-    SwapChainSyncObjects.resize(MAX_FRAMES_IN_FLIGHT);
+    // Optional, without a compute family dispatches run inline
+    if (ComputeQueue == VK_NULL_HANDLE)
+        return true;
+
+    auto computeIndex = Device.Logical.get_dedicated_queue_index(vkb::QueueType::compute);
+    if (!computeIndex)
+        computeIndex = Device.Logical.get_queue_index(vkb::QueueType::compute);
 
-    VkSemaphoreCreateInfo semaphore_info = {};
-    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    uint32_t graphicsFamily = Device.Logical.get_queue_index(vkb::QueueType::graphics).value();
 
-    VkFenceCreateInfo fence_info = {};
-    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT; // make sure fence is already signaled
+    ReleaseQueue.Push([&]() { AsyncCompute.Destroy(); });
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    if (!computeIndex || !AsyncCompute.Init(ComputeQueue, computeIndex.value(), graphicsFamily))
     {
-        if (Device.Dispatch.createSemaphore(&semaphore_info, nullptr, &SwapChainSyncObjects[i].RenderSemaphore) != VK_SUCCESS ||
-            Device.Dispatch.createSemaphore(&semaphore_info, nullptr, &SwapChainSyncObjects[i].SwapSemaphore) != VK_SUCCESS ||
-            Device.Dispatch.createFence(&fence_info, nullptr, &SwapChainSyncObjects[i].Fence) != VK_SUCCESS)
-        {
-            // std::cout << "failed to create sync objects\n";
-            return false; // failed to create synchronization objects for a frame
-        }
+        // std::cout << "async compute unavailable, dispatching inline\n";
+        AsyncCompute.Destroy();
     }
 
-    if (!Initialized)
-        ReleaseQueue.Push([&]() {
-        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-        {
-            //destroy sync objects
-            vkDestroyFence(Device.Logical, SwapChainSyncObjects[i].Fence, nullptr);
-            vkDestroySemaphore(Device.Logical, SwapChainSyncObjects[i].RenderSemaphore, nullptr);
-            vkDestroySemaphore(Device.Logical, SwapChainSyncObjects[i].SwapSemaphore, nullptr);
-        }
-        });
+    return true;
+}
+
+bool RenderSystemVulkan::CreateConstantAllocator()
+{
+    const VkPhysicalDeviceLimits& limits = Device.Physical.properties.limits;
+
+    // Async compute reads constants too, the ring is shared instead of changing owner every frame
+    Array<uint32_t> queueFamilies = { Device.Logical.get_queue_index(vkb::QueueType::graphics).value() };
+    if (AsyncCompute.IsAvailable())
+        queueFamilies.push_back(AsyncCompute.GetComputeFamily());
+
+    if (!ConstantAllocator.Init(limits.minUniformBufferOffsetAlignment, limits.maxUniformBufferRange, queueFamilies))
+        return false;
+
+    ReleaseQueue.Push([&]() { ConstantAllocator.Destroy(); });
 
     return true;
 }
 
-bool RenderSystemVulkan::InitDescriptorPool()
+bool RenderSystemVulkan::CreateDescriptorAllocator()
 {
-    //create a descriptor pool that will hold 10 sets with 1 image each
-    Array<RenderUtils::DescriptorPoolHelper::PoolSizeRatio> sizes =
+    if (!DescriptorAllocator.Init(Device.Logical))
     {
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
-    };
+        // std::cout << "failed to create descriptor allocator\n";
+        return false;
+    }
+
+    ReleaseQueue.Push([&]() { DescriptorAllocator.Destroy(); });
+
+    return true;
+}
+
+bool RenderSystemVulkan::CreateDescriptorBuffer()
+{
+    if (!DescriptorBufferActive)
+        return true;
+
+    // Async compute binds sets too, same sharing as the constant ring
+    Array<uint32_t> queueFamilies = { Device.Logical.get_queue_index(vkb::QueueType::graphics).value() };
+    if (AsyncCompute.IsAvailable())
+        queueFamilies.push_back(AsyncCompute.GetComputeFamily());
+
+    ReleaseQueue.Push([&]() { DescriptorBuffer.Destroy(); });
+
+    if (!DescriptorBuffer.Init(Device.Logical, DescriptorBufferProperties, queueFamilies))
+    {
+        // Layouts aren't built yet, they all go to the pools instead
+        // std::cout << "failed to create descriptor buffer, using descriptor pools\n";
+        DescriptorBufferActive = false;
+    }
+
+    return true;
+}
 
-    DescriptorPool.Init(Device.Logical, 10, sizes);
+bool RenderSystemVulkan::CreateBindlessHeap()
+{
+    ReleaseQueue.Push([&]() { BindlessHeap.Destroy(); });
 
-    ReleaseQueue.Push([&]() { DescriptorPool.Destroy(Device.Logical); });
+    if (!BindlessHeap.Init(Device.Logical, Device.Physical))
+    {
+        // std::cout << "failed to create bindless heap\n";
+        return false;
+    }
 
     return true;
 }
@@ -655,36 +1946,197 @@ VkImageView& RenderSystemVulkan::GetBoundImageView()
     return BackBuffers[CurrentImageIdx].ImageView;
 }
 
-void RenderSystemVulkan::Cmd_TransitionImageLayout(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout)
+void RenderSystemVulkan::OpenPass(const RenderPassDesc& desc, bool implicit)
 {
-    VkImageMemoryBarrier2 imageBarrier{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
-    imageBarrier.pNext = nullptr;
+    VkCommandBuffer cmd = GetCommandBuffer();
 
-    imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
-    imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+    RenderTargetVk* colorRT = static_cast<RenderTargetVk*>(desc.Color.Target);
+    VkImage colorImage = colorRT ? colorRT->GetImage() : BackBuffers[CurrentImageIdx].Image;
+    VkImageView colorView = colorRT ? colorRT->GetImageView() : BackBuffers[CurrentImageIdx].ImageView;
+    VkExtent2D extent = colorRT ? colorRT->GetExtent() : VkExtent2D{ CurrentWindow.Width, CurrentWindow.Height };
+
+    AttachmentLoadOp colorLoad = desc.Color.Load;
+    VkClearValue colorClear = {};
+    colorClear.color = { desc.ClearColor.r, desc.ClearColor.g, desc.ClearColor.b, desc.ClearColor.a };
+
+    // Fold a pending ClearColor into the load op
+    if (DeferredClear.Pending && DeferredClear.Image == colorImage)
+    {
+        if (colorLoad == AttachmentLoadOp::Load)
+        {
+            colorLoad = AttachmentLoadOp::Clear;
+            colorClear.color = DeferredClear.Color;
+        }
+
+        DeferredClear.Pending = false;
+    }
+
+    ResolveDeferredClear();
+
+    if (colorLoad != AttachmentLoadOp::Load)
+        StateTracker.Discard(colorImage);
+    StateTracker.TransitionImage(colorImage, ResourceUsage::ColorAttachment);
+
+    VkRenderingAttachmentInfo colorAttachment = RenderUtils::attachment_info(colorView, colorLoad == AttachmentLoadOp::Clear ? &colorClear : nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    colorAttachment.loadOp = RenderUtils::AttachmentLoadOpToVulkan(colorLoad);
+    colorAttachment.storeOp = RenderUtils::AttachmentStoreOpToVulkan(desc.Color.Store);
+
+    RenderTargetVk* depthRT = desc.UseDepth ? static_cast<RenderTargetVk*>(desc.Depth.Target) : nullptr;
+
+    VkRenderingAttachmentInfo depthAttachment = {};
+    if (depthRT)
+    {
+        VkClearValue depthClear = {};
+        depthClear.depthStencil = { desc.ClearDepth, 0 };
+
+        if (desc.Depth.Load != AttachmentLoadOp::Load)
+            StateTracker.Discard(depthRT->GetImage());
+        StateTracker.TransitionImage(depthRT->GetImage(), ResourceUsage::DepthAttachment);
+
+        depthAttachment = RenderUtils::attachment_info(depthRT->GetImageView(), desc.Depth.Load == AttachmentLoadOp::Clear ? &depthClear : nullptr, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        depthAttachment.loadOp = RenderUtils::AttachmentLoadOpToVulkan(desc.Depth.Load);
+        depthAttachment.storeOp = RenderUtils::AttachmentStoreOpToVulkan(desc.Depth.Store);
+    }
+
+    // Every transition of the pass in one barrier, nothing can be flushed once rendering began
+    StateTracker.Flush(cmd);
+
+    VkRenderingInfo renderInfo = RenderUtils::rendering_info(extent, &colorAttachment, depthRT ? &depthAttachment : nullptr);
+    if (depthRT && RenderUtils::HasStencil(depthRT->GetFormat()))
+        renderInfo.pStencilAttachment = &depthAttachment;
+
+    vkCmdBeginRendering(cmd, &renderInfo);
+
+    // Dynamic state lives as long as the command buffer, only fill in what the frame didn't set
+    if (!ViewportSet)
+    {
+        VkViewport viewport = { 0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f };
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+    }
+
+    if (!ScissorSet)
+    {
+        VkRect2D scissor = { { 0, 0 }, extent };
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+    }
+
+    CurrentPass.Open = true;
+    CurrentPass.Implicit = implicit;
+    CurrentPass.ColorImage = colorImage;
+    CurrentPass.Extent = extent;
+
+    // Pipelines are picked by the formats they render to
+    VkFormat colorFormat = colorRT ? colorRT->GetFormat() : GetBackBufferFormat();
+    VkFormat depthFormat = depthRT ? depthRT->GetFormat() : VK_FORMAT_UNDEFINED;
+    if (colorFormat != CurrentPass.ColorFormat || depthFormat != CurrentPass.DepthFormat)
+    {
+        CurrentPass.ColorFormat = colorFormat;
+        CurrentPass.DepthFormat = depthFormat;
+        PipelineStateDirty = true;
+    }
+}
+
+void RenderSystemVulkan::CloseImplicitPass()
+{
+    if (!CurrentPass.Open || !CurrentPass.Implicit)
+        return;
+
+    vkCmdEndRendering(GetCommandBuffer());
+    CurrentPass.Open = false;
+}
+
+void RenderSystemVulkan::ResolveDeferredClear()
+{
+    if (!DeferredClear.Pending)
+        return;
+
+    DeferredClear.Pending = false;
+
+    // Nothing drew into the target, so the clear has to happen on its own
+    VkImageSubresourceRange imgClearColorRange = {};
+    imgClearColorRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imgClearColorRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    imgClearColorRange.levelCount = VK_REMAINING_MIP_LEVELS;
+
+    // the clear replaces every texel, no need to keep the old contents
+    StateTracker.Discard(DeferredClear.Image);
+    StateTracker.TransitionImage(DeferredClear.Image, ResourceUsage::TransferDst);
+    StateTracker.Flush(GetCommandBuffer());
+
+    Device.Dispatch.cmdClearColorImage(GetCommandBuffer(), DeferredClear.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &DeferredClear.Color, 1, &imgClearColorRange);
+}
+
+void RenderSystemVulkan::LeavePass()
+{
+    CloseImplicitPass();
+    ResolveDeferredClear();
+}
+
+void RenderSystemVulkan::RecordUploads(uint64_t handle)
+{
+    LeavePass();
+
+    // An earlier upload still waits in a transfer batch, its copy has to land first. Submitting it now
+    // makes this frame acquire it, and wait for it on the upload timeline.
+    if (UploadEngine.IsPending(handle))
+        UploadEngine.Submit();
+
+    UploadEngine.RecordGraphicsWork(GetCommandBuffer());
+}
+
+uint64_t RenderSystemVulkan::GetUploadFrame(bool& recordNow)
+{
+    // Copies can't be recorded inside a pass the caller opened
+    recordNow = FrameRecording && !(CurrentPass.Open && !CurrentPass.Implicit);
+
+    // Outside of a frame the copies wait for the next BeginRendering, which starts the next frame number
+    return FrameScheduler.GetCurrentFrame() + (recordNow ? 0 : 1);
+}
+
+void RenderSystemVulkan::SplitFrame(uint64_t forkValue)
+{
+    VkCommandBuffer cmd = GetCommandBuffer();
+
+    if (forkValue)
+    {
+        // The fork is signalled once this part has run. Later parts wait for it where they touch the back buffer or
+        // uploaded data, so the swapchain and upload waits of the first part have to chain into the signal.
+        VkMemoryBarrier2 chain = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+        chain.srcStageMask = SWAPCHAIN_WAIT_STAGES | UploadEngineVk::CONSUMER_STAGES;
+        chain.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+        depInfo.memoryBarrierCount = 1;
+        depInfo.pMemoryBarriers = &chain;
+        Device.Dispatch.cmdPipelineBarrier2(cmd, &depInfo);
+    }
 
-    imageBarrier.oldLayout = currentLayout;
-    imageBarrier.newLayout = newLayout;
+    Device.Dispatch.endCommandBuffer(cmd);
 
-    VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-    VkImageSubresourceRange imgSubresourceRange = {};
-    imgSubresourceRange.aspectMask = aspectMask;
-    imgSubresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-    imgSubresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    FrameSegments.push_back({ cmd, forkValue, SegmentJoinValue });
+    SegmentJoinValue = 0;
 
-    imageBarrier.subresourceRange = imgSubresourceRange;
-    imageBarrier.image = image;
+    cmd = FrameScheduler.NextCommandBuffer();
+    Device.Dispatch.resetCommandBuffer(cmd, 0);
 
-    VkDependencyInfo depInfo{};
-    depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-    depInfo.pNext = nullptr;
+    VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    Device.Dispatch.beginCommandBuffer(cmd, &beginInfo);
 
-    depInfo.imageMemoryBarrierCount = 1;
-    depInfo.pImageMemoryBarriers = &imageBarrier;
+    // Nothing is bound on a fresh command buffer, viewport and scissor the caller set carry over
+    BoundPipeline = VK_NULL_HANDLE;
+    PipelineStateDirty = true;
+    DynamicStateDirty = true;
+    BoundVertexBuffer = VK_NULL_HANDLE;
+    BoundIndexBuffer = VK_NULL_HANDLE;
+    BindlessGraphicsBound = false;
+    BindlessComputeBound = false;
+    DescriptorBufferBound = false;
 
-    Device.Dispatch.cmdPipelineBarrier2(cmd, &depInfo);
+    if (ViewportSet)
+        SetViewport(CurrentViewport);
+    if (ScissorSet)
+        SetScissorRectangle(CurrentScissor);
 }
 
 void RenderSystemVulkan::Cmd_BlitImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize)
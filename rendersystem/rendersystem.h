@@ -5,10 +5,30 @@
 #include "utils.h"
 #include "shader.h"
 #include "rendertarget.h"
+#include "rendertargetpool.h"
 #include "descriptorsets.h"
+#include "framescheduler.h"
+#include "gpuprofiler.h"
+#include "commandcontext.h"
+#include "resourcestate.h"
+#include "framegraph.h"
+#include "buffer.h"
+#include "uploadengine.h"
+#include "asynccompute.h"
+#include "constantallocator.h"
+#include "pipelinecache.h"
+#include "pipelinecompiler.h"
+#include "shadermodulecache.h"
+#include "shaderwatcher.h"
+#include "workgrouptuner.h"
+#include "bindlessheap.h"
+#include "descriptorallocator.h"
+#include "descriptorbuffer.h"
 
 #include "vk_mem_alloc.h"
 
+#include <mutex>
+
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include "Windows.h"
@@ -45,12 +65,26 @@ public:
 	virtual bool Create();
 
 	virtual void AttachWindow(void *window_handle, int w, int h);
+	virtual void AttachHeadless(int w, int h);
 
 	virtual IRenderTarget* CreateRenderTarget(BufferFormat fmt, int width, int height);
+	virtual IRenderTarget* AcquireRenderTarget(BufferFormat fmt, int width, int height);
+	virtual void ReleaseRenderTarget(IRenderTarget* target);
+	virtual void SetRenderTargetEviction(uint32_t frames);
 	virtual IDescriptorLayout* BuildDescriptorLayout(uint32_t numEntries, DescriptorLayoutEntry* entries);
 	virtual IDescriptorSet* BuildDescriptorSet(IDescriptorLayout* layout);
+	virtual IDescriptorSet* BuildTransientDescriptorSet(IDescriptorLayout* layout);
+	virtual IDescriptorLayout* GetBindlessLayout();
 	virtual IShader* CreateShader();
+	virtual IFrameGraph* CreateFrameGraph();
+	virtual IVertexBuffer* CreateVertexBuffer(uint32_t size, uint32_t stride, BufferUsageHint usage, const void* data = nullptr);
+	virtual IIndexBuffer* CreateIndexBuffer(uint32_t size, IndexFormat format, BufferUsageHint usage, const void* data = nullptr);
 	virtual HShader LoadShaderModule(const char* filepath);
+	virtual void ReleaseShaderModule(HShader module);
+	virtual void WaitForPipelines();
+	virtual void SetShaderHotReload(bool enable);
+	virtual bool UploadRenderTarget(IRenderTarget* target, const void* data, uint32_t size);
+	virtual void* AllocateConstants(uint32_t size, uint32_t& offset);
 
 	// Begin rendering
 	virtual void BeginRendering();
@@ -61,6 +95,9 @@ public:
 	virtual void SetClearColor(ColorFloat &color);
 	virtual void ClearColor();
 
+	virtual void BeginPass(const RenderPassDesc &desc);
+	virtual void EndPass();
+
 	// Set the render target
 	// Set nullptr to clear
 	virtual void SetRenderTarget(IRenderTarget *target);
@@ -75,7 +112,10 @@ public:
 	// Set to nullptr to clear
 	virtual void BindShader(IShader* shader, PipelineBindPoint point);
 
-	virtual void BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point);
+	virtual void BindDescriptorSet(IDescriptorSet* set, PipelineBindPoint point, const uint32_t* constantOffsets = nullptr, uint32_t numOffsets = 0);
+
+	virtual void UseBindlessTarget(IRenderTarget* target, FrameGraphAccess access);
+	virtual void SetPushConstants(const void* data, uint32_t size, uint32_t offset = 0);
 
 	// Set the vertex buffer
 	virtual void SetVertexBuffer(IVertexBuffer *buffer);
@@ -87,7 +127,7 @@ public:
 	virtual void DrawPrimitive(int first_vertex, int vertex_count);
 
 	// Draw indexed primitives
-	virtual void DrawIndexedPrimitives(int index_count);
+	virtual void DrawIndexedPrimitives(int index_count, int first_index = 0, int base_vertex = 0, int instance_count = 1, int first_instance = 0);
 
 	virtual void CopyRenderTargetToBackBuffer();
 
@@ -96,10 +136,38 @@ public:
 
 	// Compute Dispatch
 	virtual void Dispatch(int groupSizeX, int groupSizeY, int groupSizeZ);
+	virtual void DispatchThreads(uint32_t threadsX, uint32_t threadsY, uint32_t threadsZ);
+
+	// Async compute
+	virtual void BeginAsyncCompute();
+	virtual void EndAsyncCompute();
+	virtual void WaitAsyncCompute();
+
+	// Multithreaded recording
+	virtual ICommandContext* AcquireCommandContext();
+	virtual void ExecuteCommandContexts(ICommandContext** contexts, uint32_t count);
 
 	// Destroy the rendering system
 	virtual void Destroy();
 
+	// Frame pacing
+	virtual void SetFramesInFlight(int count);
+	virtual int GetFramesInFlight();
+	virtual void SetDescriptorBufferEnabled(bool enable);
+	virtual bool IsDescriptorBufferActive();
+	virtual uint64_t GetCurrentFrame();
+	virtual uint64_t GetCompletedFrame();
+	virtual bool WaitForFrame(uint64_t frame, uint64_t timeoutNs = UINT64_MAX);
+
+	// GPU profiling
+	virtual void BeginGpuScope(const char* name);
+	virtual void EndGpuScope();
+	virtual uint32_t GetGpuScopeTimings(GpuScopeTiming* timings, uint32_t maxCount, uint64_t* frame = nullptr);
+	virtual bool WriteGpuTrace(const char* filepath);
+
+	// Pipeline cache
+	virtual PipelineCacheStats GetPipelineCacheStats();
+
 	// Set the blend state
 	virtual void SetBlendState(BlendState settings);
 
@@ -111,26 +179,88 @@ public:
 
 	VmaAllocator &GetAllocator();
 	vkb::Device &GetDevice();
-	RenderUtils::DescriptorPoolHelper& GetDescriptorPool();
+	DescriptorAllocatorVk& GetDescriptorAllocator();
+	DescriptorBufferVk& GetDescriptorBuffer();
+	FrameSchedulerVk& GetFrameScheduler();
+	ResourceStateTracker& GetStateTracker();
+	ConstantAllocatorVk& GetConstantAllocator();
+	PipelineCacheVk& GetPipelineCache();
+	PipelineCompilerVk& GetPipelineCompiler();
+	ShaderModuleCacheVk& GetShaderModuleCache();
+	WorkgroupTunerVk& GetWorkgroupTuner();
+	BindlessHeapVk& GetBindlessHeap();
+
+	// Before an image view is destroyed, cached descriptor sets reading it must not be handed out again
+	void EvictDescriptorSets(VkImageView view);
+
+	// Emit the barriers queued on the state tracker into the frame's command buffer
+	void FlushBarriers();
+
+	// Stream data into a buffer through the upload engine, fresh buffers were never used by a frame
+	bool UploadBuffer(VkBuffer dst, VkDeviceSize offset, const void* data, VkDeviceSize size, bool fresh);
+
+	VkImage GetBackBufferImage();
+	VkImageView GetBackBufferView();
+	VkFormat GetBackBufferFormat();
+	VkExtent2D GetBackBufferExtent();
 
 private:
+	bool CreateDevice();
+	bool CreatePipelineCache();
 	bool CreateQueues();
 	bool CreateSwapchain(int w, int h);
 	bool RecreateSwapchain();
 
 	bool CreateBackBufferObjects();
+	bool CreateHeadlessBackBuffers();
+	bool CreateFrameObjects();
 
 	bool CreateCommandPool();
-	bool CreateCommandBuffers();
+	bool CreateFrameScheduler();
+	bool CreateProfiler();
+	bool CreateWorkgroupTuner();
+	bool CreateUploadEngine();
+	bool CreateAsyncCompute();
+	bool CreateConstantAllocator();
 
-	bool CreateSyncObjects();
+	bool CreateDescriptorAllocator();
+	bool CreateDescriptorBuffer();
+	bool CreateBindlessHeap();
 
-	bool InitDescriptorPool();
+	// Primary command buffer of the frame being recorded
+	VkCommandBuffer GetCommandBuffer() { return FrameScheduler.GetCurrentSlot().CommandBuffer; }
 
 	VkImage &GetBoundImage();
 	VkImageView& GetBoundImageView();
 
-	void Cmd_TransitionImageLayout(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
+	// Open a pass if needed and bind the pipeline of the bound shader, false when there is nothing to draw with
+	bool PrepareDraw();
+
+	void OpenPass(const RenderPassDesc& desc, bool implicit);
+	void CloseImplicitPass();
+	void ResolveDeferredClear();
+
+	// Before commands that can't run inside a render pass
+	void LeavePass();
+
+	// Once per command buffer and bind point, unless a descriptor set replaced it
+	void BindBindlessHeap(PipelineBindPoint point);
+
+	// Dispatch with the bound compute shader, or a variant of it that is bound for just this dispatch.
+	// Timed for the workgroup tuner when the sample isn't NO_SAMPLE.
+	void RecordDispatch(VkPipeline variant, uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ, uint32_t sample);
+
+	// Graphics queue copies are recorded right away when the frame can take them, otherwise at the start of the next one.
+	// Returns the frame they land in.
+	uint64_t GetUploadFrame(bool& recordNow);
+
+	// Record the queued graphics copies now, acquiring the resource first when its transfer upload is still pending
+	void RecordUploads(uint64_t handle);
+
+	// End the command buffer being recorded and continue the frame in another one, submitted as its own batch.
+	// The ended part signals the fork value when it isn't 0.
+	void SplitFrame(uint64_t forkValue);
+
 	void Cmd_BlitImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize, VkExtent2D dstSize);
 
 	vkb::Instance VulkanInstance;
@@ -138,11 +268,14 @@ private:
 	// Make sure we dont push items to release queue multiple times when recreating swapchain
 	bool Initialized = false;
 
+	// No window or swapchain, back buffers are offscreen render targets
+	bool Headless = false;
+
 	struct RenderWindow
 	{
 		void *Handle = nullptr;
 		vkb::Swapchain SwapChain = {};
-		VkSurfaceKHR vkSurface;
+		VkSurfaceKHR vkSurface = VK_NULL_HANDLE;
 
 		uint32_t Width, Height;
 	} CurrentWindow;
@@ -150,21 +283,19 @@ private:
 	Viewport CurrentViewport;
 	ScissorRectangle CurrentScissor;
 
-	// Current swapchain frame, updated by rendersystem
-	uint32_t CurrentFrameIdx = 0;
-
 	// Current swapchain image we are rendering to, retrieved from swapchain
 	uint32_t CurrentImageIdx = 0;
 
 	// This is the main backbuffer of the window surface.
 	// When no render target is assigned, this is what is used.
-	// We have 1 for each swapchain image
+	// We have 1 for each swapchain image, or 1 for each frame in flight when headless
 	struct BackbufferInfo
 	{
 		VkImage Image;
 		VkImageView ImageView;
 	};
 	Array<BackbufferInfo> BackBuffers;
+	VkFormat BackBufferFormat = VK_FORMAT_UNDEFINED;
 
 	struct DeviceStore
 	{
@@ -176,29 +307,164 @@ private:
 	VkQueue GraphicsQueue;
 	VkQueue PresentQueue;
 
+	// Dedicated transfer queue when the device has one, the graphics queue otherwise
+	VkQueue TransferQueue;
+
+	// Separate compute family when the device has one, null otherwise
+	VkQueue ComputeQueue = VK_NULL_HANDLE;
+
 	VkCommandPool CommandPool;
-	Array<VkCommandBuffer> CommandBuffers; // one for each framebuffer
+
+	// Staging ring and transfer queue batches, frames wait on its timeline for what they acquire
+	UploadEngineVk UploadEngine;
+
+	// Per-frame constants, bound through dynamic uniform buffer offsets
+	ConstantAllocatorVk ConstantAllocator;
+
+	// Last upload timeline value a frame submission waited for
+	uint64_t WaitedUploadValue = 0;
+
+	// Between BeginRendering and EndRendering
+	bool FrameRecording = false;
+
+	AsyncComputeVk AsyncCompute;
+
+	// Between BeginAsyncCompute and EndAsyncCompute
+	bool AsyncComputeOpen = false;
+
+	// Parts of the frame ended by a fork or join, submitted in order with the last one at EndRendering
+	struct FrameSegment
+	{
+		VkCommandBuffer CommandBuffer;
+		uint64_t ForkValue; // signalled when the part has run
+		uint64_t JoinValue; // async compute value waited for before the part runs
+	};
+	Array<FrameSegment> FrameSegments;
+
+	// Async compute value the part being recorded waits for
+	uint64_t SegmentJoinValue = 0;
 
 	VkClearColorValue ClearColorValue;
 	VkClearValue ClearValue;
 
-	struct SwapSyncObjects
+	// Owns the per-frame command buffers and sync, paced by a timeline semaphore
+	FrameSchedulerVk FrameScheduler;
+
+	// Applied when the scheduler is created, or immediately once it exists
+	int DesiredFramesInFlight = 2;
+
+	GpuProfilerVk GpuProfiler;
+
+	// Picks the workgroup sizes of DispatchThreads, timed with the frame's own dispatches
+	WorkgroupTunerVk WorkgroupTuner;
+
+	// Layouts and last use of every image, turned into batched barriers right before the commands that need them
+	ResourceStateTracker StateTracker;
+
+	// Contexts are created on demand and recycled once executed
+	std::mutex CommandContextMutex;
+	Array<CommandContextVk*> AllocatedCommandContexts;
+	Array<CommandContextVk*> FreeCommandContexts;
+
+	VmaAllocator VulkanAllocator;
+
+	// Shared by every pipeline, persisted between runs
+	PipelineCacheVk PipelineCache;
+
+	// Builds pipelines in the background
+	PipelineCompilerVk PipelineCompiler;
+
+	// Shader modules shared between shaders, outlive the shaders using them
+	ShaderModuleCacheVk ShaderModuleCache;
+
+	// Hot reload. Files that changed wait here while a shader using them is still building.
+	ShaderWatcher ShaderFileWatcher;
+	Array<String> PendingShaderReloads;
+
+	// Replaced by a reload, destroyed once the last frame that may use them is complete
+	struct RetiredPipeline
 	{
-		VkSemaphore SwapSemaphore;
-		VkSemaphore RenderSemaphore;
-		VkFence Fence;
+		VkPipeline Pipeline;
+		VkPipelineLayout Layout;
+		uint64_t Frame;
 	};
-	Array<SwapSyncObjects> SwapChainSyncObjects;
+	Array<RetiredPipeline> RetiredPipelines;
 
-	VmaAllocator VulkanAllocator;
+	// At the start of a frame, before anything is bound
+	void ProcessShaderReloads();
 
 	RenderTargetVk* BoundRenderTarget = nullptr;
 	Array<RenderTargetVk*> AllocatedRenderTargets;
+
+	// Intermediate targets handed out again once the GPU is done with them
+	RenderTargetPoolVk RenderTargetPool;
 	Array<ShaderVk*> AllocatedShaders;
 	Array<DescriptorLayoutVk*> AllocatedDescriptorLayouts;
-	RenderUtils::DescriptorPoolHelper DescriptorPool;
+	Array<FrameGraphVk*> AllocatedFrameGraphs;
+	Array<VertexBufferVk*> AllocatedVertexBuffers;
+	Array<IndexBufferVk*> AllocatedIndexBuffers;
+
+	// Pages of descriptor pools, transient sets go back in bulk when their frame slot comes around again
+	DescriptorAllocatorVk DescriptorAllocator;
+
+	// Transient set objects of each frame slot, handed out again once the slot is reused
+	struct TransientSetPool
+	{
+		Array<DescriptorSetVk*> Sets;
+		uint32_t Used = 0;
+	};
+	std::mutex TransientSetMutex;
+	ConstArray<TransientSetPool, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT> TransientSets;
+
+	// Replaces the pools for every layout built while it is active, decided when the device is created
+	DescriptorBufferVk DescriptorBuffer;
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT DescriptorBufferProperties = {};
+	bool DescriptorBufferEnabled = true;
+	bool DescriptorBufferActive = false;
+	bool DescriptorBufferBound = false;
+	bool DescriptorBufferAsyncBound = false;
+
+	// Every render target and buffer, reached by index from shaders built against it
+	BindlessHeapVk BindlessHeap;
+	bool BindlessGraphicsBound = false;
+	bool BindlessComputeBound = false;
+	bool BindlessAsyncBound = false;
 
 	ShaderVk* BoundShader = nullptr;
+	bool BoundShaderReady = false; // sampled at bind, a shader that becomes ready later is bound again
+	VkPipeline BoundPipeline = VK_NULL_HANDLE;
+	VkBuffer BoundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer BoundIndexBuffer = VK_NULL_HANDLE;
+
+	// Rendering instance that is open on the frame command buffer
+	struct PassState
+	{
+		bool Open = false;
+		bool Implicit = false; // opened by a draw, closed by whatever can't run inside it
+		VkImage ColorImage = VK_NULL_HANDLE;
+		VkExtent2D Extent = {};
+		VkFormat ColorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+	} CurrentPass;
+
+	// Blend state picks the pipeline variant, depth and raster state are recorded as dynamic state
+	BlendState CurrentBlend;
+	DepthStencilState CurrentDepthStencil;
+	RasterizerState CurrentRasterizer;
+	bool PipelineStateDirty = true;
+	bool DynamicStateDirty = true;
+
+	// ClearColor outside of a pass, becomes the load op of the next pass on that image
+	struct DeferredClearState
+	{
+		bool Pending = false;
+		VkImage Image = VK_NULL_HANDLE;
+		VkClearColorValue Color = {};
+	} DeferredClear;
+
+	// Passes only set a full target viewport and scissor when the frame didn't set its own
+	bool ViewportSet = false;
+	bool ScissorSet = false;
 };
 
 extern Modules::DeclareModule<RenderSystemVulkan> rendersystem;
\ No newline at end of file
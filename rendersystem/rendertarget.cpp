@@ -3,19 +3,36 @@
 #include "utils.h"
 #include "rendersystem.h"
 
-void RenderTargetVk::Create(BufferFormat fmt, int width, int height)
+static VkImageUsageFlags GetImageUsage(VkFormat format)
 {
-	renderFormat = RenderUtils::BufferFormatToVulkan(fmt);
-	imageExtent.width = width;
-	imageExtent.height = height;
+	// depth formats can't be storage images
+	if (RenderUtils::IsDepthFormat(format))
+		return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 	VkImageUsageFlags drawImageUsages{};
 	drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 	drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
+	drawImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
 	drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	return drawImageUsages;
+}
+
+static VkImageAspectFlags GetImageAspect(VkFormat format)
+{
+	if (!RenderUtils::IsDepthFormat(format))
+		return VK_IMAGE_ASPECT_COLOR_BIT;
 
-	VkImageCreateInfo imgInfo = RenderUtils::image_create_info(renderFormat, drawImageUsages, { imageExtent.width, imageExtent.height, 1 });
+	return RenderUtils::HasStencil(format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+void RenderTargetVk::Create(BufferFormat fmt, int width, int height)
+{
+	renderFormat = RenderUtils::BufferFormatToVulkan(fmt);
+	imageExtent.width = width;
+	imageExtent.height = height;
+
+	VkImageCreateInfo imgInfo = RenderUtils::image_create_info(renderFormat, GetImageUsage(renderFormat), { imageExtent.width, imageExtent.height, 1 });
 
 	//for the render target, we want to allocate it from gpu local memory
 	VmaAllocationCreateInfo rimg_allocinfo = {};
@@ -26,15 +43,74 @@ void RenderTargetVk::Create(BufferFormat fmt, int width, int height)
 	vmaCreateImage(rendersystem->GetAllocator(), &imgInfo, &rimg_allocinfo, &renderImage, &allocation, nullptr);
 
 	//build a image-view for the draw image to use for rendering
-	VkImageViewCreateInfo rview_info = RenderUtils::imageview_create_info(renderFormat, renderImage, VK_IMAGE_ASPECT_COLOR_BIT);
+	VkImageViewCreateInfo rview_info = RenderUtils::imageview_create_info(renderFormat, renderImage, GetImageAspect(renderFormat));
 
 	vkCreateImageView(rendersystem->GetDevice(), &rview_info, nullptr, &imageView);
+
+	rendersystem->GetStateTracker().RegisterImage(renderImage, imageView, GetImageAspect(renderFormat));
+	RegisterBindless();
+}
+
+bool RenderTargetVk::CreateAliased(BufferFormat fmt, int width, int height)
+{
+	renderFormat = RenderUtils::BufferFormatToVulkan(fmt);
+	imageExtent.width = width;
+	imageExtent.height = height;
+	aliased = true;
+
+	VkImageCreateInfo imgInfo = RenderUtils::image_create_info(renderFormat, GetImageUsage(renderFormat), { imageExtent.width, imageExtent.height, 1 });
+
+	return vkCreateImage(rendersystem->GetDevice(), &imgInfo, nullptr, &renderImage) == VK_SUCCESS;
+}
+
+void RenderTargetVk::GetMemoryRequirements(VkMemoryRequirements& requirements)
+{
+	vkGetImageMemoryRequirements(rendersystem->GetDevice(), renderImage, &requirements);
+}
+
+bool RenderTargetVk::BindAliasedMemory(VmaAllocation memory, VkDeviceSize offset)
+{
+	if (vmaBindImageMemory2(rendersystem->GetAllocator(), memory, offset, renderImage, nullptr) != VK_SUCCESS)
+		return false;
+
+	VkImageViewCreateInfo rview_info = RenderUtils::imageview_create_info(renderFormat, renderImage, GetImageAspect(renderFormat));
+
+	if (vkCreateImageView(rendersystem->GetDevice(), &rview_info, nullptr, &imageView) != VK_SUCCESS)
+		return false;
+
+	rendersystem->GetStateTracker().RegisterImage(renderImage, imageView, GetImageAspect(renderFormat));
+	RegisterBindless();
+	return true;
+}
+
+void RenderTargetVk::RegisterBindless()
+{
+	BindlessHeapVk& heap = rendersystem->GetBindlessHeap();
+
+	// Depth can't be a storage image, and a view with stencil in it can't be sampled
+	if (!RenderUtils::IsDepthFormat(renderFormat))
+		StorageIndex = heap.RegisterStorageImage(imageView);
+	if (!RenderUtils::HasStencil(renderFormat))
+		SampledIndex = heap.RegisterSampledImage(imageView);
 }
 
 void RenderTargetVk::Destroy()
 {
+	rendersystem->GetStateTracker().UnregisterImage(renderImage);
+
+	BindlessHeapVk& heap = rendersystem->GetBindlessHeap();
+	heap.Release(BindlessHeapVk::STORAGE_IMAGE_BINDING, StorageIndex);
+	heap.Release(BindlessHeapVk::SAMPLED_IMAGE_BINDING, SampledIndex);
+	StorageIndex = BINDLESS_INVALID_INDEX;
+	SampledIndex = BINDLESS_INVALID_INDEX;
+
+	rendersystem->EvictDescriptorSets(imageView);
 	vkDestroyImageView(rendersystem->GetDevice(), imageView, nullptr);
-	vmaDestroyImage(rendersystem->GetAllocator(), renderImage, allocation);
+
+	if (aliased)
+		vkDestroyImage(rendersystem->GetDevice(), renderImage, nullptr);
+	else
+		vmaDestroyImage(rendersystem->GetAllocator(), renderImage, allocation);
 }
 
 HImage RenderTargetVk::GetHardwareImage()
@@ -57,6 +133,16 @@ VkImageView& RenderTargetVk::GetImageView()
 	return imageView;
 }
 
+VkFormat RenderTargetVk::GetFormat()
+{
+	return renderFormat;
+}
+
+VkExtent2D RenderTargetVk::GetExtent()
+{
+	return imageExtent;
+}
+
 void RenderTargetVk::GetExtent(int& width, int& height)
 {
 	width = imageExtent.width;
@@ -7,18 +7,37 @@ class RenderTargetVk : public IRenderTarget
 public:
 
 	virtual void Create(BufferFormat fmt, int width, int height);
+
+	// Image without memory, placed later into memory shared with other render targets
+	bool CreateAliased(BufferFormat fmt, int width, int height);
+	void GetMemoryRequirements(VkMemoryRequirements& requirements);
+	bool BindAliasedMemory(VmaAllocation memory, VkDeviceSize offset);
 	virtual void Destroy();
 	virtual HImage GetHardwareImage();
 	virtual HImageView GetHardwareImageView();
+	virtual uint32_t GetStorageIndex() { return StorageIndex; }
+	virtual uint32_t GetSampledIndex() { return SampledIndex; }
 
 	VkImage& GetImage();
 	VkImageView& GetImageView();
+	VkFormat GetFormat();
+	VkExtent2D GetExtent();
 	void GetExtent(int &width, int &height);
 
 private:
-	VkImage renderImage;
-	VkImageView imageView;
+
+	// Once the view exists
+	void RegisterBindless();
+
+	VkImage renderImage = VK_NULL_HANDLE;
+	VkImageView imageView = VK_NULL_HANDLE;
 	VkFormat renderFormat;
 	VkExtent2D imageExtent;
-	VmaAllocation allocation;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+
+	// Memory belongs to whoever placed the image
+	bool aliased = false;
+
+	uint32_t StorageIndex = BINDLESS_INVALID_INDEX;
+	uint32_t SampledIndex = BINDLESS_INVALID_INDEX;
 };
\ No newline at end of file
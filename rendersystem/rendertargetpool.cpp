@@ -0,0 +1,119 @@
+#include "common_stl.h"
+#include "rendertargetpool.h"
+#include "rendersystem.h"
+#include "utils.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
+
+void RenderTargetPoolVk::Destroy()
+{
+	for (auto& [key, targets] : FreeTargets)
+	{
+		for (FreeTarget& free : targets)
+		{
+			free.Target->Destroy();
+			delete free.Target;
+		}
+	}
+	FreeTargets.clear();
+
+	for (RenderTargetVk* target : UsedTargets)
+	{
+		target->Destroy();
+		delete target;
+	}
+	UsedTargets.clear();
+}
+
+void RenderTargetPoolVk::BeginFrame()
+{
+	if (EvictAfterFrames == 0)
+		return;
+
+	TRACE_SCOPE("EvictRenderTargets");
+
+	uint64_t currentFrame = rendersystem->GetCurrentFrame();
+	uint64_t completedFrame = rendersystem->GetCompletedFrame();
+
+	for (auto iter = FreeTargets.begin(); iter != FreeTargets.end();)
+	{
+		Array<FreeTarget>& targets = iter->second;
+
+		auto unused = [&](const FreeTarget& free)
+		{
+			return free.Frame <= completedFrame && free.Frame + EvictAfterFrames < currentFrame;
+		};
+
+		for (FreeTarget& free : targets)
+		{
+			if (!unused(free))
+				continue;
+
+			free.Target->Destroy();
+			delete free.Target;
+		}
+		std::erase_if(targets, unused);
+
+		if (targets.empty())
+			iter = FreeTargets.erase(iter);
+		else
+			++iter;
+	}
+}
+
+RenderTargetVk* RenderTargetPoolVk::Acquire(BufferFormat fmt, int width, int height)
+{
+	RenderTargetKey key = { RenderUtils::BufferFormatToVulkan(fmt), (uint32_t)width, (uint32_t)height };
+
+	RenderTargetVk* target = nullptr;
+
+	auto iter = FreeTargets.find(key);
+	if (iter != FreeTargets.end())
+	{
+		// Most recently released first, the ones left over age out
+		Array<FreeTarget>& targets = iter->second;
+		uint64_t completedFrame = rendersystem->GetCompletedFrame();
+
+		for (size_t i = targets.size(); i-- > 0;)
+		{
+			if (targets[i].Frame > completedFrame)
+				continue;
+
+			target = targets[i].Target;
+			targets.erase(targets.begin() + i);
+			break;
+		}
+	}
+
+	if (target)
+	{
+		// Whatever the last user left in it is not kept, the first use transitions from undefined
+		rendersystem->GetStateTracker().Discard(target->GetImage());
+	}
+	else
+	{
+		target = new RenderTargetVk;
+		target->Create(fmt, width, height);
+	}
+
+	UsedTargets.push_back(target);
+	return target;
+}
+
+void RenderTargetPoolVk::Release(RenderTargetVk* target)
+{
+	auto iter = std::find(UsedTargets.begin(), UsedTargets.end(), target);
+	if (iter == UsedTargets.end())
+	{
+		// std::cout << "render target was not acquired from the pool\n";
+		return;
+	}
+
+	UsedTargets.erase(iter);
+
+	VkExtent2D extent = target->GetExtent();
+	RenderTargetKey key = { target->GetFormat(), extent.width, extent.height };
+
+	FreeTargets[key].push_back({ target, rendersystem->GetCurrentFrame() });
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "rendertarget.h"
+#include "libcommon/hash.h"
+
+// What makes pooled targets interchangeable. Usage follows from the format and every target is single sampled,
+// so neither is part of it.
+struct RenderTargetKey
+{
+	VkFormat Format;
+	uint32_t Width;
+	uint32_t Height;
+
+	bool operator==(const RenderTargetKey& other) const = default;
+};
+
+template<>
+struct std::hash<RenderTargetKey>
+{
+	size_t operator()(const RenderTargetKey& key) const
+	{
+		uint64_t hash = Hash::Combine(Hash::FNV_OFFSET_BASIS, key.Format);
+		hash = Hash::Combine(hash, key.Width);
+		return (size_t)Hash::Combine(hash, key.Height);
+	}
+};
+
+// Render targets handed out by format and extent, for intermediate targets asked for every frame.
+// Released targets are handed out again once the frame that released them is complete, so reuse never needs more
+// than a discard of the old contents. Targets left unused for a while are destroyed, when eviction is on.
+class RenderTargetPoolVk
+{
+public:
+	static constexpr uint32_t DEFAULT_EVICT_AFTER_FRAMES = 120;
+
+	void Destroy();
+
+	// Destroy targets released more than the eviction age ago, the GPU is done with them
+	void BeginFrame();
+
+	// Main thread only. A free target with the same key, a new one when none is done on the GPU yet.
+	// Contents are undefined either way.
+	RenderTargetVk* Acquire(BufferFormat fmt, int width, int height);
+
+	// Main thread only. Free for reuse once the frame being recorded is complete
+	void Release(RenderTargetVk* target);
+
+	// Frames a free target is kept around unused, 0 keeps them until shutdown
+	void SetEvictAfterFrames(uint32_t frames) { EvictAfterFrames = frames; }
+
+private:
+
+	struct FreeTarget
+	{
+		RenderTargetVk* Target;
+		uint64_t Frame;
+	};
+
+	// In release order, the GPU is done with the front ones first
+	Dict<RenderTargetKey, Array<FreeTarget>> FreeTargets;
+	Array<RenderTargetVk*> UsedTargets;
+
+	uint32_t EvictAfterFrames = DEFAULT_EVICT_AFTER_FRAMES;
+};
\ No newline at end of file
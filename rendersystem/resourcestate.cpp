@@ -0,0 +1,240 @@
+#include "common_stl.h"
+#include "resourcestate.h"
+
+static constexpr VkAccessFlags2 WRITE_ACCESS_MASK =
+	VK_ACCESS_2_SHADER_WRITE_BIT |
+	VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_TRANSFER_WRITE_BIT |
+	VK_ACCESS_2_HOST_WRITE_BIT |
+	VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+ResourceStateTracker::UsageInfo ResourceStateTracker::GetUsageInfo(ResourceUsage usage)
+{
+	switch (usage)
+	{
+	case ResourceUsage::ColorAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT };
+	case ResourceUsage::DepthAttachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	case ResourceUsage::ComputeStorage:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+	case ResourceUsage::GraphicsStorage:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT };
+	case ResourceUsage::ShaderRead:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT };
+	case ResourceUsage::TransferSrc:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT };
+	case ResourceUsage::TransferDst:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT };
+	case ResourceUsage::Present:
+		// presentation is synchronized by the semaphore, nothing to wait for on the queue
+		return { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE };
+	case ResourceUsage::Undefined:
+	default:
+		return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE };
+	}
+}
+
+void ResourceStateTracker::RegisterImage(VkImage image, VkImageView view, VkImageAspectFlags aspect)
+{
+	ImageState& state = Images[image];
+	state = ImageState{};
+	state.Aspect = aspect;
+
+	if (view != VK_NULL_HANDLE)
+		Views[view] = image;
+}
+
+void ResourceStateTracker::UnregisterImage(VkImage image)
+{
+	for (auto iter = Views.begin(); iter != Views.end();)
+	{
+		if (iter->second == image)
+			iter = Views.erase(iter);
+		else
+			++iter;
+	}
+
+	Images.erase(image);
+}
+
+void ResourceStateTracker::Discard(VkImage image, VkPipelineStageFlags2 stage, VkAccessFlags2 access)
+{
+	auto iter = Images.find(image);
+	if (iter == Images.end())
+		return;
+
+	ImageState& state = iter->second;
+
+	// Whoever prepared it already picked the layout, at most the old contents can still be dropped
+	if (state.Prepared)
+	{
+		if (state.PendingBarrier >= 0)
+			PendingBarriers[state.PendingBarrier].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		return;
+	}
+
+	state.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// Earlier readers and writers still have to finish before the image is overwritten
+	state.Stage |= stage;
+	state.Access |= access;
+
+	if (state.PendingBarrier >= 0)
+		PendingBarriers[state.PendingBarrier].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+void ResourceStateTracker::TransitionImage(VkImage image, ResourceUsage usage)
+{
+	auto iter = Images.find(image);
+	if (iter == Images.end())
+		return;
+
+	ImageState& state = iter->second;
+	UsageInfo next = GetUsageInfo(usage);
+
+	state.Used = true;
+
+	if (state.Prepared)
+	{
+		state.Prepared = false;
+
+		// Already waited for when it was prepared
+		if (state.Layout == next.Layout && state.Stage == next.Stage && state.Access == next.Access)
+			return;
+	}
+
+	bool layoutChange = state.Layout != next.Layout;
+	bool hazard = (state.Access & WRITE_ACCESS_MASK) || (next.Access & WRITE_ACCESS_MASK);
+
+	if (!layoutChange && !hazard)
+	{
+		// Read after read, a later write has to wait on all of the readers
+		state.Stage |= next.Stage;
+		state.Access |= next.Access;
+		return;
+	}
+
+	if (state.PendingBarrier >= 0)
+	{
+		// Nothing touched the image since the last transition, retarget that barrier
+		VkImageMemoryBarrier2& pending = PendingBarriers[state.PendingBarrier];
+		pending.newLayout = next.Layout;
+		pending.dstStageMask = next.Stage;
+		pending.dstAccessMask = next.Access;
+	}
+	else
+	{
+		VkImageMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		barrier.srcStageMask = state.Stage;
+		barrier.srcAccessMask = state.Access & WRITE_ACCESS_MASK; // only writes need to be made available
+		barrier.dstStageMask = next.Stage;
+		barrier.dstAccessMask = next.Access;
+		barrier.oldLayout = state.Layout;
+		barrier.newLayout = next.Layout;
+		barrier.image = image;
+
+		barrier.subresourceRange.aspectMask = state.Aspect;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+		state.PendingBarrier = (int32_t)PendingBarriers.size();
+		PendingBarriers.push_back(barrier);
+	}
+
+	state.Layout = next.Layout;
+	state.Stage = next.Stage;
+	state.Access = next.Access;
+}
+
+void ResourceStateTracker::TransitionImageView(VkImageView view, ResourceUsage usage)
+{
+	auto iter = Views.find(view);
+	if (iter != Views.end())
+		TransitionImage(iter->second, usage);
+}
+
+void ResourceStateTracker::PrepareImage(VkImage image, ResourceUsage usage)
+{
+	auto iter = Images.find(image);
+	if (iter == Images.end())
+		return;
+
+	TransitionImage(image, usage);
+
+	iter->second.Prepared = true;
+	PreparedImages.push_back(image);
+}
+
+void ResourceStateTracker::EndPrepared()
+{
+	for (VkImage image : PreparedImages)
+	{
+		auto iter = Images.find(image);
+		if (iter != Images.end())
+			iter->second.Prepared = false;
+	}
+
+	PreparedImages.clear();
+}
+
+void ResourceStateTracker::Assume(VkImage image, VkImageLayout layout, VkPipelineStageFlags2 stage, VkAccessFlags2 access)
+{
+	auto iter = Images.find(image);
+	if (iter == Images.end())
+		return;
+
+	ImageState& state = iter->second;
+	assert(state.PendingBarrier < 0);
+
+	state.Layout = layout;
+	state.Stage = stage;
+	state.Access = access;
+	state.Used = true;
+}
+
+VkImageLayout ResourceStateTracker::GetLayout(VkImage image)
+{
+	auto iter = Images.find(image);
+	return iter != Images.end() ? iter->second.Layout : VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+VkImage ResourceStateTracker::GetViewImage(VkImageView view)
+{
+	auto iter = Views.find(view);
+	return iter != Views.end() ? iter->second : VK_NULL_HANDLE;
+}
+
+bool ResourceStateTracker::HasBeenUsed(VkImage image)
+{
+	auto iter = Images.find(image);
+	return iter != Images.end() && iter->second.Used;
+}
+
+void ResourceStateTracker::Flush(VkCommandBuffer cmd)
+{
+	if (PendingBarriers.empty())
+		return;
+
+	VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.imageMemoryBarrierCount = (uint32_t)PendingBarriers.size();
+	depInfo.pImageMemoryBarriers = PendingBarriers.data();
+
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+
+	for (VkImageMemoryBarrier2& barrier : PendingBarriers)
+	{
+		auto iter = Images.find(barrier.image);
+		if (iter != Images.end())
+			iter->second.PendingBarrier = -1;
+	}
+
+	PendingBarriers.clear();
+}
\ No newline at end of file
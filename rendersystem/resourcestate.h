@@ -0,0 +1,87 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+
+// How a resource is about to be used, decides layout, stages and access of the barrier into it
+enum class ResourceUsage : unsigned char
+{
+	Undefined = 0,     // contents can be thrown away
+	ColorAttachment,
+	DepthAttachment,
+	ComputeStorage,    // read/write storage image in compute shaders
+	GraphicsStorage,   // read/write storage image in vertex or pixel shaders
+	ShaderRead,        // sampled in any shader stage
+	TransferSrc,
+	TransferDst,
+	Present,
+};
+
+// Tracks the current layout, stages and access of every registered image.
+// Transitions are queued and only emitted on Flush, as a single vkCmdPipelineBarrier2 with exact masks.
+// Read after read in the same layout needs no barrier at all. Main thread only.
+class ResourceStateTracker
+{
+public:
+
+	struct UsageInfo
+	{
+		VkImageLayout Layout;
+		VkPipelineStageFlags2 Stage;
+		VkAccessFlags2 Access;
+	};
+
+	static UsageInfo GetUsageInfo(ResourceUsage usage);
+
+	void RegisterImage(VkImage image, VkImageView view, VkImageAspectFlags aspect);
+	void UnregisterImage(VkImage image);
+
+	// Contents are about to be overwritten, the next transition starts from UNDEFINED.
+	// The stage is added to what the barrier waits on, e.g. where a swapchain acquire semaphore is waited.
+	// Writes in the access are made available too, e.g. those of an image that shared the memory.
+	void Discard(VkImage image, VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE, VkAccessFlags2 access = VK_ACCESS_2_NONE);
+
+	void TransitionImage(VkImage image, ResourceUsage usage);
+	void TransitionImageView(VkImageView view, ResourceUsage usage);
+
+	// Transition ahead of the commands that use the image, e.g. for a whole frame graph pass.
+	// The first matching transition from those commands is then free instead of a second barrier.
+	void PrepareImage(VkImage image, ResourceUsage usage);
+	void EndPrepared();
+
+	// The layout was changed outside of this queue, e.g. by an upload on the transfer queue.
+	// Stage and access are where that write was made visible, the next barrier chains after them.
+	void Assume(VkImage image, VkImageLayout layout, VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+
+	VkImageLayout GetLayout(VkImage image);
+	VkImage GetViewImage(VkImageView view);
+
+	// Any transition since the image was registered
+	bool HasBeenUsed(VkImage image);
+
+	// Emit every pending transition in one barrier
+	void Flush(VkCommandBuffer cmd);
+
+	bool HasPending() const { return !PendingBarriers.empty(); }
+
+private:
+
+	struct ImageState
+	{
+		VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2 Stage = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 Access = VK_ACCESS_2_NONE;
+		VkImageAspectFlags Aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+		// Index into PendingBarriers, so back to back transitions collapse into one
+		int32_t PendingBarrier = -1;
+
+		bool Prepared = false;
+		bool Used = false;
+	};
+
+	Dict<VkImage, ImageState> Images;
+	Dict<VkImageView, VkImage> Views;
+
+	Array<VkImageMemoryBarrier2> PendingBarriers;
+	Array<VkImage> PreparedImages;
+};
\ No newline at end of file
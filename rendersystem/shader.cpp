@@ -2,6 +2,8 @@
 #include "shader.h"
 #include "rendersystem.h"
 #include "descriptorsets.h"
+#include "libcommon/hash.h"
+#include "libcommon/trace.h"
 
 ShaderType ShaderVk::GetType()
 {
@@ -11,19 +13,26 @@ ShaderType ShaderVk::GetType()
 void ShaderVk::SetVertexModule(HShader vsModule)
 {
 	Type = ShaderType::Graphics;
-	VertexShader = static_cast<VkShaderModule>(vsModule);
+	ReplaceModule(VertexShader, vsModule);
 }
 
 void ShaderVk::SetFragmentModule(HShader fsModule)
 {
 	Type = ShaderType::Graphics;
-	FragmentShader = static_cast<VkShaderModule>(fsModule);
+	ReplaceModule(FragmentShader, fsModule);
 }
 
 void ShaderVk::SetComputeModule(HShader csModule)
 {
 	Type = ShaderType::Compute;
-	ComputeShader = static_cast<VkShaderModule>(csModule);
+	ReplaceModule(ComputeShader, csModule);
+}
+
+void ShaderVk::ReplaceModule(VkShaderModule& slot, HShader module)
+{
+	// Pipelines keep what they need from a module, it can go as soon as the shader lets go of it
+	rendersystem->GetShaderModuleCache().Release(rendersystem->GetDevice(), slot);
+	slot = static_cast<VkShaderModule>(module);
 }
 
 void ShaderVk::SetTopology(PrimitiveTopology topology)
@@ -41,20 +50,234 @@ void ShaderVk::SetCullMode(CullModeFlags cullFlags, PolygonWinding winding)
 	PipelineBuilder.SetCullMode(RenderUtils::CullModeFlagsToVulkan(cullFlags), RenderUtils::PolygonWindingToVulkan(winding));
 }
 
+void ShaderVk::SetAttachmentFormats(BufferFormat color, BufferFormat depth)
+{
+	PipelineBuilder.SetColorAttachmentFormat(color != BufferFormat::Null ? RenderUtils::BufferFormatToVulkan(color) : VK_FORMAT_UNDEFINED);
+	PipelineBuilder.SetDepthFormat(depth != BufferFormat::Null ? RenderUtils::BufferFormatToVulkan(depth) : VK_FORMAT_UNDEFINED);
+}
+
+void ShaderVk::SetVertexLayout(uint32_t stride, uint32_t numAttributes, VertexAttribute* attributes)
+{
+	Array<VkVertexInputAttributeDescription> vkAttributes;
+	for (uint32_t i = 0; i < numAttributes; ++i)
+	{
+		VkVertexInputAttributeDescription attribute = {};
+		attribute.location = attributes[i].Location;
+		attribute.binding = 0;
+		attribute.format = RenderUtils::VertexFormatToVulkan(attributes[i].Format);
+		attribute.offset = attributes[i].Offset;
+
+		vkAttributes.push_back(attribute);
+	}
+
+	PipelineBuilder.SetVertexLayout(stride, vkAttributes);
+}
+
+void ShaderVk::SetPushConstantRange(uint32_t size, ShaderStage stages)
+{
+	PushConstants.offset = 0;
+	PushConstants.size = size;
+	PushConstants.stageFlags = RenderUtils::ShaderStageToVulkan(stages);
+}
+
+void ShaderVk::SetSpecializationConstant(uint32_t id, uint32_t value)
+{
+	SpecConstants[id] = value;
+}
+
+void ShaderVk::SetWorkgroupSize(uint32_t x, uint32_t y, uint32_t z)
+{
+	WorkgroupSize = { x, y, z };
+	HasWorkgroupSize = true;
+}
+
+void ShaderVk::SetWorkgroupAutotune(bool enable)
+{
+	Autotune = enable;
+}
+
+void ShaderVk::GetSpecialization(const uint32_t* workgroupSize, Specialization& spec) const
+{
+	Dict<uint32_t, uint32_t> constants = SpecConstants;
+	if (workgroupSize)
+	{
+		for (uint32_t i = 0; i < 3; ++i)
+			constants[WORKGROUP_SIZE_ID + i] = workgroupSize[i];
+	}
+
+	spec.Entries.clear();
+	spec.Data.clear();
+	for (auto& [id, value] : constants)
+	{
+		spec.Entries.push_back({ id, (uint32_t)(spec.Data.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+		spec.Data.push_back(value);
+	}
+
+	spec.Info.mapEntryCount = (uint32_t)spec.Entries.size();
+	spec.Info.pMapEntries = spec.Entries.data();
+	spec.Info.dataSize = spec.Data.size() * sizeof(uint32_t);
+	spec.Info.pData = spec.Data.data();
+}
+
+uint64_t ShaderVk::GetCodeHash() const
+{
+	// Specialization changes the code as much as the modules do
+	uint64_t hash = rendersystem->GetShaderModuleCache().GetHash(ComputeShader);
+	hash = Hash::Combine(hash, rendersystem->GetShaderModuleCache().GetHash(VertexShader));
+	hash = Hash::Combine(hash, rendersystem->GetShaderModuleCache().GetHash(FragmentShader));
+
+	// Dict order is not stable, so it is folded in order independently
+	uint64_t constants = 0;
+	for (auto& [id, value] : SpecConstants)
+		constants += Hash::Combine(Hash::Combine(Hash::FNV_OFFSET_BASIS, id), value);
+
+	return Hash::Combine(hash, constants);
+}
+
+void ShaderVk::UseDescriptorLayout(IDescriptorLayout* layout)
+{
+	if (layout == nullptr)
+		return;
+
+	DescriptorLayoutVk* vkLayout = static_cast<DescriptorLayoutVk*>(layout);
+	descriptorLayout = vkLayout->GetLayout();
+	Bindless = vkLayout->IsBindless();
+	DescriptorBuffer = vkLayout->IsDescriptorBuffer();
+
+	PipelineBuilder.Flags = DescriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+
+	// The heap stays bound across shaders only while every pipeline layout is identical
+	if (Bindless)
+		PushConstants = rendersystem->GetBindlessHeap().GetPushConstantRange();
+}
+
 void ShaderVk::BuildPipeline(IDescriptorLayout* layout)
 {
-	if(layout != nullptr)
-		descriptorLayout = static_cast<DescriptorLayoutVk*>(layout)->GetLayout();
+	UseDescriptorLayout(layout);
+
+	Ready = false;
+	Build(shaderPipeline, shaderPipelineLayout);
+	Ready = true;
+}
+
+void ShaderVk::BuildPipelineAsync(IDescriptorLayout* layout)
+{
+	UseDescriptorLayout(layout);
+
+	Ready = false;
+
+	// The shader is left alone until it is ready, the job has it to itself
+	rendersystem->GetPipelineCompiler().Submit([this]()
+	{
+		Build(shaderPipeline, shaderPipelineLayout);
+		Ready = true;
+	});
+}
+
+bool ShaderVk::IsReady()
+{
+	return Ready;
+}
+
+bool ShaderVk::UsesModule(VkShaderModule module) const
+{
+	return module != VK_NULL_HANDLE && (module == VertexShader || module == FragmentShader || module == ComputeShader);
+}
+
+void ShaderVk::Reload(VkShaderModule oldModule, VkShaderModule newModule)
+{
+	// Takes over the reference on the new module for every slot using the old one
+	VkShaderModule* slots[] = { &VertexShader, &FragmentShader, &ComputeShader };
+	bool replaced = false;
+	for (VkShaderModule* slot : slots)
+	{
+		if (*slot != oldModule)
+			continue;
+
+		if (replaced)
+			rendersystem->GetShaderModuleCache().AddRef(newModule);
+
+		ReplaceModule(*slot, newModule);
+		replaced = true;
+	}
+
+	if (!replaced)
+	{
+		rendersystem->GetShaderModuleCache().Release(rendersystem->GetDevice(), newModule);
+		return;
+	}
+
+	// The current pipeline stays in use until the new one is swapped in
+	ReloadState = ReloadBuilding;
+	rendersystem->GetPipelineCompiler().Submit([this]()
+	{
+		Build(ReloadedPipeline, ReloadedPipelineLayout);
+		ReloadState = ReloadBuilt;
+	});
+}
+
+bool ShaderVk::SwapReloadedPipeline(Array<VkPipeline>& oldPipelines, VkPipelineLayout& oldLayout)
+{
+	if (ReloadState != ReloadBuilt)
+		return false;
+
+	// Variants still compiling use the layout retired below, the swap waits for them
+	{
+		std::lock_guard<std::mutex> lock(VariantMutex);
+		for (auto& [key, variant] : Variants)
+		{
+			if (variant.Building)
+				return false;
+		}
+	}
+
+	ReloadState = ReloadIdle;
+
+	// Broken code, e.g. a file caught halfway through being written, keeps the last working pipeline
+	if (ReloadedPipeline == VK_NULL_HANDLE)
+	{
+		if (ReloadedPipelineLayout != VK_NULL_HANDLE)
+			vkDestroyPipelineLayout(rendersystem->GetDevice(), ReloadedPipelineLayout, nullptr);
+
+		ReloadedPipelineLayout = VK_NULL_HANDLE;
+		return false;
+	}
+
+	oldPipelines.push_back(shaderPipeline);
+	oldLayout = shaderPipelineLayout;
+
+	{
+		std::lock_guard<std::mutex> lock(VariantMutex);
+		for (auto& [key, variant] : Variants)
+		{
+			if (variant.Pipeline != VK_NULL_HANDLE)
+				oldPipelines.push_back(variant.Pipeline);
+		}
+		Variants.clear();
+	}
+
+	shaderPipeline = ReloadedPipeline;
+	shaderPipelineLayout = ReloadedPipelineLayout;
+
+	ReloadedPipeline = VK_NULL_HANDLE;
+	ReloadedPipelineLayout = VK_NULL_HANDLE;
+	return true;
+}
+
+void ShaderVk::Build(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout)
+{
+	pipeline = VK_NULL_HANDLE;
+	pipelineLayout = VK_NULL_HANDLE;
 
 	switch (Type)
 	{
 	case ShaderType::Null:
 		break;
 	case ShaderType::Graphics:
-		BuildGraphicsPipeline();
+		BuildGraphicsPipeline(pipeline, pipelineLayout);
 		break;
 	case ShaderType::Compute:
-		BuildComputePipeline();
+		BuildComputePipeline(pipeline, pipelineLayout);
 		break;
 	default:
 		break;
@@ -66,23 +289,177 @@ void ShaderVk::Destroy()
 	vkDestroyPipelineLayout(rendersystem->GetDevice(), shaderPipelineLayout, nullptr);
 	vkDestroyPipeline(rendersystem->GetDevice(), shaderPipeline, nullptr);
 
-	if (FragmentShader != VK_NULL_HANDLE)
+	for (auto& [key, variant] : Variants)
+		vkDestroyPipeline(rendersystem->GetDevice(), variant.Pipeline, nullptr);
+	Variants.clear();
+
+	// A reload that finished but was never swapped in
+	vkDestroyPipelineLayout(rendersystem->GetDevice(), ReloadedPipelineLayout, nullptr);
+	vkDestroyPipeline(rendersystem->GetDevice(), ReloadedPipeline, nullptr);
+
+	// Shared with other shaders, the cache destroys them with the last reference
+	ReplaceModule(FragmentShader, VK_NULL_HANDLE);
+	ReplaceModule(VertexShader, VK_NULL_HANDLE);
+	ReplaceModule(ComputeShader, VK_NULL_HANDLE);
+}
+
+VkPipeline ShaderVk::GetPipelineVariant(const BlendState& blend, VkFormat colorFormat, VkFormat depthFormat)
+{
+	bool baseFormats = colorFormat == PipelineBuilder.ColorAttachmentformat && depthFormat == PipelineBuilder.RenderInfo.depthAttachmentFormat;
+	if (Type != ShaderType::Graphics || (baseFormats && !blend.enable))
+		return shaderPipeline;
+
+	// Factors are left out while blending is off, they don't change the pipeline
+	PipelineVariantKey key;
+	key.Blend[0] = blend.enable;
+	if (blend.enable)
+	{
+		key.Blend[1] = (uint8_t)blend.src_factor;
+		key.Blend[2] = (uint8_t)blend.dst_factor;
+		key.Blend[3] = (uint8_t)blend.op;
+		key.Blend[4] = (uint8_t)blend.src_alpha_factor;
+		key.Blend[5] = (uint8_t)blend.dst_alpha_factor;
+		key.Blend[6] = (uint8_t)blend.alpha_op;
+	}
+	key.ColorFormat = colorFormat;
+	key.DepthFormat = depthFormat;
+
+	{
+		std::unique_lock<std::mutex> lock(VariantMutex);
+
+		auto [iter, inserted] = Variants.try_emplace(key);
+		if (!inserted)
+		{
+			// The draw can't go on without it, wait for the thread compiling it
+			VariantBuilt.wait(lock, [&]() { return !Variants[key].Building; });
+			return Variants[key].Pipeline;
+		}
+
+		iter->second.Building = true;
+	}
+
+	TRACE_SCOPE("CompilePipelineVariant");
+
+	Specialization spec;
+	GetSpecialization(nullptr, spec);
+
+	// Everything else comes from the shader, the cache makes this cheap when the driver saw it before
+	RenderUtils::GraphicsPipelineBuilder builder = PipelineBuilder;
+	builder.SetShaders(VertexShader, FragmentShader);
+	builder.SetSpecialization(&spec.Info);
+	builder.ColorBlendAttachment = RenderUtils::color_blend_attachment(blend);
+	builder.SetColorAttachmentFormat(colorFormat);
+	builder.SetDepthFormat(depthFormat);
+	builder.PipelineLayout = shaderPipelineLayout;
+
+	PipelineCacheVk& cache = rendersystem->GetPipelineCache();
+
+	PipelineCacheVk::Feedback feedback;
+	cache.BeginFeedback(feedback, nullptr);
+
+	VkPipeline pipeline = builder.Build(rendersystem->GetDevice(), cache.GetCache(), &feedback.Info);
+
+	cache.Record(feedback);
+
+	{
+		std::lock_guard<std::mutex> lock(VariantMutex);
+
+		// A reload waits for building variants, the entry is still there
+		PipelineVariant& variant = Variants[key];
+		variant.Pipeline = pipeline;
+		variant.Building = false;
+	}
+	VariantBuilt.notify_all();
+
+	return pipeline;
+}
+
+bool ShaderVk::GetComputeVariant(const uint32_t workgroupSize[3], VkPipeline& pipeline)
+{
+	pipeline = VK_NULL_HANDLE;
+
+	if (Type != ShaderType::Compute || !HasWorkgroupSize)
+		return false;
+
+	if (workgroupSize[0] == WorkgroupSize[0] && workgroupSize[1] == WorkgroupSize[1] && workgroupSize[2] == WorkgroupSize[2])
 	{
-		vkDestroyShaderModule(rendersystem->GetDevice(), FragmentShader, nullptr);
+		pipeline = shaderPipeline;
+		return true;
 	}
-	if (VertexShader != VK_NULL_HANDLE)
+
+	PipelineVariantKey key;
+	std::copy(workgroupSize, workgroupSize + 3, key.WorkgroupSize.begin());
+
+	std::lock_guard<std::mutex> lock(VariantMutex);
+
+	auto iter = Variants.find(key);
+	if (iter != Variants.end())
 	{
-		vkDestroyShaderModule(rendersystem->GetDevice(), VertexShader, nullptr);
+		pipeline = iter->second.Pipeline;
+		return pipeline != VK_NULL_HANDLE || iter->second.Building;
 	}
-	if (ComputeShader != VK_NULL_HANDLE)
+
+	// Dispatches go on with what they have until the compiler is done with it
+	Variants[key].Building = true;
+
+	// A reload may swap the module out of the shader before the job runs, the job holds on to its own reference
+	VkShaderModule module = ComputeShader;
+	rendersystem->GetShaderModuleCache().AddRef(module);
+
+	VkPipelineLayout layout = shaderPipelineLayout;
+	rendersystem->GetPipelineCompiler().Submit([this, key, module, layout]()
+	{
+		VkPipeline compiled = CreateComputePipeline(module, layout, key.WorkgroupSize.data());
+		rendersystem->GetShaderModuleCache().Release(rendersystem->GetDevice(), module);
+
+		std::lock_guard<std::mutex> lock(VariantMutex);
+
+		// Dropped along with the other variants in the meantime, nobody is waiting for it
+		auto iter = Variants.find(key);
+		if (iter == Variants.end() || !iter->second.Building)
+		{
+			vkDestroyPipeline(rendersystem->GetDevice(), compiled, nullptr);
+			return;
+		}
+
+		iter->second.Pipeline = compiled;
+		iter->second.Building = false;
+	});
+
+	return true;
+}
+
+void ShaderVk::RecordDynamicState(VkCommandBuffer cmd, const DepthStencilState& depthStencil, const RasterizerState& rasterizer) const
+{
+	VkCullModeFlags cullMode = PipelineBuilder.Rasterizer.cullMode;
+	VkFrontFace frontFace = PipelineBuilder.Rasterizer.frontFace;
+	if (rasterizer.enable)
 	{
-		vkDestroyShaderModule(rendersystem->GetDevice(), ComputeShader, nullptr);
+		cullMode = RenderUtils::CullModeFlagsToVulkan(rasterizer.cull_mode);
+		frontFace = RenderUtils::PolygonWindingToVulkan(rasterizer.winding);
 	}
+
+	vkCmdSetCullMode(cmd, cullMode);
+	vkCmdSetFrontFace(cmd, frontFace);
+
+	vkCmdSetDepthTestEnable(cmd, depthStencil.enable);
+	vkCmdSetDepthWriteEnable(cmd, depthStencil.enable && depthStencil.write_enable);
+	vkCmdSetDepthCompareOp(cmd, RenderUtils::CompareOpToVulkan(depthStencil.compare_op));
+
+	bool bias = depthStencil.depth_bias != 0.0f || depthStencil.depth_bias_slope != 0.0f;
+	vkCmdSetDepthBiasEnable(cmd, bias);
+	vkCmdSetDepthBias(cmd, depthStencil.depth_bias, 0.0f, depthStencil.depth_bias_slope);
 }
 
-void ShaderVk::BuildGraphicsPipeline()
+void ShaderVk::BuildGraphicsPipeline(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout)
 {
-	PipelineBuilder.SetShaders(VertexShader, FragmentShader);
+	// Variants copy the builder while this may run on a compiler thread, it is only read here
+	RenderUtils::GraphicsPipelineBuilder builder = PipelineBuilder;
+	builder.SetShaders(VertexShader, FragmentShader);
+
+	Specialization spec;
+	GetSpecialization(nullptr, spec);
+	builder.SetSpecialization(&spec.Info);
 
 	VkPipelineLayoutCreateInfo graphicsLayout{};
 	graphicsLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -92,31 +469,69 @@ void ShaderVk::BuildGraphicsPipeline()
 		graphicsLayout.pSetLayouts = &descriptorLayout;
 		graphicsLayout.setLayoutCount = 1;
 	}
+	if (PushConstants.size > 0)
+	{
+		graphicsLayout.pPushConstantRanges = &PushConstants;
+		graphicsLayout.pushConstantRangeCount = 1;
+	}
+
+	vkCreatePipelineLayout(rendersystem->GetDevice(), &graphicsLayout, nullptr, &pipelineLayout);
+
+	builder.PipelineLayout = pipelineLayout;
+
+	PipelineCacheVk& cache = rendersystem->GetPipelineCache();
 
-	vkCreatePipelineLayout(rendersystem->GetDevice(), &graphicsLayout, nullptr, &shaderPipelineLayout);
+	PipelineCacheVk::Feedback feedback;
+	cache.BeginFeedback(feedback, nullptr);
 
-	PipelineBuilder.PipelineLayout = shaderPipelineLayout;
+	pipeline = builder.Build(rendersystem->GetDevice(), cache.GetCache(), &feedback.Info);
 
-	shaderPipeline = PipelineBuilder.Build(rendersystem->GetDevice());
+	cache.Record(feedback);
 }
 
-void ShaderVk::BuildComputePipeline()
+void ShaderVk::BuildComputePipeline(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout)
 {
 	VkPipelineLayoutCreateInfo computeLayout{};
 	computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	computeLayout.pNext = nullptr;
 	computeLayout.pSetLayouts = &descriptorLayout;
 	computeLayout.setLayoutCount = 1;
+	if (PushConstants.size > 0)
+	{
+		computeLayout.pPushConstantRanges = &PushConstants;
+		computeLayout.pushConstantRangeCount = 1;
+	}
 
-	vkCreatePipelineLayout(rendersystem->GetDevice(), &computeLayout, nullptr, &shaderPipelineLayout);
+	vkCreatePipelineLayout(rendersystem->GetDevice(), &computeLayout, nullptr, &pipelineLayout);
 
-	VkPipelineShaderStageCreateInfo stageinfo = RenderUtils::shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, ComputeShader);
+	pipeline = CreateComputePipeline(ComputeShader, pipelineLayout, HasWorkgroupSize ? WorkgroupSize.data() : nullptr);
+}
+
+VkPipeline ShaderVk::CreateComputePipeline(VkShaderModule module, VkPipelineLayout pipelineLayout, const uint32_t* workgroupSize)
+{
+	Specialization spec;
+	GetSpecialization(workgroupSize, spec);
+
+	VkPipelineShaderStageCreateInfo stageinfo = RenderUtils::shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, module);
+	stageinfo.pSpecializationInfo = spec.Entries.empty() ? nullptr : &spec.Info;
 
 	VkComputePipelineCreateInfo computePipelineCreateInfo{};
 	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 	computePipelineCreateInfo.pNext = nullptr;
-	computePipelineCreateInfo.layout = shaderPipelineLayout;
+	computePipelineCreateInfo.flags = DescriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+	computePipelineCreateInfo.layout = pipelineLayout;
 	computePipelineCreateInfo.stage = stageinfo;
 
-	vkCreateComputePipelines(rendersystem->GetDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &shaderPipeline);
+	PipelineCacheVk& cache = rendersystem->GetPipelineCache();
+
+	PipelineCacheVk::Feedback feedback;
+	cache.BeginFeedback(feedback, nullptr);
+	computePipelineCreateInfo.pNext = &feedback.Info;
+
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(rendersystem->GetDevice(), cache.GetCache(), 1, &computePipelineCreateInfo, nullptr, &pipeline) != VK_SUCCESS)
+		pipeline = VK_NULL_HANDLE;
+
+	cache.Record(feedback);
+	return pipeline;
 }
\ No newline at end of file
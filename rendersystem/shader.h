@@ -3,6 +3,37 @@
 #include "rendersystem/ishader.h"
 #include "vulkan_common.h"
 #include "utils.h"
+#include "libcommon/hash.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Everything a pipeline variant differs in from the shader's own pipeline. Graphics variants fill in the blend
+// state and the formats, blend factors stay zero while blending is off. Compute variants fill in the workgroup size.
+struct PipelineVariantKey
+{
+	ConstArray<uint8_t, 7> Blend = {};
+	VkFormat ColorFormat = VK_FORMAT_UNDEFINED;
+	VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+	ConstArray<uint32_t, 3> WorkgroupSize = {};
+
+	bool operator==(const PipelineVariantKey& other) const = default;
+};
+
+template<>
+struct std::hash<PipelineVariantKey>
+{
+	size_t operator()(const PipelineVariantKey& key) const
+	{
+		uint64_t hash = Hash::Fnv1a(key.Blend.data(), key.Blend.size());
+		hash = Hash::Combine(hash, key.ColorFormat);
+		hash = Hash::Combine(hash, key.DepthFormat);
+		for (uint32_t size : key.WorkgroupSize)
+			hash = Hash::Combine(hash, size);
+		return (size_t)hash;
+	}
+};
 
 class ShaderVk : public IShader
 {
@@ -17,8 +48,16 @@ public:
 	virtual void SetTopology(PrimitiveTopology topology);
 	virtual void SetPolygonMode(PolygonMode polygonMode);
 	virtual void SetCullMode(CullModeFlags cullFlags, PolygonWinding winding);
+	virtual void SetAttachmentFormats(BufferFormat color, BufferFormat depth);
+	virtual void SetVertexLayout(uint32_t stride, uint32_t numAttributes, VertexAttribute* attributes);
+	virtual void SetPushConstantRange(uint32_t size, ShaderStage stages);
+	virtual void SetSpecializationConstant(uint32_t id, uint32_t value);
+	virtual void SetWorkgroupSize(uint32_t x, uint32_t y, uint32_t z);
+	virtual void SetWorkgroupAutotune(bool enable);
 
 	virtual void BuildPipeline(IDescriptorLayout *layout);
+	virtual void BuildPipelineAsync(IDescriptorLayout *layout);
+	virtual bool IsReady();
 
 	VkPipeline GetPipeline()
 	{
@@ -30,18 +69,111 @@ public:
 		return shaderPipelineLayout;
 	}
 
+	VkShaderStageFlags GetPushConstantStages() const
+	{
+		return PushConstants.stageFlags;
+	}
+
+	// Built against the bindless heap, which has to be bound instead of a descriptor set
+	bool IsBindless() const { return Bindless; }
+
+	// Thread safe. Pipeline for the blend state and the attachment formats of the pass, compiled on first use.
+	// The formats the shader was set up with and no blending give the pipeline it was built with.
+	// Another thread asking for the same variant meanwhile waits for that one compile.
+	VkPipeline GetPipelineVariant(const BlendState& blend, VkFormat colorFormat, VkFormat depthFormat);
+
+	// Depth and raster state are dynamic in every graphics pipeline, they are recorded after a pipeline is bound.
+	// The shader's own cull mode and winding apply unless the rasterizer state overrides them.
+	void RecordDynamicState(VkCommandBuffer cmd, const DepthStencilState& depthStencil, const RasterizerState& rasterizer) const;
+
+	// Thread safe. Compute pipeline specialized to another workgroup size, built on a compiler thread on first use.
+	// Null while it is being built, false when it can't be built at all.
+	bool GetComputeVariant(const uint32_t workgroupSize[3], VkPipeline& pipeline);
+
+	bool IsAutotuned() const { return HasWorkgroupSize && Autotune; }
+	const ConstArray<uint32_t, 3>& GetWorkgroupSize() const { return WorkgroupSize; }
+
+	// Changes with the code and the specialization constants, keys results measured on the shader
+	uint64_t GetCodeHash() const;
+
 	void Destroy();
 
+	// Hot reload. Swaps the old module for the new one, taking over a reference on it, and rebuilds the
+	// pipeline in the background. Only while the shader is ready and not reloading already.
+	bool UsesModule(VkShaderModule module) const;
+	void Reload(VkShaderModule oldModule, VkShaderModule newModule);
+	bool IsReloading() const { return ReloadState != ReloadIdle; }
+
+	// At a frame boundary, once the rebuilt pipeline exists and no variant is compiling. Hands out the previous pipeline and its
+	// variants to be retired, variants are compiled again from the new code on their next use.
+	bool SwapReloadedPipeline(Array<VkPipeline>& oldPipelines, VkPipelineLayout& oldLayout);
+
 private:
 
-	void BuildGraphicsPipeline();
-	void BuildComputePipeline();
+	void Build(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout);
+
+	// A bindless layout also replaces the push constant range with the heap's,
+	// a layout in the descriptor buffer makes every pipeline of the shader read sets from it
+	void UseDescriptorLayout(IDescriptorLayout* layout);
+
+	// Releases the module held in the slot
+	void ReplaceModule(VkShaderModule& slot, HShader module);
+
+	void BuildGraphicsPipeline(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout);
+	void BuildComputePipeline(VkPipeline& pipeline, VkPipelineLayout& pipelineLayout);
+	VkPipeline CreateComputePipeline(VkShaderModule module, VkPipelineLayout pipelineLayout, const uint32_t* workgroupSize);
+
+	// Workgroup size goes to constants 0, 1 and 2, like local_size_x_id and friends
+	static constexpr uint32_t WORKGROUP_SIZE_ID = 0;
+
+	// Info points into the arrays, filled in place
+	struct Specialization
+	{
+		Array<VkSpecializationMapEntry> Entries;
+		Array<uint32_t> Data;
+		VkSpecializationInfo Info = {};
+	};
+	void GetSpecialization(const uint32_t* workgroupSize, Specialization& spec) const;
 
-	VkPipeline shaderPipeline;
-	VkPipelineLayout shaderPipelineLayout;
+	VkPipeline shaderPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout shaderPipelineLayout = VK_NULL_HANDLE;
 	ShaderType Type;
 
+	// Set by the compiler thread once the pipeline exists
+	std::atomic<bool> Ready = false;
+
+	enum ReloadStates : int
+	{
+		ReloadIdle = 0,
+		ReloadBuilding,
+		ReloadBuilt,
+	};
+	std::atomic<int> ReloadState = ReloadIdle;
+	VkPipeline ReloadedPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout ReloadedPipelineLayout = VK_NULL_HANDLE;
+
+	// Pipelines sharing the layout of the built pipeline. Failed compiles stay in as null so they aren't retried
+	// every draw. Variants are compiled outside the lock, marked as building meanwhile.
+	struct PipelineVariant
+	{
+		VkPipeline Pipeline = VK_NULL_HANDLE;
+		bool Building = false;
+	};
+	std::mutex VariantMutex;
+	std::condition_variable VariantBuilt;
+	Dict<PipelineVariantKey, PipelineVariant> Variants;
+
+	Dict<uint32_t, uint32_t> SpecConstants;
+	ConstArray<uint32_t, 3> WorkgroupSize = { 1, 1, 1 };
+	bool HasWorkgroupSize = false;
+	bool Autotune = false;
+
 	VkDescriptorSetLayout descriptorLayout = VK_NULL_HANDLE;
+	bool Bindless = false;
+	bool DescriptorBuffer = false;
+
+	// Empty when size is 0
+	VkPushConstantRange PushConstants = {};
 
 	VkShaderModule FragmentShader = VK_NULL_HANDLE;
 	VkShaderModule VertexShader = VK_NULL_HANDLE;
@@ -0,0 +1,172 @@
+#include "common_stl.h"
+#include "shaderarchive.h"
+#include "libcommon/hash.h"
+
+#include <cstring>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "Windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool ShaderArchive::Open(const char* filepath)
+{
+	Close();
+
+#ifdef WIN32
+	HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	FileHandle = file;
+	MappingHandle = mapping;
+	Data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	Size = (size_t)fileSize.QuadPart;
+#else
+	int file = open(filepath, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		close(file);
+		return false;
+	}
+
+	// The mapping keeps the file alive on its own
+	void* mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+
+	if (mapped == MAP_FAILED)
+		return false;
+
+	Data = static_cast<const char*>(mapped);
+	Size = (size_t)fileStat.st_size;
+#endif
+
+	if (!Data || !Validate())
+	{
+		// std::cout << "invalid shader archive\n";
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void ShaderArchive::Close()
+{
+#ifdef WIN32
+	if (Data)
+		UnmapViewOfFile(Data);
+	if (MappingHandle)
+		CloseHandle(MappingHandle);
+	if (FileHandle)
+		CloseHandle(FileHandle);
+
+	MappingHandle = nullptr;
+	FileHandle = nullptr;
+#else
+	if (Data)
+		munmap(const_cast<char*>(Data), Size);
+#endif
+
+	Data = nullptr;
+	Size = 0;
+	Entries = nullptr;
+	EntryCount = 0;
+}
+
+bool ShaderArchive::Validate()
+{
+	ShaderPack::Header header;
+	if (Size < sizeof(header))
+		return false;
+
+	memcpy(&header, Data, sizeof(header));
+	if (header.Magic != ShaderPack::MAGIC || header.Version != ShaderPack::VERSION)
+		return false;
+
+	// The index is read in place, it has to be aligned for its 64-bit hashes
+	if (header.IndexOffset % alignof(ShaderPack::Entry) != 0 ||
+		(uint64_t)header.IndexOffset + (uint64_t)header.EntryCount * sizeof(ShaderPack::Entry) > Size)
+		return false;
+
+	Entries = reinterpret_cast<const ShaderPack::Entry*>(Data + header.IndexOffset);
+	EntryCount = header.EntryCount;
+
+	for (uint32_t i = 0; i < EntryCount; ++i)
+	{
+		const ShaderPack::Entry& entry = Entries[i];
+		if ((uint64_t)entry.NameOffset + entry.NameLength > Size ||
+			(uint64_t)entry.CodeOffset + entry.CodeSize > Size ||
+			entry.CodeOffset % sizeof(uint32_t) != 0 ||
+			entry.CodeSize % sizeof(uint32_t) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool ShaderArchive::Find(const char* filepath, const uint32_t*& code, size_t& size, uint64_t& contentHash) const
+{
+	if (!IsOpen())
+		return false;
+
+	// Packed by file name only
+	const char* name = filepath;
+	for (const char* c = filepath; *c; ++c)
+	{
+		if (*c == '/' || *c == '\\')
+			name = c + 1;
+	}
+
+	size_t nameLength = strlen(name);
+	uint64_t nameHash = Hash::Fnv1a(name, nameLength);
+
+	// The index is sorted by name hash
+	uint32_t first = 0;
+	uint32_t count = EntryCount;
+	while (count > 0)
+	{
+		uint32_t step = count / 2;
+		if (Entries[first + step].NameHash < nameHash)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+
+	if (first >= EntryCount)
+		return false;
+
+	const ShaderPack::Entry& entry = Entries[first];
+	if (entry.NameHash != nameHash || entry.NameLength != nameLength || memcmp(Data + entry.NameOffset, name, nameLength) != 0)
+		return false;
+
+	code = reinterpret_cast<const uint32_t*>(Data + entry.CodeOffset);
+	size = entry.CodeSize;
+	contentHash = entry.ContentHash;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+#include "common_stl.h"
+#include "rendersystem/shaderpack_format.h"
+
+// Read only view of a shader archive made by the shaderpack tool.
+// The file is memory mapped, code is handed out as pointers into the mapping, nothing is copied.
+class ShaderArchive
+{
+public:
+
+	~ShaderArchive() { Close(); }
+
+	// False when the file is missing or not a valid archive, shaders are then loaded file by file
+	bool Open(const char* filepath);
+	void Close();
+
+	bool IsOpen() const { return Data != nullptr; }
+
+	// Looks up the file name of the path, directories are ignored. Code stays valid until Close.
+	bool Find(const char* filepath, const uint32_t*& code, size_t& size, uint64_t& contentHash) const;
+
+private:
+
+	bool Validate();
+
+	const char* Data = nullptr;
+	size_t Size = 0;
+
+	const ShaderPack::Entry* Entries = nullptr;
+	uint32_t EntryCount = 0;
+
+#ifdef WIN32
+	void* FileHandle = nullptr;
+	void* MappingHandle = nullptr;
+#endif
+};
\ No newline at end of file
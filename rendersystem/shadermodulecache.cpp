@@ -0,0 +1,154 @@
+#include "common_stl.h"
+#include "shadermodulecache.h"
+#include "utils.h"
+#include "libcommon/hash.h"
+
+bool ShaderModuleCacheVk::OpenArchive(const char* filepath)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+	return Archive.Open(filepath);
+}
+
+void ShaderModuleCacheVk::Destroy(VkDevice device)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	Archive.Close();
+
+	// Whatever is still referenced goes too, the shaders holding it are gone by now
+	for (auto& [hash, entry] : Modules)
+		vkDestroyShaderModule(device, entry.Module, nullptr);
+
+	Modules.clear();
+	PathHashes.clear();
+	ModuleHashes.clear();
+	LoosePaths.clear();
+}
+
+VkShaderModule ShaderModuleCacheVk::Acquire(VkDevice device, const char* filepath)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	// Known path, no need to touch the disk
+	auto pathIter = PathHashes.find(filepath);
+	if (pathIter != PathHashes.end())
+	{
+		auto moduleIter = Modules.find(pathIter->second);
+		if (moduleIter != Modules.end())
+		{
+			moduleIter->second.RefCount++;
+			return moduleIter->second.Module;
+		}
+	}
+
+	return AcquireFromFile(device, filepath);
+}
+
+void ShaderModuleCacheVk::Invalidate(const char* filepath)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	// Modules of the old code stay alive for whoever still holds them
+	PathHashes.erase(filepath);
+	LoosePaths[filepath] = true;
+}
+
+VkShaderModule ShaderModuleCacheVk::Find(const char* filepath)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	auto pathIter = PathHashes.find(filepath);
+	if (pathIter == PathHashes.end())
+		return VK_NULL_HANDLE;
+
+	auto moduleIter = Modules.find(pathIter->second);
+	return moduleIter != Modules.end() ? moduleIter->second.Module : VK_NULL_HANDLE;
+}
+
+uint64_t ShaderModuleCacheVk::GetHash(VkShaderModule module)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	auto hashIter = ModuleHashes.find(module);
+	return hashIter != ModuleHashes.end() ? hashIter->second : 0;
+}
+
+VkShaderModule ShaderModuleCacheVk::AcquireFromFile(VkDevice device, const String& path)
+{
+	const uint32_t* code = nullptr;
+	size_t codeSize = 0;
+	uint64_t hash = 0;
+
+	// Packed code is read in place and comes with its hash
+	Array<uint32_t> fileCode;
+	bool loose = LoosePaths.find(path) != LoosePaths.end();
+	if (loose || !Archive.Find(path.c_str(), code, codeSize, hash))
+	{
+		if (!RenderUtils::read_spirv(path.c_str(), fileCode))
+			return VK_NULL_HANDLE;
+
+		code = fileCode.data();
+		codeSize = fileCode.size() * sizeof(uint32_t);
+		hash = Hash::Fnv1a(code, codeSize);
+	}
+
+	PathHashes[path] = hash;
+
+	// Same code under another path
+	ModuleEntry& entry = Modules[hash];
+	if (entry.Module == VK_NULL_HANDLE)
+	{
+		entry.Module = RenderUtils::create_shader_module(device, code, codeSize);
+		if (entry.Module == VK_NULL_HANDLE)
+		{
+			Modules.erase(hash);
+			PathHashes.erase(path);
+			return VK_NULL_HANDLE;
+		}
+
+		ModuleHashes[entry.Module] = hash;
+	}
+
+	entry.RefCount++;
+	return entry.Module;
+}
+
+void ShaderModuleCacheVk::AddRef(VkShaderModule module)
+{
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	auto hashIter = ModuleHashes.find(module);
+	if (hashIter != ModuleHashes.end())
+		Modules[hashIter->second].RefCount++;
+}
+
+void ShaderModuleCacheVk::Release(VkDevice device, VkShaderModule module)
+{
+	if (module == VK_NULL_HANDLE)
+		return;
+
+	std::lock_guard<std::mutex> lock(CacheMutex);
+
+	auto hashIter = ModuleHashes.find(module);
+	if (hashIter == ModuleHashes.end())
+		return;
+
+	uint64_t hash = hashIter->second;
+	ModuleEntry& entry = Modules[hash];
+	if (entry.RefCount > 0 && --entry.RefCount > 0)
+		return;
+
+	vkDestroyShaderModule(device, entry.Module, nullptr);
+
+	Modules.erase(hash);
+	ModuleHashes.erase(hashIter);
+
+	// Paths leading here read the file again next time
+	for (auto iter = PathHashes.begin(); iter != PathHashes.end();)
+	{
+		if (iter->second == hash)
+			iter = PathHashes.erase(iter);
+		else
+			++iter;
+	}
+}
\ No newline at end of file
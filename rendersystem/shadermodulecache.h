@@ -0,0 +1,59 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "shaderarchive.h"
+
+#include <mutex>
+
+// Shader modules shared by every shader that uses the same SPIR-V.
+// A path is read from disk once, modules are keyed by the hash of their code so identical files under
+// different paths share one too. Every Acquire holds a reference, the module is destroyed with the last Release.
+// With a shader archive open, files in it are created straight from the mapping without touching the disk.
+class ShaderModuleCacheVk
+{
+public:
+
+	// Optional, files not in the archive are still read one by one
+	bool OpenArchive(const char* filepath);
+
+	void Destroy(VkDevice device);
+
+	// Thread safe. Null when the file can't be read or isn't valid SPIR-V.
+	VkShaderModule Acquire(VkDevice device, const char* filepath);
+
+	// Thread safe. Takes another reference on a module handed out before
+	void AddRef(VkShaderModule module);
+	void Release(VkDevice device, VkShaderModule module);
+
+	// Thread safe. The next Acquire of the path reads the file again, modules handed out stay valid.
+	// The file on disk is newer than anything packed, the archive is skipped for it from then on.
+	void Invalidate(const char* filepath);
+
+	// Thread safe. Module the path currently leads to without taking a reference, null when there's none
+	VkShaderModule Find(const char* filepath);
+
+	// Thread safe. Hash of the module's code, 0 for modules the cache doesn't know
+	uint64_t GetHash(VkShaderModule module);
+
+private:
+
+	struct ModuleEntry
+	{
+		VkShaderModule Module = VK_NULL_HANDLE;
+		uint32_t RefCount = 0;
+	};
+
+	VkShaderModule AcquireFromFile(VkDevice device, const String& path);
+
+	std::mutex CacheMutex;
+
+	ShaderArchive Archive;
+
+	// Content hash to module, and where each path and module lead to
+	Dict<uint64_t, ModuleEntry> Modules;
+	Dict<String, uint64_t> PathHashes;
+	Dict<VkShaderModule, uint64_t> ModuleHashes;
+
+	// Invalidated paths, always read from disk
+	Dict<String, bool> LoosePaths;
+};
\ No newline at end of file
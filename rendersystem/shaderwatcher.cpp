@@ -0,0 +1,184 @@
+#include "common_stl.h"
+#include "shaderwatcher.h"
+#include "libcommon/trace.h"
+
+#include <chrono>
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+void ShaderWatcher::Start()
+{
+	if (Running)
+		return;
+
+#ifdef __linux__
+	Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (Inotify < 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(WatchMutex);
+	for (auto& [key, path] : Files)
+		AddDirectoryWatch(std::filesystem::path(key).parent_path().string());
+#endif
+
+	Running = true;
+	Thread = std::thread(&ShaderWatcher::WatcherMain, this);
+}
+
+void ShaderWatcher::Stop()
+{
+	if (!Running)
+		return;
+
+	Running = false;
+	Thread.join();
+
+#ifdef __linux__
+	close(Inotify);
+	Inotify = -1;
+	WatchDirectories.clear();
+	DirectoryWatches.clear();
+#endif
+}
+
+String ShaderWatcher::MakeKey(const String& directory, const String& name)
+{
+	return (directory.empty() ? String(".") : directory) + "/" + name;
+}
+
+void ShaderWatcher::Watch(const char* filepath)
+{
+	std::filesystem::path path = filepath;
+	String directory = path.parent_path().string();
+	String key = MakeKey(directory, path.filename().string());
+
+	std::lock_guard<std::mutex> lock(WatchMutex);
+
+	if (!Files.try_emplace(key, filepath).second)
+		return;
+
+#ifdef __linux__
+	if (Running)
+		AddDirectoryWatch(std::filesystem::path(key).parent_path().string());
+#else
+	std::error_code error;
+	auto writeTime = std::filesystem::last_write_time(key, error);
+	WriteTimes[key] = error ? 0 : (int64_t)writeTime.time_since_epoch().count();
+#endif
+}
+
+void ShaderWatcher::TakeChanged(Array<String>& paths)
+{
+	std::lock_guard<std::mutex> lock(WatchMutex);
+
+	for (auto& [key, changed] : Changed)
+		paths.push_back(Files[key]);
+
+	Changed.clear();
+}
+
+void ShaderWatcher::MarkChanged(const String& key)
+{
+	std::lock_guard<std::mutex> lock(WatchMutex);
+
+	if (Files.count(key))
+		Changed[key] = true;
+}
+
+#ifdef __linux__
+void ShaderWatcher::AddDirectoryWatch(const String& directory)
+{
+	if (DirectoryWatches.count(directory))
+		return;
+
+	// Compilers and editors replace files as often as they write them in place
+	int watch = inotify_add_watch(Inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watch < 0)
+		return;
+
+	DirectoryWatches[directory] = watch;
+	WatchDirectories[watch] = directory;
+}
+
+void ShaderWatcher::WatcherMain()
+{
+	Trace::SetThreadName("ShaderWatcher");
+
+	alignas(inotify_event) char buffer[4096];
+
+	while (Running)
+	{
+		// Wakes up now and then to notice Stop
+		pollfd pollInfo = { Inotify, POLLIN, 0 };
+		if (poll(&pollInfo, 1, 250) <= 0)
+			continue;
+
+		ssize_t length;
+		while ((length = read(Inotify, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* ptr = buffer; ptr < buffer + length;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+				ptr += sizeof(inotify_event) + event->len;
+
+				if (event->len == 0)
+					continue;
+
+				String directory;
+				{
+					std::lock_guard<std::mutex> lock(WatchMutex);
+					auto dirIter = WatchDirectories.find(event->wd);
+					if (dirIter == WatchDirectories.end())
+						continue;
+					directory = dirIter->second;
+				}
+
+				MarkChanged(MakeKey(directory, event->name));
+			}
+		}
+	}
+}
+#else
+void ShaderWatcher::WatcherMain()
+{
+	Trace::SetThreadName("ShaderWatcher");
+
+	while (Running)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+		Array<String> keys;
+		{
+			std::lock_guard<std::mutex> lock(WatchMutex);
+			for (auto& [key, path] : Files)
+				keys.push_back(key);
+		}
+
+		for (const String& key : keys)
+		{
+			std::error_code error;
+			auto writeTime = std::filesystem::last_write_time(key, error);
+			if (error)
+				continue;
+
+			int64_t ticks = (int64_t)writeTime.time_since_epoch().count();
+
+			bool changed = false;
+			{
+				std::lock_guard<std::mutex> lock(WatchMutex);
+				int64_t& lastTicks = WriteTimes[key];
+				changed = lastTicks != 0 && lastTicks != ticks;
+				lastTicks = ticks;
+			}
+
+			if (changed)
+				MarkChanged(key);
+		}
+	}
+}
+#endif
\ No newline at end of file
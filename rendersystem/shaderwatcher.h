@@ -0,0 +1,54 @@
+#pragma once
+#include "common_stl.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Background thread reporting shader files that changed on disk.
+// Uses inotify on the directories of the watched files where available, and polls their write times elsewhere.
+// Changes are collected until the rendersystem takes them at a frame boundary.
+class ShaderWatcher
+{
+public:
+
+	~ShaderWatcher() { Stop(); }
+
+	void Start();
+	void Stop();
+
+	bool IsRunning() const { return Running; }
+
+	// Thread safe. Files can be added before or after Start
+	void Watch(const char* filepath);
+
+	// Thread safe. Paths as they were passed to Watch, each one once
+	void TakeChanged(Array<String>& paths);
+
+private:
+
+	void WatcherMain();
+	void MarkChanged(const String& key);
+
+	// Directory and file name joined the same way for every path, e.g. "./circle_cs61.spv"
+	static String MakeKey(const String& directory, const String& name);
+
+	std::mutex WatchMutex;
+	std::thread Thread;
+	std::atomic<bool> Running = false;
+
+	// Key to the path the file was loaded with
+	Dict<String, String> Files;
+	Dict<String, bool> Changed;
+
+#ifdef __linux__
+	int Inotify = -1;
+	Dict<int, String> WatchDirectories;
+	Dict<String, int> DirectoryWatches;
+
+	void AddDirectoryWatch(const String& directory);
+#else
+	// Last seen write time of every file, in ticks of its clock
+	Dict<String, int64_t> WriteTimes;
+#endif
+};
\ No newline at end of file
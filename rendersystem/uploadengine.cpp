@@ -0,0 +1,587 @@
+#include "common_stl.h"
+#include "uploadengine.h"
+#include "rendersystem.h"
+#include "libcommon/trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Copy offsets have to be a multiple of the texel size, this covers every format up to RGBA32
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+bool UploadEngineVk::Init(VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily)
+{
+	VkDevice device = rendersystem->GetDevice();
+
+	TransferQueue = transferQueue;
+	TransferFamily = transferFamily;
+	GraphicsFamily = graphicsFamily;
+
+	VkSemaphoreTypeCreateInfo timelineInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphoreInfo.pNext = &timelineInfo;
+
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &Timeline) != VK_SUCCESS)
+		return false;
+
+	for (Batch& batch : Batches)
+	{
+		VkCommandPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = TransferFamily;
+
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &batch.Pool) != VK_SUCCESS)
+			return false;
+
+		VkCommandBufferAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocInfo.commandPool = batch.Pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &batch.CommandBuffer) != VK_SUCCESS)
+			return false;
+
+		batch.Value = 0;
+		batch.Recording = false;
+	}
+
+	VkBufferCreateInfo ringInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	ringInfo.size = STAGING_RING_SIZE;
+	ringInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	VmaAllocationCreateInfo ringAlloc = {};
+	ringAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+	ringAlloc.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo ringResult = {};
+	if (vmaCreateBuffer(rendersystem->GetAllocator(), &ringInfo, &ringAlloc, &Ring, &RingAllocation, &ringResult) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create staging ring\n";
+		return false;
+	}
+
+	RingMapped = static_cast<char*>(ringResult.pMappedData);
+	RingHead = 0;
+
+	return true;
+}
+
+void UploadEngineVk::Destroy()
+{
+	VkDevice device = rendersystem->GetDevice();
+	VmaAllocator allocator = rendersystem->GetAllocator();
+
+	for (OversizedStaging& staging : Oversized)
+		vmaDestroyBuffer(allocator, staging.Buffer, staging.Allocation);
+	Oversized.clear();
+
+	if (Ring != VK_NULL_HANDLE)
+		vmaDestroyBuffer(allocator, Ring, RingAllocation);
+	Ring = VK_NULL_HANDLE;
+	RingAllocation = VK_NULL_HANDLE;
+	RingMapped = nullptr;
+	RingRegions.clear();
+
+	for (Batch& batch : Batches)
+	{
+		// frees the command buffer along with it
+		if (batch.Pool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(device, batch.Pool, nullptr);
+		batch = Batch{};
+	}
+
+	if (Timeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, Timeline, nullptr);
+	Timeline = VK_NULL_HANDLE;
+
+	PendingAcquires.clear();
+	ReadyAcquires.clear();
+	FrameCopies.clear();
+}
+
+bool UploadEngineVk::UploadBuffer(VkBuffer dst, VkDeviceSize offset, const void* data, VkDeviceSize size, bool fresh, uint64_t frame)
+{
+	if (!data || size == 0)
+		return false;
+
+	StagingSpan staging;
+	if (!AllocateStaging(size, fresh ? 0 : frame, staging))
+		return false;
+
+	memcpy(staging.Mapped, data, size);
+	vmaFlushAllocation(rendersystem->GetAllocator(), staging.Allocation, staging.Offset, size);
+
+	if (!fresh)
+	{
+		FrameCopy copy;
+		copy.Source = staging;
+		copy.Size = size;
+		copy.Buffer = dst;
+		copy.Offset = offset;
+		FrameCopies.push_back(copy);
+		return true;
+	}
+
+	Batch* batch = GetBatch();
+	if (!batch)
+		return false;
+
+	VkBufferCopy region = {};
+	region.srcOffset = staging.Offset;
+	region.dstOffset = offset;
+	region.size = size;
+	vkCmdCopyBuffer(batch->CommandBuffer, staging.Buffer, dst, 1, &region);
+
+	OwnershipTransfer transfer;
+	transfer.Buffer = dst;
+	transfer.Offset = offset;
+	transfer.Size = size;
+
+	if (!SameFamily())
+	{
+		// Release to the graphics family, the matching acquire is recorded by the frame that waits for this batch
+		VkBufferMemoryBarrier2 release = { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+		release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		release.srcQueueFamilyIndex = TransferFamily;
+		release.dstQueueFamilyIndex = GraphicsFamily;
+		release.buffer = dst;
+		release.offset = offset;
+		release.size = size;
+
+		VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		depInfo.bufferMemoryBarrierCount = 1;
+		depInfo.pBufferMemoryBarriers = &release;
+		vkCmdPipelineBarrier2(batch->CommandBuffer, &depInfo);
+	}
+
+	PendingAcquires.push_back(transfer);
+	return true;
+}
+
+bool UploadEngineVk::UploadImage(VkImage dst, VkImageAspectFlags aspect, VkExtent3D extent, const void* data, VkDeviceSize size, bool fresh, uint64_t frame)
+{
+	if (!data || size == 0)
+		return false;
+
+	StagingSpan staging;
+	if (!AllocateStaging(size, fresh ? 0 : frame, staging))
+		return false;
+
+	memcpy(staging.Mapped, data, size);
+	vmaFlushAllocation(rendersystem->GetAllocator(), staging.Allocation, staging.Offset, size);
+
+	if (!fresh)
+	{
+		FrameCopy copy;
+		copy.Source = staging;
+		copy.Size = size;
+		copy.Image = dst;
+		copy.Aspect = aspect;
+		copy.Extent = extent;
+		FrameCopies.push_back(copy);
+		return true;
+	}
+
+	Batch* batch = GetBatch();
+	if (!batch)
+		return false;
+
+	VkImageMemoryBarrier2 barrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = dst;
+	barrier.subresourceRange.aspectMask = aspect;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+
+	VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.imageMemoryBarrierCount = 1;
+	depInfo.pImageMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(batch->CommandBuffer, &depInfo);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = staging.Offset;
+	region.imageSubresource.aspectMask = aspect;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = extent;
+	vkCmdCopyBufferToImage(batch->CommandBuffer, staging.Buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	if (!SameFamily())
+	{
+		// The layout stays, only ownership moves to the graphics family
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier.dstAccessMask = VK_ACCESS_2_NONE;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = TransferFamily;
+		barrier.dstQueueFamilyIndex = GraphicsFamily;
+		vkCmdPipelineBarrier2(batch->CommandBuffer, &depInfo);
+	}
+
+	// From here on the graphics side treats it as written by a transfer, a second upload goes through the frame.
+	// The acquire barrier and the upload timeline wait both land in the consumer stages, so the next
+	// barrier on the image has to start from there to be ordered after the copy.
+	rendersystem->GetStateTracker().Assume(dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, CONSUMER_STAGES, VK_ACCESS_2_MEMORY_WRITE_BIT);
+
+	OwnershipTransfer transfer;
+	transfer.Image = dst;
+	transfer.Aspect = aspect;
+	PendingAcquires.push_back(transfer);
+	return true;
+}
+
+uint64_t UploadEngineVk::Submit()
+{
+	Batch& batch = Batches[BatchIndex];
+	if (!batch.Recording)
+		return SubmittedValue;
+
+	TRACE_SCOPE("UploadSubmit");
+
+	batch.Recording = false;
+
+	if (vkEndCommandBuffer(batch.CommandBuffer) != VK_SUCCESS)
+	{
+		// std::cout << "failed to record upload batch\n";
+		return SubmittedValue;
+	}
+
+	VkCommandBufferSubmitInfo commandSubmitInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+	commandSubmitInfo.commandBuffer = batch.CommandBuffer;
+
+	VkSemaphoreSubmitInfo signalInfo = RenderUtils::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, Timeline);
+	signalInfo.value = batch.Value;
+
+	VkSubmitInfo2 submitInfo = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandSubmitInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+	if (vkQueueSubmit2(TransferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		// std::cout << "failed to submit upload batch\n";
+		return SubmittedValue;
+	}
+
+	SubmittedValue = batch.Value;
+	BatchIndex = (BatchIndex + 1) % MAX_BATCHES_IN_FLIGHT;
+
+	ReadyAcquires.insert(ReadyAcquires.end(), PendingAcquires.begin(), PendingAcquires.end());
+	PendingAcquires.clear();
+
+	return SubmittedValue;
+}
+
+bool UploadEngineVk::IsPending(uint64_t handle) const
+{
+	auto matches = [handle](const OwnershipTransfer& transfer) {
+		return (transfer.Image != VK_NULL_HANDLE ? (uint64_t)transfer.Image : (uint64_t)transfer.Buffer) == handle;
+	};
+
+	return std::any_of(PendingAcquires.begin(), PendingAcquires.end(), matches) ||
+		std::any_of(ReadyAcquires.begin(), ReadyAcquires.end(), matches);
+}
+
+void UploadEngineVk::RecordGraphicsWork(VkCommandBuffer cmd)
+{
+	if (!ReadyAcquires.empty())
+	{
+		Array<VkBufferMemoryBarrier2> bufferBarriers;
+		Array<VkImageMemoryBarrier2> imageBarriers;
+
+		// Same family needs no transfer, the semaphore wait alone makes the writes visible
+		if (!SameFamily())
+		{
+			for (OwnershipTransfer& transfer : ReadyAcquires)
+			{
+				// Chained to the semaphore wait of the frame submit through the same stages
+				if (transfer.Buffer != VK_NULL_HANDLE)
+				{
+					VkBufferMemoryBarrier2 acquire = { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+					acquire.srcStageMask = CONSUMER_STAGES;
+					acquire.dstStageMask = CONSUMER_STAGES;
+					acquire.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+					acquire.srcQueueFamilyIndex = TransferFamily;
+					acquire.dstQueueFamilyIndex = GraphicsFamily;
+					acquire.buffer = transfer.Buffer;
+					acquire.offset = transfer.Offset;
+					acquire.size = transfer.Size;
+					bufferBarriers.push_back(acquire);
+				}
+				else
+				{
+					VkImageMemoryBarrier2 acquire = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+					acquire.srcStageMask = CONSUMER_STAGES;
+					acquire.dstStageMask = CONSUMER_STAGES;
+					acquire.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+					acquire.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+					acquire.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+					acquire.srcQueueFamilyIndex = TransferFamily;
+					acquire.dstQueueFamilyIndex = GraphicsFamily;
+					acquire.image = transfer.Image;
+					acquire.subresourceRange.aspectMask = transfer.Aspect;
+					acquire.subresourceRange.levelCount = 1;
+					acquire.subresourceRange.layerCount = 1;
+					imageBarriers.push_back(acquire);
+				}
+			}
+
+			VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			depInfo.bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size();
+			depInfo.pBufferMemoryBarriers = bufferBarriers.data();
+			depInfo.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+			depInfo.pImageMemoryBarriers = imageBarriers.data();
+			vkCmdPipelineBarrier2(cmd, &depInfo);
+		}
+
+		ReadyAcquires.clear();
+		AcquiredValue = SubmittedValue;
+	}
+
+	if (FrameCopies.empty())
+		return;
+
+	ResourceStateTracker& tracker = rendersystem->GetStateTracker();
+
+	bool hasBuffers = false;
+	for (FrameCopy& copy : FrameCopies)
+	{
+		if (copy.Image != VK_NULL_HANDLE)
+			tracker.TransitionImage(copy.Image, ResourceUsage::TransferDst);
+		else
+			hasBuffers = true;
+	}
+
+	tracker.Flush(cmd);
+
+	// Earlier work on the queue may still read or write the ranges that get overwritten
+	VkMemoryBarrier2 memoryBarrier = { .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	memoryBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+	memoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+	VkDependencyInfo depInfo = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.memoryBarrierCount = 1;
+	depInfo.pMemoryBarriers = &memoryBarrier;
+
+	if (hasBuffers)
+		vkCmdPipelineBarrier2(cmd, &depInfo);
+
+	// Copies into the same resource are not ordered against each other without a barrier in between
+	Array<uint64_t> written;
+
+	for (FrameCopy& copy : FrameCopies)
+	{
+		uint64_t handle = copy.Image != VK_NULL_HANDLE ? (uint64_t)copy.Image : (uint64_t)copy.Buffer;
+		if (std::find(written.begin(), written.end(), handle) != written.end())
+		{
+			memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+			memoryBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier2(cmd, &depInfo);
+			written.clear();
+		}
+		written.push_back(handle);
+
+		if (copy.Image != VK_NULL_HANDLE)
+		{
+			VkBufferImageCopy region = {};
+			region.bufferOffset = copy.Source.Offset;
+			region.imageSubresource.aspectMask = copy.Aspect;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = copy.Extent;
+			vkCmdCopyBufferToImage(cmd, copy.Source.Buffer, copy.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		}
+		else
+		{
+			VkBufferCopy region = {};
+			region.srcOffset = copy.Source.Offset;
+			region.dstOffset = copy.Offset;
+			region.size = copy.Size;
+			vkCmdCopyBuffer(cmd, copy.Source.Buffer, copy.Buffer, 1, &region);
+		}
+	}
+
+	// Images are picked up by the state tracker, buffers have no tracked state
+	if (hasBuffers)
+	{
+		memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		memoryBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstStageMask = CONSUMER_STAGES;
+		memoryBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+		vkCmdPipelineBarrier2(cmd, &depInfo);
+	}
+
+	FrameCopies.clear();
+}
+
+bool UploadEngineVk::AllocateStaging(VkDeviceSize size, uint64_t frame, StagingSpan& span)
+{
+	VkDeviceSize offset = 0;
+	bool allocated = AllocateFromRing(size, STAGING_ALIGNMENT, offset);
+
+	if (!allocated)
+	{
+		Reclaim();
+		allocated = AllocateFromRing(size, STAGING_ALIGNMENT, offset);
+	}
+
+	// Wait for the oldest transfer batches to drain. Regions of graphics frames can't be waited on here,
+	// the frame that frees them may not even be recorded yet.
+	while (!allocated && size <= STAGING_RING_SIZE && !RingRegions.empty() && RingRegions.front().Timeline == Timeline)
+	{
+		uint64_t value = RingRegions.front().Value;
+		if (value > SubmittedValue)
+			Submit();
+
+		WaitForValue(value);
+		Reclaim();
+		allocated = AllocateFromRing(size, STAGING_ALIGNMENT, offset);
+	}
+
+	// The copy lands in the batch that is open after the waits above
+	VkSemaphore timeline = frame ? rendersystem->GetFrameScheduler().GetTimeline() : Timeline;
+	uint64_t value = frame ? frame : SubmittedValue + 1;
+
+	if (allocated)
+	{
+		RingRegions.push_back({ offset, offset + size, timeline, value });
+
+		span.Buffer = Ring;
+		span.Allocation = RingAllocation;
+		span.Offset = offset;
+		span.Mapped = RingMapped + offset;
+		return true;
+	}
+
+	VkBufferCreateInfo stagingInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	stagingInfo.size = size;
+	stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	VmaAllocationCreateInfo stagingAlloc = {};
+	stagingAlloc.usage = VMA_MEMORY_USAGE_AUTO;
+	stagingAlloc.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	OversizedStaging staging;
+	VmaAllocationInfo stagingResult = {};
+	if (vmaCreateBuffer(rendersystem->GetAllocator(), &stagingInfo, &stagingAlloc, &staging.Buffer, &staging.Allocation, &stagingResult) != VK_SUCCESS)
+	{
+		// std::cout << "failed to create staging buffer\n";
+		return false;
+	}
+
+	staging.Timeline = timeline;
+	staging.Value = value;
+	Oversized.push_back(staging);
+
+	span.Buffer = staging.Buffer;
+	span.Allocation = staging.Allocation;
+	span.Offset = 0;
+	span.Mapped = stagingResult.pMappedData;
+	return true;
+}
+
+bool UploadEngineVk::AllocateFromRing(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	if (size > STAGING_RING_SIZE)
+		return false;
+
+	if (RingRegions.empty())
+		RingHead = 0;
+
+	VkDeviceSize tail = RingRegions.empty() ? 0 : RingRegions.front().Begin;
+	VkDeviceSize aligned = (RingHead + alignment - 1) & ~(alignment - 1);
+
+	// Free space is [head, end) + [0, tail) until the head wraps, then [head, tail)
+	bool wrapped = !RingRegions.empty() && RingHead <= tail;
+
+	if (!wrapped && aligned + size <= STAGING_RING_SIZE)
+		offset = aligned;
+	else if (!wrapped && size <= tail)
+		offset = 0; // the skipped end comes back along with the region in front of it
+	else if (wrapped && aligned + size <= tail)
+		offset = aligned;
+	else
+		return false;
+
+	RingHead = offset + size;
+	return true;
+}
+
+void UploadEngineVk::Reclaim()
+{
+	uint64_t uploadsDone = 0;
+	vkGetSemaphoreCounterValue(rendersystem->GetDevice(), Timeline, &uploadsDone);
+	uint64_t framesDone = rendersystem->GetFrameScheduler().GetCompletedFrame();
+
+	auto isComplete = [&](VkSemaphore timeline, uint64_t value) {
+		return value <= (timeline == Timeline ? uploadsDone : framesDone);
+	};
+
+	// In order, the ring is only ever freed from the tail
+	while (!RingRegions.empty() && isComplete(RingRegions.front().Timeline, RingRegions.front().Value))
+		RingRegions.pop_front();
+
+	VmaAllocator allocator = rendersystem->GetAllocator();
+	for (auto iter = Oversized.begin(); iter != Oversized.end();)
+	{
+		if (isComplete(iter->Timeline, iter->Value))
+		{
+			vmaDestroyBuffer(allocator, iter->Buffer, iter->Allocation);
+			iter = Oversized.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+UploadEngineVk::Batch* UploadEngineVk::GetBatch()
+{
+	Batch& batch = Batches[BatchIndex];
+	if (batch.Recording)
+		return &batch;
+
+	// The slot was last submitted MAX_BATCHES_IN_FLIGHT batches ago
+	WaitForValue(batch.Value);
+
+	VkDevice device = rendersystem->GetDevice();
+	vkResetCommandPool(device, batch.Pool, 0);
+
+	VkCommandBufferBeginInfo beginInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(batch.CommandBuffer, &beginInfo) != VK_SUCCESS)
+		return nullptr;
+
+	batch.Value = SubmittedValue + 1;
+	batch.Recording = true;
+	return &batch;
+}
+
+void UploadEngineVk::WaitForValue(uint64_t value)
+{
+	if (value == 0)
+		return;
+
+	TRACE_SCOPE("UploadWait");
+
+	VkSemaphoreWaitInfo waitInfo = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &Timeline;
+	waitInfo.pValues = &value;
+
+	vkWaitSemaphores(rendersystem->GetDevice(), &waitInfo, UINT64_MAX);
+}
\ No newline at end of file
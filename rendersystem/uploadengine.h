@@ -0,0 +1,150 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+
+#include "vk_mem_alloc.h"
+
+// Streams buffer and image data to the GPU without stalling the frame.
+// Data is written into a persistently mapped staging ring. Resources the graphics queue never touched
+// are copied on the transfer queue and handed to the graphics family with an ownership transfer,
+// the frame that acquires them waits on the upload timeline. Everything else is copied on the
+// graphics queue at the start of the next frame, so ownership never has to travel back.
+class UploadEngineVk
+{
+public:
+	static constexpr VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+	static constexpr uint32_t MAX_BATCHES_IN_FLIGHT = 4;
+
+	// Graphics stages that may consume uploaded data, the frame waits on the upload timeline there
+	static constexpr VkPipelineStageFlags2 CONSUMER_STAGES =
+		VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+		VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+
+	bool Init(VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily);
+	void Destroy();
+
+	// A fresh resource has never been used by the graphics queue, it can be written on the transfer queue.
+	// The frame value is the graphics frame the copy lands in otherwise.
+	bool UploadBuffer(VkBuffer dst, VkDeviceSize offset, const void* data, VkDeviceSize size, bool fresh, uint64_t frame);
+	bool UploadImage(VkImage dst, VkImageAspectFlags aspect, VkExtent3D extent, const void* data, VkDeviceSize size, bool fresh, uint64_t frame);
+
+	// Submit the open transfer batch, returns the upload timeline value the next frame has to wait for
+	uint64_t Submit();
+
+	// Acquire barriers for everything the submitted batches released, then the queued graphics copies.
+	// Has to be recorded outside of a render pass.
+	void RecordGraphicsWork(VkCommandBuffer cmd);
+
+	// The resource has a transfer copy that no frame acquired yet, in the open batch or a submitted one.
+	// A graphics copy into it has to wait for the acquire.
+	bool IsPending(uint64_t handle) const;
+
+	bool HasGraphicsWork() const { return !ReadyAcquires.empty() || !FrameCopies.empty(); }
+
+	VkSemaphore GetTimeline() const { return Timeline; }
+	uint64_t GetSubmittedValue() const { return SubmittedValue; }
+
+	// Latest batch whose resources were acquired on the graphics queue, the frame submit waits for it
+	uint64_t GetAcquiredValue() const { return AcquiredValue; }
+
+private:
+
+	struct StagingSpan
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VmaAllocation Allocation = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+		void* Mapped = nullptr;
+	};
+
+	// A piece of staging memory in use until its timeline reaches the value
+	struct StagingRegion
+	{
+		VkDeviceSize Begin = 0;
+		VkDeviceSize End = 0;
+		VkSemaphore Timeline = VK_NULL_HANDLE;
+		uint64_t Value = 0;
+	};
+
+	// Uploads that don't fit in the ring get their own staging buffer
+	struct OversizedStaging
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VmaAllocation Allocation = VK_NULL_HANDLE;
+		VkSemaphore Timeline = VK_NULL_HANDLE;
+		uint64_t Value = 0;
+	};
+
+	struct Batch
+	{
+		VkCommandPool Pool = VK_NULL_HANDLE;
+		VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+		uint64_t Value = 0;
+		bool Recording = false;
+	};
+
+	struct OwnershipTransfer
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+		VkDeviceSize Size = 0;
+
+		VkImage Image = VK_NULL_HANDLE;
+		VkImageAspectFlags Aspect = 0;
+	};
+
+	struct FrameCopy
+	{
+		StagingSpan Source;
+		VkDeviceSize Size = 0;
+
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+
+		VkImage Image = VK_NULL_HANDLE;
+		VkImageAspectFlags Aspect = 0;
+		VkExtent3D Extent = {};
+	};
+
+	// Staging for a copy in the given graphics frame, or in the open transfer batch when the frame is 0
+	bool AllocateStaging(VkDeviceSize size, uint64_t frame, StagingSpan& span);
+	bool AllocateFromRing(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+	// Free staging memory whose timeline value has been reached
+	void Reclaim();
+
+	// Open batch on the transfer queue, begins one if needed
+	Batch* GetBatch();
+
+	bool SameFamily() const { return TransferFamily == GraphicsFamily; }
+
+	void WaitForValue(uint64_t value);
+
+	VkQueue TransferQueue = VK_NULL_HANDLE;
+	uint32_t TransferFamily = 0;
+	uint32_t GraphicsFamily = 0;
+
+	VkSemaphore Timeline = VK_NULL_HANDLE;
+	uint64_t SubmittedValue = 0;
+	uint64_t AcquiredValue = 0;
+
+	ConstArray<Batch, MAX_BATCHES_IN_FLIGHT> Batches;
+	uint32_t BatchIndex = 0;
+
+	VkBuffer Ring = VK_NULL_HANDLE;
+	VmaAllocation RingAllocation = VK_NULL_HANDLE;
+	char* RingMapped = nullptr;
+	VkDeviceSize RingHead = 0;
+	Queue<StagingRegion> RingRegions;
+
+	Array<OversizedStaging> Oversized;
+
+	// Released by the open batch, and by submitted batches still to be acquired
+	Array<OwnershipTransfer> PendingAcquires;
+	Array<OwnershipTransfer> ReadyAcquires;
+
+	Array<FrameCopy> FrameCopies;
+};
\ No newline at end of file
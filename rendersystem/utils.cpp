@@ -6,47 +6,6 @@
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
 
-void RenderUtils::DescriptorPoolHelper::Init(VkDevice device, uint32_t maxSets, Span<PoolSizeRatio> poolRatios)
-{
-    Array<VkDescriptorPoolSize> poolSizes;
-    for (PoolSizeRatio ratio : poolRatios) {
-        poolSizes.push_back(VkDescriptorPoolSize{
-            .type = ratio.Type,
-            .descriptorCount = uint32_t(ratio.Ratio * maxSets)
-            });
-    }
-
-    VkDescriptorPoolCreateInfo pool_info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-    pool_info.flags = 0;
-    pool_info.maxSets = maxSets;
-    pool_info.poolSizeCount = (uint32_t)poolSizes.size();
-    pool_info.pPoolSizes = poolSizes.data();
-
-    vkCreateDescriptorPool(device, &pool_info, nullptr, &Pool);
-}
-void RenderUtils::DescriptorPoolHelper::Clear(VkDevice device)
-{
-    vkResetDescriptorPool(device, Pool, 0);
-}
-void RenderUtils::DescriptorPoolHelper::Destroy(VkDevice device)
-{
-    vkDestroyDescriptorPool(device, Pool, nullptr);
-}
-
-VkDescriptorSet RenderUtils::DescriptorPoolHelper::Build(VkDevice device, VkDescriptorSetLayout layout)
-{
-    VkDescriptorSetAllocateInfo allocInfo = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-    allocInfo.pNext = nullptr;
-    allocInfo.descriptorPool = Pool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &layout;
-
-    VkDescriptorSet descriptorSet;
-    vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
-
-    return descriptorSet;
-}
-
 VkImageCreateInfo RenderUtils::image_create_info(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent, VkImageType type, uint32_t mipLevels, uint32_t arrayLayers)
 {
     VkImageCreateInfo info = {};
@@ -104,35 +63,54 @@ VkSemaphoreSubmitInfo RenderUtils::semaphore_submit_info(VkPipelineStageFlags2 s
 }
 
 VkShaderModule RenderUtils::load_shader_module(VkDevice device, const char* filePath)
+{
+    Array<uint32_t> code;
+    if (!read_spirv(filePath, code))
+        return nullptr;
+
+    return create_shader_module(device, code);
+}
+
+bool RenderUtils::read_spirv(const char* filePath, Array<uint32_t>& code)
 {
     // open the file. With cursor at the end
     std::ifstream file(filePath, std::ios::ate | std::ios::binary);
 
     if (!file.is_open()) {
-        return nullptr;
+        return false;
     }
 
     // find what the size of the file is by looking up the location of the cursor
     size_t fileSize = (size_t)file.tellg();
 
     // spirv expects the buffer to be aligned to uint32
-    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
+    code.resize(fileSize / sizeof(uint32_t));
 
     // put file cursor back to beginning
     file.seekg(0);
 
     // load the entire file into the buffer
-    file.read((char*)buffer.data(), fileSize);
+    file.read((char*)code.data(), code.size() * sizeof(uint32_t));
 
     file.close();
 
+    return !code.empty();
+}
+
+VkShaderModule RenderUtils::create_shader_module(VkDevice device, const Array<uint32_t>& code)
+{
+    // codeSize has to be in bytes, multiply by size of int
+    return create_shader_module(device, code.data(), code.size() * sizeof(uint32_t));
+}
+
+VkShaderModule RenderUtils::create_shader_module(VkDevice device, const uint32_t* code, size_t size)
+{
     VkShaderModuleCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.pNext = nullptr;
 
-    // codeSize has to be in bytes, multiply by size of int
-    createInfo.codeSize = buffer.size() * sizeof(uint32_t);
-    createInfo.pCode = buffer.data();
+    createInfo.codeSize = size;
+    createInfo.pCode = code;
 
     VkShaderModule shaderModule;
     if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -233,6 +211,12 @@ VkFormat RenderUtils::BufferFormatToVulkan(BufferFormat fmt)
         return VK_FORMAT_R16G16B16A16_SFLOAT;
     case BufferFormat::RGBA32F:
         return VK_FORMAT_R32G32B32A32_SFLOAT;
+    case BufferFormat::D16:
+        return VK_FORMAT_D16_UNORM;
+    case BufferFormat::D32F:
+        return VK_FORMAT_D32_SFLOAT;
+    case BufferFormat::D24S8:
+        return VK_FORMAT_D24_UNORM_S8_UINT;
     default:
         assert(0);
         return VK_FORMAT_UNDEFINED;
@@ -244,7 +228,8 @@ VkDescriptorType RenderUtils::DescriptorTypeToVulkan(DescriptorType type)
     switch (type)
     {
     case DescriptorType::ConstantBuffer :
-        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        // always bound from the per-frame constant ring
+        return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     case DescriptorType::StorageBuffer:
         return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     case DescriptorType::StorageImage:
@@ -338,6 +323,219 @@ VkFrontFace RenderUtils::PolygonWindingToVulkan(PolygonWinding winding)
     }
 }
 
+VkFormat RenderUtils::VertexFormatToVulkan(BufferFormat fmt)
+{
+    // Vertex data is mostly floats and normalized colors, unlike render targets
+    switch (fmt)
+    {
+    case BufferFormat::R32F:
+        return VK_FORMAT_R32_SFLOAT;
+    case BufferFormat::RG32F:
+        return VK_FORMAT_R32G32_SFLOAT;
+    case BufferFormat::RGB32F:
+        return VK_FORMAT_R32G32B32_SFLOAT;
+    case BufferFormat::RGBA32F:
+        return VK_FORMAT_R32G32B32A32_SFLOAT;
+    case BufferFormat::RG16F:
+        return VK_FORMAT_R16G16_SFLOAT;
+    case BufferFormat::RGBA16F:
+        return VK_FORMAT_R16G16B16A16_SFLOAT;
+    case BufferFormat::RGBA8:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    default:
+        return BufferFormatToVulkan(fmt);
+    }
+}
+
+VkAttachmentLoadOp RenderUtils::AttachmentLoadOpToVulkan(AttachmentLoadOp op)
+{
+    switch (op)
+    {
+    case AttachmentLoadOp::Load:
+        return VK_ATTACHMENT_LOAD_OP_LOAD;
+    case AttachmentLoadOp::Clear:
+        return VK_ATTACHMENT_LOAD_OP_CLEAR;
+    case AttachmentLoadOp::DontCare:
+        return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    default:
+        return VK_ATTACHMENT_LOAD_OP_MAX_ENUM;
+    }
+}
+
+VkAttachmentStoreOp RenderUtils::AttachmentStoreOpToVulkan(AttachmentStoreOp op)
+{
+    switch (op)
+    {
+    case AttachmentStoreOp::Store:
+        return VK_ATTACHMENT_STORE_OP_STORE;
+    case AttachmentStoreOp::DontCare:
+        return VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    default:
+        return VK_ATTACHMENT_STORE_OP_MAX_ENUM;
+    }
+}
+
+VkBlendFactor RenderUtils::BlendFactorToVulkan(BlendFactor factor)
+{
+    switch (factor)
+    {
+    case BlendFactor::Zero:
+        return VK_BLEND_FACTOR_ZERO;
+    case BlendFactor::One:
+        return VK_BLEND_FACTOR_ONE;
+    case BlendFactor::SrcColor:
+        return VK_BLEND_FACTOR_SRC_COLOR;
+    case BlendFactor::InvSrcColor:
+        return VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+    case BlendFactor::SrcAlpha:
+        return VK_BLEND_FACTOR_SRC_ALPHA;
+    case BlendFactor::InvSrcAlpha:
+        return VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    case BlendFactor::DstColor:
+        return VK_BLEND_FACTOR_DST_COLOR;
+    case BlendFactor::InvDstColor:
+        return VK_BLEND_FACTOR_ONE_MINUS_DST_COLOR;
+    case BlendFactor::DstAlpha:
+        return VK_BLEND_FACTOR_DST_ALPHA;
+    case BlendFactor::InvDstAlpha:
+        return VK_BLEND_FACTOR_ONE_MINUS_DST_ALPHA;
+    default:
+        return VK_BLEND_FACTOR_MAX_ENUM;
+    }
+}
+
+VkBlendOp RenderUtils::BlendOpToVulkan(BlendOp op)
+{
+    switch (op)
+    {
+    case BlendOp::Add:
+        return VK_BLEND_OP_ADD;
+    case BlendOp::Subtract:
+        return VK_BLEND_OP_SUBTRACT;
+    case BlendOp::ReverseSubtract:
+        return VK_BLEND_OP_REVERSE_SUBTRACT;
+    case BlendOp::Min:
+        return VK_BLEND_OP_MIN;
+    case BlendOp::Max:
+        return VK_BLEND_OP_MAX;
+    default:
+        return VK_BLEND_OP_MAX_ENUM;
+    }
+}
+
+VkCompareOp RenderUtils::CompareOpToVulkan(CompareOp op)
+{
+    switch (op)
+    {
+    case CompareOp::Never:
+        return VK_COMPARE_OP_NEVER;
+    case CompareOp::Less:
+        return VK_COMPARE_OP_LESS;
+    case CompareOp::Equal:
+        return VK_COMPARE_OP_EQUAL;
+    case CompareOp::LessOrEqual:
+        return VK_COMPARE_OP_LESS_OR_EQUAL;
+    case CompareOp::Greater:
+        return VK_COMPARE_OP_GREATER;
+    case CompareOp::NotEqual:
+        return VK_COMPARE_OP_NOT_EQUAL;
+    case CompareOp::GreaterOrEqual:
+        return VK_COMPARE_OP_GREATER_OR_EQUAL;
+    case CompareOp::Always:
+        return VK_COMPARE_OP_ALWAYS;
+    default:
+        return VK_COMPARE_OP_MAX_ENUM;
+    }
+}
+
+VkPipelineColorBlendAttachmentState RenderUtils::color_blend_attachment(const BlendState& blend)
+{
+    VkPipelineColorBlendAttachmentState attachment = {};
+    attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    attachment.blendEnable = blend.enable;
+
+    if (blend.enable)
+    {
+        attachment.srcColorBlendFactor = BlendFactorToVulkan(blend.src_factor);
+        attachment.dstColorBlendFactor = BlendFactorToVulkan(blend.dst_factor);
+        attachment.colorBlendOp = BlendOpToVulkan(blend.op);
+        attachment.srcAlphaBlendFactor = BlendFactorToVulkan(blend.src_alpha_factor);
+        attachment.dstAlphaBlendFactor = BlendFactorToVulkan(blend.dst_alpha_factor);
+        attachment.alphaBlendOp = BlendOpToVulkan(blend.alpha_op);
+    }
+
+    return attachment;
+}
+
+bool RenderUtils::IsDepthFormat(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool RenderUtils::HasStencil(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint32_t RenderUtils::FormatTexelSize(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_A8_UNORM_KHR:
+    case VK_FORMAT_R8_UINT:
+        return 1;
+    case VK_FORMAT_R16_UINT:
+    case VK_FORMAT_R16_SFLOAT:
+    case VK_FORMAT_R8G8_UINT:
+    case VK_FORMAT_D16_UNORM:
+        return 2;
+    case VK_FORMAT_R8G8B8_UINT:
+        return 3;
+    case VK_FORMAT_R32_UINT:
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_R16G16_UINT:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R8G8B8A8_UINT:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+        return 4;
+    case VK_FORMAT_R16G16B16_UINT:
+    case VK_FORMAT_R16G16B16_SFLOAT:
+        return 6;
+    case VK_FORMAT_R32G32_UINT:
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_R16G16B16A16_UINT:
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return 8;
+    case VK_FORMAT_R32G32B32_UINT:
+    case VK_FORMAT_R32G32B32_SFLOAT:
+        return 12;
+    case VK_FORMAT_R32G32B32A32_UINT:
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
 void RenderUtils::DescriptorLayoutBuilder::AddBinding(uint32_t binding, VkDescriptorType type, VkShaderStageFlagBits stage)
 {
     VkDescriptorSetLayoutBinding newbind{};
@@ -377,6 +575,13 @@ void RenderUtils::GraphicsPipelineBuilder::SetShaders(VkShaderModule vertexShade
     Stages.push_back(RenderUtils::shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
 
+void RenderUtils::GraphicsPipelineBuilder::SetSpecialization(const VkSpecializationInfo* specialization)
+{
+    bool empty = !specialization || specialization->mapEntryCount == 0;
+    for (VkPipelineShaderStageCreateInfo& stage : Stages)
+        stage.pSpecializationInfo = empty ? nullptr : specialization;
+}
+
 void RenderUtils::GraphicsPipelineBuilder::SetTopology(VkPrimitiveTopology topology)
 {
     InputAssembly.topology = topology;
@@ -394,6 +599,33 @@ void RenderUtils::GraphicsPipelineBuilder::SetCullMode(VkCullModeFlagBits cullFl
     Rasterizer.frontFace = frontFace;
 }
 
+void RenderUtils::GraphicsPipelineBuilder::SetColorAttachmentFormat(VkFormat format)
+{
+    ColorAttachmentformat = format;
+}
+
+void RenderUtils::GraphicsPipelineBuilder::SetVertexLayout(uint32_t stride, const Array<VkVertexInputAttributeDescription>& attributes)
+{
+    VertexBindings.clear();
+    VertexBindings.push_back({ 0, stride, VK_VERTEX_INPUT_RATE_VERTEX });
+
+    VertexAttributes = attributes;
+}
+
+void RenderUtils::GraphicsPipelineBuilder::SetDepthFormat(VkFormat format)
+{
+    RenderInfo.depthAttachmentFormat = format;
+    RenderInfo.stencilAttachmentFormat = HasStencil(format) ? format : VK_FORMAT_UNDEFINED;
+
+    // Depth test, write and compare op are dynamic, these only apply to passes without depth
+    bool depth = format != VK_FORMAT_UNDEFINED;
+    DepthStencil.depthTestEnable = depth;
+    DepthStencil.depthWriteEnable = depth;
+    DepthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    DepthStencil.minDepthBounds = 0.0f;
+    DepthStencil.maxDepthBounds = 1.0f;
+}
+
 void RenderUtils::GraphicsPipelineBuilder::Clear()
 {
     InputAssembly = { .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
@@ -403,6 +635,7 @@ void RenderUtils::GraphicsPipelineBuilder::Clear()
     PipelineLayout = {};
     DepthStencil = { .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
     RenderInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+    Flags = 0;
 
     // Default to no MSAA
     Multisampling.sampleShadingEnable = VK_FALSE;
@@ -418,10 +651,17 @@ void RenderUtils::GraphicsPipelineBuilder::Clear()
 
     Rasterizer.lineWidth = 1.0f;
 
+    // HDR color target, no depth
+    ColorAttachmentformat = VK_FORMAT_R16G16B16A16_SFLOAT;
+    SetDepthFormat(VK_FORMAT_UNDEFINED);
+
+    VertexBindings.clear();
+    VertexAttributes.clear();
+
     Stages.clear();
 }
 
-VkPipeline RenderUtils::GraphicsPipelineBuilder::Build(VkDevice device)
+VkPipeline RenderUtils::GraphicsPipelineBuilder::Build(VkDevice device, VkPipelineCache cache, const void* next)
 {
     // make viewport state from our stored viewport and scissor.
     VkPipelineViewportStateCreateInfo viewportState = {};
@@ -437,15 +677,24 @@ VkPipeline RenderUtils::GraphicsPipelineBuilder::Build(VkDevice device)
 
     colorBlending.logicOpEnable = VK_FALSE;
     colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
+    colorBlending.attachmentCount = ColorAttachmentformat != VK_FORMAT_UNDEFINED ? 1 : 0;
     colorBlending.pAttachments = &ColorBlendAttachment;
 
-    // dummy VertexInputStateCreateInfo, we have no need for it
+    RenderInfo.colorAttachmentCount = colorBlending.attachmentCount;
+    RenderInfo.pColorAttachmentFormats = &ColorAttachmentformat;
+
+    // empty unless the shader reads a vertex buffer
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+    vertexInputInfo.vertexBindingDescriptionCount = (uint32_t)VertexBindings.size();
+    vertexInputInfo.pVertexBindingDescriptions = VertexBindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t)VertexAttributes.size();
+    vertexInputInfo.pVertexAttributeDescriptions = VertexAttributes.data();
 
     // build the pipeline create structure
     VkGraphicsPipelineCreateInfo pipelineInfo = { .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
     pipelineInfo.pNext = &RenderInfo;
+    pipelineInfo.flags = Flags;
+    RenderInfo.pNext = next;
 
     pipelineInfo.stageCount = (uint32_t)Stages.size();
     pipelineInfo.pStages = Stages.data();
@@ -458,15 +707,26 @@ VkPipeline RenderUtils::GraphicsPipelineBuilder::Build(VkDevice device)
     pipelineInfo.pDepthStencilState = &DepthStencil;
     pipelineInfo.layout = PipelineLayout;
 
-    VkDynamicState state[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    // Depth and raster state are core dynamic state since 1.3, changing them needs no other pipeline
+    VkDynamicState state[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR,
+        VK_DYNAMIC_STATE_CULL_MODE,
+        VK_DYNAMIC_STATE_FRONT_FACE,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+        VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_BIAS,
+    };
     VkPipelineDynamicStateCreateInfo dynamicInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
     dynamicInfo.pDynamicStates = &state[0];
-    dynamicInfo.dynamicStateCount = 2;
+    dynamicInfo.dynamicStateCount = (uint32_t)std::size(state);
 
     pipelineInfo.pDynamicState = &dynamicInfo;
 
     VkPipeline newPipeline;
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS) 
+    if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS) 
     {
         return VK_NULL_HANDLE; // failed to create graphics pipeline
     }
@@ -8,6 +8,9 @@ namespace RenderUtils
 	VkImageViewCreateInfo imageview_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspectFlags, VkImageViewType type = VK_IMAGE_VIEW_TYPE_2D, uint32_t mipLevels = 1, uint32_t arrayLayers = 1);
 	VkSemaphoreSubmitInfo semaphore_submit_info(VkPipelineStageFlags2 stageMask, VkSemaphore semaphore);
 	VkShaderModule load_shader_module(VkDevice device, const char* filePath);
+	bool read_spirv(const char* filePath, Array<uint32_t>& code);
+	VkShaderModule create_shader_module(VkDevice device, const Array<uint32_t>& code);
+	VkShaderModule create_shader_module(VkDevice device, const uint32_t* code, size_t size);
 	VkPipelineShaderStageCreateInfo shader_stage_create_info(VkShaderStageFlagBits stage, VkShaderModule shader);
 	VkRenderingInfo rendering_info(VkExtent2D renderExtent, VkRenderingAttachmentInfo* colorAttachment, VkRenderingAttachmentInfo* depthAttachment, uint32_t attachment_count = 1);
 	VkRenderingAttachmentInfo attachment_info(VkImageView view, VkClearValue* clear = nullptr, VkImageLayout layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -21,6 +24,21 @@ namespace RenderUtils
 	VkPolygonMode PolygonModeToVulkan(PolygonMode mode);
 	VkCullModeFlagBits CullModeFlagsToVulkan(CullModeFlags flags);
 	VkFrontFace PolygonWindingToVulkan(PolygonWinding winding);
+	VkFormat VertexFormatToVulkan(BufferFormat fmt);
+	VkAttachmentLoadOp AttachmentLoadOpToVulkan(AttachmentLoadOp op);
+	VkAttachmentStoreOp AttachmentStoreOpToVulkan(AttachmentStoreOp op);
+	VkBlendFactor BlendFactorToVulkan(BlendFactor factor);
+	VkBlendOp BlendOpToVulkan(BlendOp op);
+	VkCompareOp CompareOpToVulkan(CompareOp op);
+
+	// Every color channel written, factors only filled in when blending is on
+	VkPipelineColorBlendAttachmentState color_blend_attachment(const BlendState& blend);
+
+	bool IsDepthFormat(VkFormat format);
+	bool HasStencil(VkFormat format);
+
+	// Bytes per texel of the uncompressed formats render targets use, 0 when unknown
+	uint32_t FormatTexelSize(VkFormat format);
 
 	class GraphicsPipelineBuilder {
 	public:
@@ -34,17 +52,31 @@ namespace RenderUtils
 		VkPipelineDepthStencilStateCreateInfo DepthStencil;
 		VkPipelineRenderingCreateInfo RenderInfo;
 		VkFormat ColorAttachmentformat;
+		Array<VkVertexInputBindingDescription> VertexBindings;
+		Array<VkVertexInputAttributeDescription> VertexAttributes;
+		VkPipelineCreateFlags Flags;
 
 		GraphicsPipelineBuilder() { Clear(); }
 
 		void SetShaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+
+		// Same constants for every stage, ids a stage doesn't declare are ignored. Null or empty for none.
+		void SetSpecialization(const VkSpecializationInfo* specialization);
 		void SetTopology(VkPrimitiveTopology topology);
 		void SetPolygonMode(VkPolygonMode polygonMode);
 		void SetCullMode(VkCullModeFlagBits cullFlags, VkFrontFace frontFace);
 
+		// Must match the passes the pipeline is used in, VK_FORMAT_UNDEFINED for no attachment
+		void SetColorAttachmentFormat(VkFormat format);
+		void SetDepthFormat(VkFormat format);
+
+		// Single interleaved vertex buffer at binding 0
+		void SetVertexLayout(uint32_t stride, const Array<VkVertexInputAttributeDescription>& attributes);
+
 		void Clear();
 
-		VkPipeline Build(VkDevice device);
+		// next is chained in front of the rendering info
+		VkPipeline Build(VkDevice device, VkPipelineCache cache = VK_NULL_HANDLE, const void* next = nullptr);
 	};
 
 	class DescriptorLayoutBuilder
@@ -58,20 +90,4 @@ namespace RenderUtils
 
 		Array<VkDescriptorSetLayoutBinding> Bindings;
 	};
-
-	struct DescriptorPoolHelper {
-
-		struct PoolSizeRatio {
-			VkDescriptorType Type;
-			float Ratio;
-		};
-
-		VkDescriptorPool Pool;
-
-		void Init(VkDevice device, uint32_t maxSets, Span<PoolSizeRatio> poolRatios);
-		void Clear(VkDevice device);
-		void Destroy(VkDevice device);
-
-		VkDescriptorSet Build(VkDevice device, VkDescriptorSetLayout layout);
-	};
 }
\ No newline at end of file
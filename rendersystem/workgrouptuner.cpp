@@ -0,0 +1,370 @@
+#include "common_stl.h"
+#include "workgrouptuner.h"
+#include "shader.h"
+#include "libcommon/hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// Shapes worth trying, by how many dimensions the dispatch has. Sizes over the device limits are left out.
+static const uint32_t LINEAR_SIZES[][3] = { { 32, 1, 1 }, { 64, 1, 1 }, { 128, 1, 1 }, { 256, 1, 1 }, { 512, 1, 1 }, { 1024, 1, 1 } };
+static const uint32_t TILE_SIZES[][3] = { { 8, 4, 1 }, { 8, 8, 1 }, { 16, 4, 1 }, { 16, 8, 1 }, { 16, 16, 1 }, { 32, 4, 1 }, { 32, 8, 1 }, { 32, 16, 1 }, { 64, 4, 1 } };
+static const uint32_t VOLUME_SIZES[][3] = { { 4, 4, 4 }, { 8, 4, 4 }, { 8, 8, 4 }, { 8, 8, 8 }, { 16, 8, 2 } };
+
+bool WorkgroupTunerVk::Init(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits, const char* filepath)
+{
+	Device = device;
+	Properties = properties;
+	Filepath = filepath;
+
+	Load();
+
+	// Queue family can't write timestamps, nothing can be measured
+	if (timestampValidBits == 0)
+		return false;
+
+	TimestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+
+	VkQueryPoolCreateInfo poolInfo = { .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = MAX_SAMPLES_PER_FRAME * 2;
+
+	for (SlotQueries& slot : Slots)
+	{
+		if (vkCreateQueryPool(Device, &poolInfo, nullptr, &slot.Pool) != VK_SUCCESS)
+			return false;
+
+		slot.Samples.reserve(MAX_SAMPLES_PER_FRAME);
+	}
+
+	Enabled = true;
+	return true;
+}
+
+void WorkgroupTunerVk::Destroy()
+{
+	Save();
+
+	for (SlotQueries& slot : Slots)
+	{
+		if (slot.Pool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(Device, slot.Pool, nullptr);
+
+		slot = SlotQueries{};
+	}
+
+	Enabled = false;
+}
+
+void WorkgroupTunerVk::BeginFrame(VkCommandBuffer cmd, uint32_t slotIndex)
+{
+	if (!Enabled)
+		return;
+
+	std::lock_guard<std::mutex> lock(TunerMutex);
+
+	ResolveSlot(slotIndex);
+
+	CurrentSlot = slotIndex;
+	Slots[slotIndex].Samples.clear();
+
+	vkCmdResetQueryPool(cmd, Slots[slotIndex].Pool, 0, MAX_SAMPLES_PER_FRAME * 2);
+}
+
+VkPipeline WorkgroupTunerVk::Select(ShaderVk* shader, const uint32_t threads[3], uint32_t size[3], uint32_t* sample)
+{
+	if (sample)
+		*sample = NO_SAMPLE;
+
+	const ConstArray<uint32_t, 3>& baseSize = shader->GetWorkgroupSize();
+	std::copy(baseSize.begin(), baseSize.end(), size);
+
+	VkPipeline basePipeline = shader->GetPipeline();
+	if (!shader->IsAutotuned())
+		return basePipeline;
+
+	uint64_t key = shader->GetCodeHash();
+	for (uint32_t i = 0; i < 3; ++i)
+		key = Hash::Combine(key, threads[i]);
+
+	std::lock_guard<std::mutex> lock(TunerMutex);
+
+	auto resultIter = Results.find(key);
+	if (resultIter != Results.end())
+	{
+		// The size from disk still has to be compiled, the shader's own one fills in until then
+		VkPipeline pipeline;
+		if (shader->GetComputeVariant(resultIter->second.data(), pipeline) && pipeline != VK_NULL_HANDLE)
+		{
+			std::copy(resultIter->second.begin(), resultIter->second.end(), size);
+			return pipeline;
+		}
+
+		return basePipeline;
+	}
+
+	// Command contexts and the async queue only use finished results
+	if (!Enabled || !sample)
+		return basePipeline;
+
+	SlotQueries& slot = Slots[CurrentSlot];
+	if (slot.Samples.size() >= MAX_SAMPLES_PER_FRAME)
+		return basePipeline;
+
+	auto [tuningIter, inserted] = Tunings.try_emplace(key);
+	Tuning& tuning = tuningIter->second;
+	if (inserted)
+		MakeCandidates(shader, threads, tuning);
+
+	// Round robin over the candidates still short of samples, whatever else runs on the GPU hits all of them alike
+	uint32_t count = (uint32_t)tuning.Candidates.size();
+	bool pending = false;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t index = (tuning.Next + i) % count;
+		Candidate& candidate = tuning.Candidates[index];
+		if (candidate.Failed || candidate.Requested >= SAMPLES_PER_CANDIDATE)
+			continue;
+
+		VkPipeline pipeline;
+		if (!shader->GetComputeVariant(candidate.Size.data(), pipeline))
+		{
+			candidate.Failed = true;
+			continue;
+		}
+
+		// Still compiling, measured on a later dispatch
+		pending = true;
+		if (pipeline == VK_NULL_HANDLE)
+			continue;
+
+		candidate.Requested++;
+		tuning.Next = index + 1;
+
+		*sample = (uint32_t)slot.Samples.size();
+		slot.Samples.push_back({ key, index });
+
+		std::copy(candidate.Size.begin(), candidate.Size.end(), size);
+		return pipeline;
+	}
+
+	// Nothing left that could be measured, the samples in flight finish it otherwise
+	bool inFlight = std::any_of(tuning.Candidates.begin(), tuning.Candidates.end(), [](const Candidate& candidate)
+	{
+		return !candidate.Failed && candidate.Ticks.size() < candidate.Requested;
+	});
+	if (!pending && !inFlight)
+		Finish(key, tuning);
+
+	return basePipeline;
+}
+
+void WorkgroupTunerVk::BeginSample(VkCommandBuffer cmd, uint32_t sample)
+{
+	if (sample == NO_SAMPLE)
+		return;
+
+	// Once everything recorded before is done, top of pipe would count the tail of the previous work too
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, Slots[CurrentSlot].Pool, sample * 2);
+}
+
+void WorkgroupTunerVk::EndSample(VkCommandBuffer cmd, uint32_t sample)
+{
+	if (sample == NO_SAMPLE)
+		return;
+
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, Slots[CurrentSlot].Pool, sample * 2 + 1);
+}
+
+void WorkgroupTunerVk::ResolveSlot(uint32_t slotIndex)
+{
+	SlotQueries& slot = Slots[slotIndex];
+	if (slot.Samples.empty())
+		return;
+
+	uint32_t queryCount = (uint32_t)slot.Samples.size() * 2;
+
+	// Pairs of timestamp and availability
+	Array<uint64_t> results(queryCount * 2);
+
+	VkResult res = vkGetQueryPoolResults(Device, slot.Pool, 0, queryCount, results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t) * 2,
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	bool read = res == VK_SUCCESS || res == VK_NOT_READY;
+
+	Array<uint64_t> finished;
+	for (uint32_t i = 0; i < slot.Samples.size(); ++i)
+	{
+		const Sample& sample = slot.Samples[i];
+
+		auto tuningIter = Tunings.find(sample.Key);
+		if (tuningIter == Tunings.end())
+			continue;
+
+		Tuning& tuning = tuningIter->second;
+		Candidate& candidate = tuning.Candidates[sample.Candidate];
+
+		uint64_t* begin = &results[i * 4];
+		uint64_t* end = &results[i * 4 + 2];
+
+		// A lost sample is asked for again
+		if (!read || begin[1] == 0 || end[1] == 0)
+		{
+			candidate.Requested--;
+			continue;
+		}
+
+		candidate.Ticks.push_back(((end[0] & TimestampMask) - (begin[0] & TimestampMask)) & TimestampMask);
+
+		bool complete = std::all_of(tuning.Candidates.begin(), tuning.Candidates.end(), [](const Candidate& other)
+		{
+			return other.Failed || other.Ticks.size() >= SAMPLES_PER_CANDIDATE;
+		});
+		if (complete)
+			finished.push_back(sample.Key);
+	}
+
+	for (uint64_t key : finished)
+	{
+		auto tuningIter = Tunings.find(key);
+		if (tuningIter != Tunings.end())
+			Finish(key, tuningIter->second);
+	}
+}
+
+void WorkgroupTunerVk::Finish(uint64_t key, Tuning& tuning)
+{
+	// Medians, a frame that got interrupted doesn't count against a size
+	const Candidate* best = nullptr;
+	uint64_t bestTicks = UINT64_MAX;
+	for (Candidate& candidate : tuning.Candidates)
+	{
+		if (candidate.Failed || candidate.Ticks.empty())
+			continue;
+
+		std::sort(candidate.Ticks.begin(), candidate.Ticks.end());
+		uint64_t median = candidate.Ticks[candidate.Ticks.size() / 2];
+		if (median < bestTicks)
+		{
+			bestTicks = median;
+			best = &candidate;
+		}
+	}
+
+	// Nothing could be measured, or the limits left no candidate at all
+	Results[key] = best ? best->Size : tuning.BaseSize;
+	Tunings.erase(key);
+}
+
+void WorkgroupTunerVk::MakeCandidates(const ShaderVk* shader, const uint32_t threads[3], Tuning& tuning) const
+{
+	const VkPhysicalDeviceLimits& limits = Properties.limits;
+
+	auto addCandidate = [&](const uint32_t* size)
+	{
+		if (size[0] * size[1] * size[2] > limits.maxComputeWorkGroupInvocations)
+			return;
+
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			if (size[i] > limits.maxComputeWorkGroupSize[i])
+				return;
+		}
+
+		for (const Candidate& candidate : tuning.Candidates)
+		{
+			if (std::equal(candidate.Size.begin(), candidate.Size.end(), size))
+				return;
+		}
+
+		Candidate candidate;
+		std::copy(size, size + 3, candidate.Size.begin());
+		tuning.Candidates.push_back(candidate);
+	};
+
+	tuning.BaseSize = shader->GetWorkgroupSize();
+	addCandidate(tuning.BaseSize.data());
+
+	if (threads[2] > 1)
+	{
+		for (const uint32_t* size : VOLUME_SIZES)
+			addCandidate(size);
+	}
+	else if (threads[1] > 1)
+	{
+		for (const uint32_t* size : TILE_SIZES)
+			addCandidate(size);
+	}
+	else
+	{
+		for (const uint32_t* size : LINEAR_SIZES)
+			addCandidate(size);
+	}
+}
+
+bool WorkgroupTunerVk::Load()
+{
+	std::ifstream file(Filepath, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	FileHeader header;
+	if (!file.read((char*)&header, sizeof(header)))
+		return false;
+
+	// Tuned on another device or driver, start over
+	if (memcmp(header.Magic, "CWGT", 4) != 0 || header.Version != FILE_VERSION ||
+		header.VendorID != Properties.vendorID || header.DeviceID != Properties.deviceID ||
+		header.DriverVersion != Properties.driverVersion)
+		return false;
+
+	for (uint32_t i = 0; i < header.Count; ++i)
+	{
+		FileEntry entry;
+		if (!file.read((char*)&entry, sizeof(entry)))
+			return false;
+
+		Results[entry.Key] = { entry.Size[0], entry.Size[1], entry.Size[2] };
+	}
+
+	return true;
+}
+
+bool WorkgroupTunerVk::Save()
+{
+	std::lock_guard<std::mutex> lock(TunerMutex);
+
+	if (Results.empty())
+		return false;
+
+	FileHeader header = {};
+	memcpy(header.Magic, "CWGT", 4);
+	header.Version = FILE_VERSION;
+	header.VendorID = Properties.vendorID;
+	header.DeviceID = Properties.deviceID;
+	header.DriverVersion = Properties.driverVersion;
+	header.Count = (uint32_t)Results.size();
+
+	// Same as the pipeline cache, a crash while saving never leaves a truncated file behind
+	String tempPath = Filepath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file.write((const char*)&header, sizeof(header));
+		for (auto& [key, size] : Results)
+		{
+			FileEntry entry = { key, { size[0], size[1], size[2] }, 0 };
+			file.write((const char*)&entry, sizeof(entry));
+		}
+
+		if (!file.good())
+			return false;
+	}
+
+	std::remove(Filepath.c_str());
+	return std::rename(tempPath.c_str(), Filepath.c_str()) == 0;
+}
\ No newline at end of file
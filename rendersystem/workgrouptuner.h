@@ -0,0 +1,110 @@
+#pragma once
+#include "common_stl.h"
+#include "vulkan_common.h"
+#include "framescheduler.h"
+
+#include <mutex>
+
+class ShaderVk;
+
+// Finds the fastest workgroup size of autotuned compute shaders on the device they run on.
+// While a shader is tuned, its dispatches go through the candidate sizes one after the other, each one timed with
+// a pair of timestamps. The results are read when the frame slot comes around again, so tuning never waits on the GPU.
+// Once every candidate has its samples the fastest one sticks, and is saved for the next run on the same device.
+class WorkgroupTunerVk
+{
+public:
+	static constexpr uint32_t MAX_SAMPLES_PER_FRAME = 64;
+	static constexpr uint32_t SAMPLES_PER_CANDIDATE = 8;
+	static constexpr uint32_t NO_SAMPLE = UINT32_MAX;
+
+	// Without timestamps nothing is tuned, saved results are still used
+	bool Init(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits, const char* filepath);
+
+	// Saves the results, then destroys the queries
+	void Destroy();
+
+	// Read the samples of the frame that last used this slot, then reset the slot's queries
+	void BeginFrame(VkCommandBuffer cmd, uint32_t slotIndex);
+
+	// Thread safe. Workgroup size and pipeline to dispatch the threads with. While the shader is tuned this is
+	// the next candidate, and when a sample is asked for, the query pair to time the dispatch with or NO_SAMPLE.
+	VkPipeline Select(ShaderVk* shader, const uint32_t threads[3], uint32_t size[3], uint32_t* sample);
+
+	// Around the dispatch, nothing happens for NO_SAMPLE
+	void BeginSample(VkCommandBuffer cmd, uint32_t sample);
+	void EndSample(VkCommandBuffer cmd, uint32_t sample);
+
+private:
+
+	struct Candidate
+	{
+		ConstArray<uint32_t, 3> Size;
+		uint32_t Requested = 0;
+		Array<uint64_t> Ticks;
+		bool Failed = false;
+	};
+
+	struct Tuning
+	{
+		Array<Candidate> Candidates;
+		uint32_t Next = 0;
+
+		// The shader's own size, kept when no candidate could be measured
+		ConstArray<uint32_t, 3> BaseSize = { 1, 1, 1 };
+	};
+
+	struct Sample
+	{
+		uint64_t Key;
+		uint32_t Candidate;
+	};
+
+	struct SlotQueries
+	{
+		VkQueryPool Pool = VK_NULL_HANDLE;
+		Array<Sample> Samples;
+	};
+
+	// Header of the results file, results from another device or driver are dropped
+	struct FileHeader
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint32_t VendorID;
+		uint32_t DeviceID;
+		uint32_t DriverVersion;
+		uint32_t Count;
+	};
+
+	struct FileEntry
+	{
+		uint64_t Key;
+		uint32_t Size[3];
+		uint32_t Padding;
+	};
+
+	static constexpr uint32_t FILE_VERSION = 1;
+
+	void ResolveSlot(uint32_t slotIndex);
+	void Finish(uint64_t key, Tuning& tuning);
+	void MakeCandidates(const ShaderVk* shader, const uint32_t threads[3], Tuning& tuning) const;
+
+	bool Load();
+	bool Save();
+
+	VkDevice Device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties Properties = {};
+	String Filepath;
+
+	bool Enabled = false;
+	uint64_t TimestampMask = ~0ull;
+
+	ConstArray<SlotQueries, FrameSchedulerVk::MAX_FRAMES_IN_FLIGHT> Slots;
+	uint32_t CurrentSlot = 0;
+
+	// Keyed by shader code and thread counts, the best size depends on both
+	std::mutex TunerMutex;
+	Dict<uint64_t, Tuning> Tunings;
+	Dict<uint64_t, ConstArray<uint32_t, 3>> Results;
+};
\ No newline at end of file
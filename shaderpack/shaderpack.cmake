@@ -0,0 +1,9 @@
+set(LIBNAME shaderpack)
+
+set(src_dir ${PROJECT_ROOT_PATH}/shaderpack)
+
+set(sources ${src_dir}/shaderpack.cpp)
+set(headers ${PROJECT_ROOT_PATH}/public/rendersystem/shaderpack_format.h)
+
+add_executable(${LIBNAME} ${sources} ${headers} )
+set_property(TARGET shaderpack PROPERTY FOLDER "${SLN_FOLDER_PREFIX}Tools")
\ No newline at end of file
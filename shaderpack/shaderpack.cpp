@@ -0,0 +1,122 @@
+#include "common_stl.h"
+#include "libcommon/hash.h"
+#include "rendersystem/shaderpack_format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Packs SPIR-V files into one archive the rendersystem maps at startup.
+// Usage: shaderpack <output> <input.spv>...
+// Files are looked up by their name without directories, so names have to be unique.
+
+struct PackedFile
+{
+    String Name;
+    Array<char> Code;
+    ShaderPack::Entry Entry;
+};
+
+static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static bool ReadFile(const std::filesystem::path &path, Array<char> &data)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+
+    return file.good();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: shaderpack <output> <input.spv>...\n";
+        return 1;
+    }
+
+    Array<PackedFile> files;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::filesystem::path path = argv[i];
+
+        PackedFile packed = {};
+        packed.Name = path.filename().string();
+
+        if (!ReadFile(path, packed.Code) || packed.Code.empty() || packed.Code.size() % sizeof(uint32_t) != 0)
+        {
+            std::cerr << "shaderpack: " << path.string() << " is not valid SPIR-V\n";
+            return 1;
+        }
+
+        packed.Entry.NameHash = Hash::Fnv1a(packed.Name.data(), packed.Name.size());
+        packed.Entry.ContentHash = Hash::Fnv1a(packed.Code.data(), packed.Code.size());
+
+        for (PackedFile &other : files)
+        {
+            if (other.Entry.NameHash == packed.Entry.NameHash)
+            {
+                std::cerr << "shaderpack: " << packed.Name << " is packed twice or collides with " << other.Name << "\n";
+                return 1;
+            }
+        }
+
+        files.push_back(std::move(packed));
+    }
+
+    // Sorted so the runtime can binary search the index
+    std::sort(files.begin(), files.end(), [](const PackedFile &a, const PackedFile &b) { return a.Entry.NameHash < b.Entry.NameHash; });
+
+    ShaderPack::Header header = {};
+    header.Magic = ShaderPack::MAGIC;
+    header.Version = ShaderPack::VERSION;
+    header.EntryCount = (uint32_t)files.size();
+    header.IndexOffset = sizeof(header);
+
+    uint32_t offset = header.IndexOffset + header.EntryCount * sizeof(ShaderPack::Entry);
+    for (PackedFile &packed : files)
+    {
+        packed.Entry.NameOffset = offset;
+        packed.Entry.NameLength = (uint32_t)packed.Name.size();
+        offset += packed.Entry.NameLength;
+    }
+    for (PackedFile &packed : files)
+    {
+        offset = AlignUp(offset, ShaderPack::CODE_ALIGNMENT);
+        packed.Entry.CodeOffset = offset;
+        packed.Entry.CodeSize = (uint32_t)packed.Code.size();
+        offset += packed.Entry.CodeSize;
+    }
+
+    Array<char> archive(offset, 0);
+    memcpy(archive.data(), &header, sizeof(header));
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const PackedFile &packed = files[i];
+        memcpy(archive.data() + header.IndexOffset + i * sizeof(ShaderPack::Entry), &packed.Entry, sizeof(packed.Entry));
+        memcpy(archive.data() + packed.Entry.NameOffset, packed.Name.data(), packed.Entry.NameLength);
+        memcpy(archive.data() + packed.Entry.CodeOffset, packed.Code.data(), packed.Entry.CodeSize);
+    }
+
+    std::ofstream output(argv[1], std::ios::binary | std::ios::trunc);
+    if (!output.is_open())
+    {
+        std::cerr << "shaderpack: can't write " << argv[1] << "\n";
+        return 1;
+    }
+
+    output.write(archive.data(), archive.size());
+    return output.good() ? 0 : 1;
+}
\ No newline at end of file